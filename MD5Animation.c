@@ -1,140 +1,73 @@
 #include "MD5Animation.h"
+#include "MD5Parser.h"
+#include "MD5Memory.h"
+#include "MD5Thread.h"
 #include <stdio.h>
 #include <stdlib.h>
-#include <memory.h>
+#include <string.h>
 
-#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
-
-/*
-** read a line from a file. return 1 in case of EOF.
-*/ 
-static int readLine(char* line, int maxChars, FILE* file)
-{
-	char c;
-	int numChars = 0;
+typedef struct FxsMD5FrameCache FxsMD5FrameCache;
 
-	do
-	{
-		c = fgetc(file);
-		line[numChars] = c;
-		numChars++;
-	} 
-	while (c != EOF && c != '\r' && c != '\n' && numChars < maxChars - 1);
-
-    /* finish the string */
-	line[numChars - 1] = '\0';
-    
-    
-    /* swallow the line feed as well */
-    if (c == '\r')
-    {
-        c = fgetc(file);
-    }
-    
-    /* check for end of file */
-    if (c == EOF)
-    {
-        return 1;
-    }
-    else
-    {
-        return 0;
-    }
-}
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
 
 /*
-** Trims the line and removes comments. replace tabs with spaces and 
-** dont allow more than two spaces in a row.
+** Keywords at the beginning of a line of the animation file.
 */
-static void processLine(char* pline, const char* line)
+enum
 {
-    int i = 0;
-    int l = 0;
-    char* c;
-    int isPrevSpace = 0;
-    
-    /* find first non blank char in the line */
-    while (line[i] == ' ' || line[i] == '\t')
-    {
-        i++;
-    }
-    
-    /* cut line where comment is found */
-    c = strstr(line, "//");
-    
-    if (c)
-    {
-        *c = '\0';
-    }
-    
-    /* replace tabs and no more two or more spaces in a row */
-    while (line[i] != '\0')
-    {
-        if ((line[i] == '\t' || line[i] == ' ') && !isPrevSpace)
-        {
-            pline[l] = ' ';
-            l++;
-            isPrevSpace = 1;
-        }
-        else
-        {
-            isPrevSpace = 0;
-            pline[l] = line[i];
-            l++;
-        }
-        
-        i++;
-    }
-    
-    /* make sure: no spaces at the end of the line*/
-    if (l > 1 && pline[l - 1] == ' ')
-    {
-        pline[l-1] = '\0';
-    }
-    else
-    {
-        pline[l] = '\0';
-    }
-}
+    KEYWORD_NUM_FRAMES,
+    KEYWORD_NUM_JOINTS,
+    KEYWORD_FRAME_RATE,
+    KEYWORD_NUM_ANIMATED_COMPONENTS,
+    KEYWORD_HIERARCHY,
+    KEYWORD_BOUNDS,
+    KEYWORD_BASE_FRAME,
+    KEYWORD_FRAME,
+    NUM_KEYWORDS
+};
+
+static const char* const keywords[NUM_KEYWORDS] = {
+        "numFrames",
+        "numJoints",
+        "frameRate",
+        "numAnimatedComponents",
+        "hierarchy",
+        "bounds",
+        "baseframe",
+        "frame"
+    };
 
 /*
 ** Loads the joint hierachy. which is basically how joint information is stored.
 */
-static int loadHierarchy(FxsMD5Animation* animation, FILE* file)
+static int loadHierarchy(FxsMD5Animation* animation, FxsMD5Parser* parser)
 {
-	char line[256];
-	char pline[256];
-	int scres = 0;
-	char name[256];
-	char pname[256]; /* name of the joint w/o the quotation marks */
+	FxsMD5Token name;
 	int parent = 0;
 	int flags = 0;
 	int frameIndex = 0;
 	int count = 0;
-	int i = 0, j = 0; /* loop vars */
-	size_t len = 0;
 
 	while (1)
 	{
-		if (readLine(line, sizeof(line), file))
+		if (!FxsMD5ParserNextLine(parser))
 		{
 			ERR_MSG("unexpected end of line")
 			return 0; 
 		}
 		
-		processLine(pline, line);
-
-		scres = sscanf(
-				pline, 
-				"%s %d %d %d",
-				name,
-				&parent,
-				&flags,
-				&frameIndex
-			);
+		FxsMD5ParserReadToken(parser, &name);
+
+		/* leave loop if we meet the closing bracket */
+		if (FxsMD5TokenIs(&name, "}"))
+		{
+			break;
+		}
 
 		/* if everything could be read, add the joint to the animation */		
-		if (scres == 4) 
+		if (FxsMD5ParserReadInt(parser, &parent)
+		&& FxsMD5ParserReadInt(parser, &flags)
+		&& FxsMD5ParserReadInt(parser, &frameIndex)) 
 		{
 			/* complain if the amount of joints exceeds the intially promised
 			** value. 
@@ -145,27 +78,16 @@ static int loadHierarchy(FxsMD5Animation* animation, FILE* file)
 				return 0;
 			}		
 
-			/*lets remove the quotation marks of the joints name */
-			i = 0;
-			j = 0;
-
-			while (name[i] != '\0')
+			/* copy the joints name w/o the quotation marks */
+			animation->joints[count].name = FxsMD5TokenCopyUnquoted(&name);
+			
+			if (!animation->joints[count].name)
 			{
-				if (name[i] != '"')
-				{
-					pname[j] = name[i]; 
-					j++;
-				} 	
-				i++;
+				ERR_MSG("malloc failed")
+				return 0;
 			}
-			
-			pname[j] = '\0';			
-			
-			len = strlen(pname) + 1;	
-			
-			/* alloc some space for the joints name and copy */
-			animation->joints[count].name = (char*)malloc(len);
-			memcpy(animation->joints[count].name, pname, len);
+
+			FXS_MD5_STATS_ALLOC(animation->stats, name.length + 1);
 			
 			/*copy the rest */
 			animation->joints[count].parent = parent;		    
@@ -174,12 +96,6 @@ static int loadHierarchy(FxsMD5Animation* animation, FILE* file)
 
 			count++;
 		}
-
-		/* leave loop if we meet the closing bracket */
-		if (pline[0] == '}')
-		{
-			break;
-		}
 	}
 
 	/* complain if not enough joins could be loaded */
@@ -192,14 +108,36 @@ static int loadHierarchy(FxsMD5Animation* animation, FILE* file)
 	return 1;
 }
 
+/*
+** Reads a "( x y z ) ( x y z )" line. Returns 0 if it fails.
+*/
+static int readVectorPair(FxsMD5Parser* parser, FxsVector3* a, FxsVector3* b)
+{
+	float v[6];
+
+	if (!FxsMD5ParserReadTuple(parser, &v[0], 3)
+	|| !FxsMD5ParserReadTuple(parser, &v[3], 3))
+	{
+		return 0;
+	}
+
+	a->x = v[0];
+	a->y = v[1];
+	a->z = v[2];
+	b->x = v[3];
+	b->y = v[4];
+	b->z = v[5];
+
+	return 1;
+}
+
 /*
 ** Load the bounds
 */ 
-static int loadBounds(FxsMD5Animation* animation, FILE* file)
+static int loadBounds(FxsMD5Animation* animation, FxsMD5Parser* parser)
 {
-	char line[256];
-	char pline[256];
-	int scres = 0;
+	FxsMD5Parser line;
+	FxsMD5Token token;
 	FxsVector3 min;
 	FxsVector3 max;
 	int count = 0;
@@ -208,34 +146,22 @@ static int loadBounds(FxsMD5Animation* animation, FILE* file)
 	while (1)
 	{
 		/* complain if we reach the end of file */
-		if (readLine(line, sizeof(line), file)) 
+		if (!FxsMD5ParserNextLine(parser)) 
 		{
 			ERR_MSG("Unexpected end of file")
 			return 0;
 		}
 		
-		processLine(pline, line);
-
 		/* exit if we reach closing bracket */
-		if (pline[0] == '}') 
+		line = *parser;
+		
+		if (FxsMD5ParserReadToken(&line, &token) && FxsMD5TokenIs(&token, "}")) 
 		{
 		    break;
 		}
 
-		/* read in the bound by bound */
-		scres = sscanf(
-				pline, 
-				"( %f %f %f ) ( %f %f %f )",
-				&min.x,
-				&min.y,
-				&min.z,
-				&max.x,		
-				&max.y,		
-				&max.z		
-			);	
-
-		/* if bound was correctly read, store it */
-		if (scres == 6) 
+		/* read in the bound by bound, if bound was correctly read, store it */
+		if (readVectorPair(parser, &min, &max)) 
 		{
 		    /* complain if there are more bound than promised,
 			** there is a bound for each frame in the animation.
@@ -265,11 +191,10 @@ static int loadBounds(FxsMD5Animation* animation, FILE* file)
 	return 1;
 }
 
-int loadBaseFrame(FxsMD5Animation* animation, FILE* file)
+static int loadBaseFrame(FxsMD5Animation* animation, FxsMD5Parser* parser)
 {
-	char line[256];
-	char pline[256];
-	int scres = 0;
+	FxsMD5Parser line;
+	FxsMD5Token token;
 	FxsVector3 position;
 	FxsVector3 orientation;
 	int count = 0;
@@ -277,32 +202,21 @@ int loadBaseFrame(FxsMD5Animation* animation, FILE* file)
 	while (1)
 	{
 		/* compl. when eof */
-		if (readLine(line, sizeof(line), file))
+		if (!FxsMD5ParserNextLine(parser))
 		{
 			ERR_MSG("Unexpected end of file")
 			return 0;
 		}
 
-		processLine(pline, line);	
-	
 		/* end when we reach closing bracket */
-		if (pline[0] == '}')
+		line = *parser;
+		
+		if (FxsMD5ParserReadToken(&line, &token) && FxsMD5TokenIs(&token, "}"))
 		{
 			break;
 		}
 	
-		scres = sscanf(
-				pline, 
-				"( %f %f %f ) ( %f %f %f )",
-				&position.x,
-				&position.y,
-				&position.z,
-				&orientation.x,
-				&orientation.y,
-				&orientation.z
-			);
-
-		if (6 == scres) 
+		if (readVectorPair(parser, &position, &orientation)) 
 		{
 			/* cant load more than numJoints joints for baseframe */
 			if (count >= animation->numJoints) 
@@ -333,98 +247,686 @@ int loadBaseFrame(FxsMD5Animation* animation, FILE* file)
 }
 
 /*
-** loads data for a frame
+** Returns the row of frameData for a frame. Returns NULL if the frame is
+** out of range or was already loaded.
 */ 
-int loadFrame(FxsMD5Animation* animation, int frame, FILE* file)
+static float* frameSlot(FxsMD5Animation* animation, int frame)
 {
-    char line[256];
-    char pline[256];
-	size_t linelen;
-	int count = 0;
-	int i = 0;
-	char* numStart;
+	size_t frameDataSize;
 
 	/* make sure we don't load more frames than numFrames */
-	if (frame >= animation->numFrames) 
+	if (frame < 0 || frame >= animation->numFrames) 
 	{
 		ERR_MSG("Too many frames")
-	   	return 0; 
+	   	return NULL; 
 	}
 
-	/* malloc memory for a frame's components */
-	animation->frames[frame].data = (float*)malloc(
-			sizeof(float)*animation->numAnimatedComponents
-		);
+	/* every frame may only occur once */
+	if (animation->frames[frame].data)
+	{
+		ERR_MSG("Frame found more than once")
+		return NULL;
+	}
 
-	if (!animation->frames[frame].data) 
+	/* the components of all frames go to one block, alloc it with the 
+	** first frame.
+	*/
+	if (!animation->frameData)
 	{
-	    ERR_MSG("malloc failed")
-		return 0;
+		frameDataSize = sizeof(float)*animation->numAnimatedComponents
+			*animation->numFrames;
+
+		animation->frameData = (float*)FxsMD5AlignedAlloc(
+				frameDataSize,
+				FXS_MD5_ALIGNMENT
+			);
+
+		if (!animation->frameData) 
+		{
+		    ERR_MSG("malloc failed")
+			return NULL;
+		}
+
+		FXS_MD5_STATS_ALLOC(animation->stats, frameDataSize);
+
+		memset(animation->frameData, 0, frameDataSize);
 	}
 
-	memset(
-		animation->frames[frame].data,
-		0,
-		sizeof(float)*animation->numAnimatedComponents
-	);
+	animation->frames[frame].data = animation->frameData 
+		+ (size_t)frame*animation->numAnimatedComponents;
+
+	return animation->frames[frame].data;
+}
+
+/*
+** loads data for a frame, reads up to the closing bracket.
+*/ 
+static int loadFrame(
+	const FxsMD5Animation* animation, 
+	float* data, 
+	FxsMD5Parser* parser
+)
+{
+	FxsMD5Token token;
+	int count = 0;
+	float value;
 
 	/* read in frame */
 	while (1)
 	{
-		readLine(line, sizeof(line), file);
-		processLine(pline, line);	
+		if (!FxsMD5ParserNextLine(parser))
+		{
+			ERR_MSG("Unexpected end of file")
+			return 0;
+		}
+
+		/* read the run of numbers of this line at once */
+		count += FxsMD5ParserReadFloats(
+				parser,
+				data + count,
+				animation->numAnimatedComponents - count
+			);
+
+		/* the line can only go on with the closing bracket */
+		if (!FxsMD5ParserReadToken(parser, &token))
+		{
+			continue;
+		}
 
 		/* break if we reach closing bracket */
-		if (pline[0] == '}')
+		if (FxsMD5TokenIs(&token, "}"))
 		{
 			break;
 		}	
 
-		/* read numbers of this line */
-		i = 0;
-		numStart = &pline[0];
-		linelen = strlen(pline);
+		/* check if we are about to load more then numAnimatedComponents */
+		if (count >= animation->numAnimatedComponents
+		&& FxsMD5TokenToFloat(&token, &value)) 
+		{
+		    ERR_MSG("Too much frame components")
+			return 0;
+		}
+
+		ERR_MSG("Invalid frame component")
+		return 0;
+	}
 
-		while (1)
+	/* complain if not enough components were loaded */
+	if (animation->numAnimatedComponents != count) 
+	{
+	    ERR_MSG("Did not load enough frame components")
+		return 0;
+	}
+	
+	return 1;
+}
+
+/*
+** Returns the closing bracket of a block that starts at cur, brackets in
+** comments are skipped. Returns NULL if there is none.
+*/ 
+static const char* findClosingBracket(const char* cur, const char* end)
+{
+	const char* bracket;
+	const char* c;
+	int isComment;
+
+	while ((bracket = (const char*)memchr(cur, '}', end - cur)))
+	{
+		/* look for a comment between the line start and the bracket */
+		c = bracket;
+
+		while (c > cur && c[-1] != '\n')
 		{
-			/* check if we are about to load more then numAnimatedComponents */
-			if (count >= animation->numAnimatedComponents) 
-			{
-			    ERR_MSG("Too much frame components")
-				return 0;
-			}
+			c--;
+		}
 
-			/* every time we find a space or the terminating zero, we read in
-			** a number
-			*/
-			if (pline[i] == ' ' || pline[i] == '\0') 
-			{
-			    pline[i] = '\0';
-				animation->frames[frame].data[count] = atof(numStart);
-				numStart = pline + i + 1;
-				count++;
-			}
-		
-			/* break when we reached the end of the line */
-			if (i == linelen) 
+		isComment = 0;
+
+		for (; c + 1 < bracket; c++)
+		{
+			if (c[0] == '/' && c[1] == '/')
 			{
-			    break;
+				isComment = 1;
+				break;
 			}
+		}
 
-			i++;
+		if (!isComment)
+		{
+			return bracket;
 		}
+
+		cur = bracket + 1;
 	}
-	
-	/* complain if not enough components were loaded */
-	if (animation->numAnimatedComponents != count) 
+
+	return NULL;
+}
+
+/*
+** Frame blocks found by the pre-scan, parsed in parallel.
+*/ 
+typedef struct
+{
+	float* data;                /* row of the frame in frameData */
+	FxsMD5Parser parser;        /* parser over the block */
+}
+FrameJob;
+
+typedef struct
+{
+	const FxsMD5Animation* animation;
+	FrameJob* jobs;
+	unsigned int numJobs;
+	unsigned int capacity;
+	unsigned int nextJob;       /* first job not taken by a thread yet */
+	unsigned int loadedFrames;
+	int success;
+	FxsMD5Mutex mutex;
+}
+FrameJobs;
+
+/*
+** # of frames a thread takes at once.
+*/
+#define FRAME_JOB_CHUNK 16
+
+/*
+** Records a frame block for parallel parsing and moves the parser past it.
+** Returns 0 if it fails.
+*/ 
+static int addFrameJob(FrameJobs* jobs, float* data, FxsMD5Parser* parser)
+{
+	const char* bracket;
+	FrameJob* grown;
+
+	bracket = findClosingBracket(parser->cur, parser->end);
+
+	if (!bracket)
 	{
-	    ERR_MSG("Did not load enough frame components")
+		ERR_MSG("Unexpected end of file")
 		return 0;
 	}
-	
+
+	if (jobs->numJobs == jobs->capacity)
+	{
+		jobs->capacity = jobs->capacity ? jobs->capacity*2 : 64;
+		grown = (FrameJob*)realloc(jobs->jobs, jobs->capacity*sizeof(FrameJob));
+
+		if (!grown)
+		{
+			ERR_MSG("malloc failed")
+			return 0;
+		}
+
+		jobs->jobs = grown;
+		FXS_MD5_STATS_ALLOC(jobs->animation->stats, jobs->capacity*sizeof(FrameJob));
+	}
+
+	/* the job continues where the parser is now, after "frame N {" */
+	jobs->jobs[jobs->numJobs].data = data;
+	jobs->jobs[jobs->numJobs].parser = *parser;
+	jobs->jobs[jobs->numJobs].parser.end = bracket + 1;
+	jobs->jobs[jobs->numJobs].parser.numLines = 0;
+	jobs->numJobs++;
+
+	/* the main parser goes on with the line after the bracket */
+	parser->cur = bracket;
+
+	return 1;
+}
+
+static void* frameWorker(void* arg)
+{
+	FrameJobs* jobs = (FrameJobs*)arg;
+	unsigned int begin = 0;
+	unsigned int end = 0;
+	unsigned int loaded = 0;
+	unsigned int i = 0;
+	int success = 1;
+
+	while (success)
+	{
+		/* take the next chunk of frames */
+		FxsMD5MutexLock(&jobs->mutex);
+
+		begin = jobs->nextJob;
+		end = begin + FRAME_JOB_CHUNK < jobs->numJobs ? 
+			begin + FRAME_JOB_CHUNK : jobs->numJobs;
+		jobs->nextJob = end;
+		success = jobs->success;
+
+		FxsMD5MutexUnlock(&jobs->mutex);
+
+		if (begin >= end)
+		{
+			break;
+		}
+
+		for (i = begin; success && i < end; i++)
+		{
+			success = loadFrame(jobs->animation, jobs->jobs[i].data, &jobs->jobs[i].parser);
+			loaded += success;
+		}
+	}
+
+	FxsMD5MutexLock(&jobs->mutex);
+	jobs->loadedFrames += loaded;
+	jobs->success = jobs->success && success;
+	FxsMD5MutexUnlock(&jobs->mutex);
+
+	return NULL;
+}
+
+/*
+** Parses the recorded frame blocks on numThreads threads, the calling thread
+** is one of them. Returns 0 if a frame failed to load.
+*/ 
+static int runFrameJobs(FrameJobs* jobs, unsigned int numThreads)
+{
+	FxsMD5Thread* threads;
+	unsigned int numStarted = 0;
+	unsigned int i = 0;
+
+	if (numThreads > (jobs->numJobs + FRAME_JOB_CHUNK - 1)/FRAME_JOB_CHUNK)
+	{
+		numThreads = (jobs->numJobs + FRAME_JOB_CHUNK - 1)/FRAME_JOB_CHUNK;
+	}
+
+	threads = (FxsMD5Thread*)malloc(sizeof(FxsMD5Thread)*numThreads);
+
+	if (threads)
+	{
+		FXS_MD5_STATS_ALLOC(jobs->animation->stats, sizeof(FxsMD5Thread)*numThreads);
+	}
+
+	/* if threads can not be started, the calling thread does all the work */
+	for (i = 1; threads && i < numThreads; i++)
+	{
+		if (!FxsMD5ThreadCreate(&threads[numStarted], frameWorker, jobs))
+		{
+			break;
+		}
+
+		numStarted++;
+	}
+
+	frameWorker(jobs);
+
+	for (i = 0; i < numStarted; i++)
+	{
+		FxsMD5ThreadJoin(&threads[i]);
+	}
+
+	free(threads);
+
+	return jobs->success;
+}
+
+/*
+** A decoded frame in the frame cache. Entries form a list from the most to
+** the least recently used entry.
+*/
+typedef struct
+{
+    int frame;              /* decoded frame, -1 if the entry is empty */
+    int isReady;            /* 0 while the frame is decoded */
+    unsigned int refCount;  /* # of users, entries in use are not evicted */
+    int prev;
+    int next;
+}
+CacheEntry;
+
+struct FxsMD5FrameCache
+{
+    FxsMD5File file;        /* the text file, stays mapped */
+    const char** frameStarts;   /* position after "frame N {" of each frame */
+    int* entryOfFrame;      /* entry of each frame, -1 if not decoded */
+    float* data;            /* numEntries rows of components */
+    CacheEntry* entries;
+    unsigned int numEntries;
+    int head;               /* most recently used entry */
+    int tail;               /* least recently used entry */
+    FxsMD5Mutex mutex;
+    FxsMD5Condition decoded;    /* signaled when a frame was decoded */
+};
+
+static void destroyFrameCache(FxsMD5FrameCache* cache)
+{
+    if (!cache)
+    {
+        return;
+    }
+
+    FxsMD5FileClose(&cache->file);
+    free((void*)cache->frameStarts);
+    free(cache->entryOfFrame);
+    free(cache->entries);
+    FxsMD5AlignedFree(cache->data);
+    FxsMD5MutexDestroy(&cache->mutex);
+    FxsMD5ConditionDestroy(&cache->decoded);
+    free(cache);
+}
+
+static FxsMD5FrameCache* createFrameCache(
+    const FxsMD5Animation* animation, 
+    unsigned int numEntries
+)
+{
+    FxsMD5FrameCache* cache;
+    unsigned int i = 0;
+
+    if (numEntries == 0)
+    {
+        numEntries = FXS_MD5_DEFAULT_FRAME_CACHE_SIZE;
+    }
+
+    cache = (FxsMD5FrameCache*)malloc(sizeof(FxsMD5FrameCache));
+
+    if (!cache)
+    {
+        ERR_MSG("malloc failed")
+        return NULL;
+    }
+
+    FXS_MD5_STATS_ALLOC(animation->stats, sizeof(FxsMD5FrameCache));
+    memset(cache, 0, sizeof(FxsMD5FrameCache));
+    FxsMD5MutexInit(&cache->mutex);
+    FxsMD5ConditionInit(&cache->decoded);
+
+    cache->numEntries = numEntries;
+    cache->frameStarts = (const char**)malloc(
+            sizeof(const char*)*animation->numFrames
+        );
+    cache->entryOfFrame = (int*)malloc(sizeof(int)*animation->numFrames);
+    cache->entries = (CacheEntry*)malloc(sizeof(CacheEntry)*numEntries);
+    cache->data = (float*)FxsMD5AlignedAlloc(
+            sizeof(float)*animation->numAnimatedComponents*numEntries,
+            FXS_MD5_ALIGNMENT
+        );
+
+    if (!cache->frameStarts || !cache->entryOfFrame || !cache->entries
+    || !cache->data)
+    {
+        ERR_MSG("malloc failed")
+        destroyFrameCache(cache);
+        return NULL;
+    }
+
+    FXS_MD5_STATS_ALLOC(animation->stats, sizeof(const char*)*animation->numFrames);
+    FXS_MD5_STATS_ALLOC(animation->stats, sizeof(int)*animation->numFrames);
+    FXS_MD5_STATS_ALLOC(animation->stats, sizeof(CacheEntry)*numEntries);
+    FXS_MD5_STATS_ALLOC(
+        animation->stats,
+        sizeof(float)*animation->numAnimatedComponents*numEntries
+    );
+
+    for (i = 0; i < animation->numFrames; i++)
+    {
+        cache->frameStarts[i] = NULL;
+        cache->entryOfFrame[i] = -1;
+    }
+
+    /* all entries are empty and listed in order */
+    for (i = 0; i < numEntries; i++)
+    {
+        cache->entries[i].frame = -1;
+        cache->entries[i].isReady = 0;
+        cache->entries[i].refCount = 0;
+        cache->entries[i].prev = (int)i - 1;
+        cache->entries[i].next = i + 1 < numEntries ? (int)i + 1 : -1;
+    }
+
+    cache->head = 0;
+    cache->tail = numEntries - 1;
+
+    return cache;
+}
+
+/*
+** Records the position of a frame block for lazy decoding and moves the 
+** parser past it. Returns 0 if it fails.
+*/ 
+static int addLazyFrame(
+    FxsMD5Animation* animation, 
+    int frame, 
+    FxsMD5Parser* parser
+)
+{
+    const char* bracket;
+    FxsMD5FrameCache* cache = animation->frameCache;
+
+	if (frame < 0 || frame >= animation->numFrames) 
+	{
+		ERR_MSG("Too many frames")
+	   	return 0; 
+	}
+
+	if (cache->frameStarts[frame])
+	{
+		ERR_MSG("Frame found more than once")
+		return 0;
+	}
+
+	bracket = findClosingBracket(parser->cur, parser->end);
+
+	if (!bracket)
+	{
+		ERR_MSG("Unexpected end of file")
+		return 0;
+	}
+
+	cache->frameStarts[frame] = parser->cur;
+	parser->cur = bracket;
+
 	return 1;
 }
 
+/*
+** Moves an entry to the front of the LRU list.
+*/ 
+static void touchEntry(FxsMD5FrameCache* cache, int e)
+{
+    CacheEntry* entries = cache->entries;
+
+    if (cache->head == e)
+    {
+        return;
+    }
+
+    /* unlink */
+    entries[entries[e].prev].next = entries[e].next;
+
+    if (entries[e].next >= 0)
+    {
+        entries[entries[e].next].prev = entries[e].prev;
+    }
+    else
+    {
+        cache->tail = entries[e].prev;
+    }
+
+    /* link in front */
+    entries[e].prev = -1;
+    entries[e].next = cache->head;
+    entries[cache->head].prev = e;
+    cache->head = e;
+}
+
+/*
+** Returns the frame of a lazy animation, decodes it if it is not in the 
+** cache.
+*/ 
+static const float* acquireCachedFrame(
+    const FxsMD5Animation* animation, 
+    unsigned int frame
+)
+{
+    FxsMD5FrameCache* cache = animation->frameCache;
+    FxsMD5Parser parser;
+    float* row;
+    int e;
+    int success;
+
+    FxsMD5MutexLock(&cache->mutex);
+
+    /* wait if another thread is decoding the frame right now */
+    while ((e = cache->entryOfFrame[frame]) >= 0 && !cache->entries[e].isReady)
+    {
+        FxsMD5ConditionWait(&cache->decoded, &cache->mutex);
+    }
+
+    if (e >= 0)
+    {
+        cache->entries[e].refCount++;
+        touchEntry(cache, e);
+        FXS_MD5_STATS_ADD(animation->stats, numFrameCacheHits, 1);
+        FxsMD5MutexUnlock(&cache->mutex);
+
+        return cache->data + (size_t)e*animation->numAnimatedComponents;
+    }
+
+    /* evict the least recently used entry that is not in use */
+    for (e = cache->tail; e >= 0 && cache->entries[e].refCount; e = cache->entries[e].prev)
+    {
+    }
+
+    /* all entries are in use, FxsMD5AnimationCopyFrame does w/o one */
+    if (e < 0)
+    {
+        FxsMD5MutexUnlock(&cache->mutex);
+        return NULL;
+    }
+
+    if (cache->entries[e].frame >= 0)
+    {
+        cache->entryOfFrame[cache->entries[e].frame] = -1;
+    }
+
+    cache->entries[e].frame = frame;
+    cache->entries[e].isReady = 0;
+    cache->entries[e].refCount = 1;
+    cache->entryOfFrame[frame] = e;
+    touchEntry(cache, e);
+    FXS_MD5_STATS_ADD(animation->stats, numFrameCacheMisses, 1);
+
+    FxsMD5MutexUnlock(&cache->mutex);
+
+    /* decode w/o holding the lock */
+    row = cache->data + (size_t)e*animation->numAnimatedComponents;
+    FxsMD5ParserInit(&parser, cache->frameStarts[frame], cache->file.data + cache->file.size);
+    parser.started = 1;
+    success = loadFrame(animation, row, &parser);
+
+    FxsMD5MutexLock(&cache->mutex);
+
+    FXS_MD5_STATS_ADD(animation->stats, numLines, parser.numLines);
+
+    if (success)
+    {
+        cache->entries[e].isReady = 1;
+    }
+    else
+    {
+        cache->entries[e].frame = -1;
+        cache->entries[e].refCount = 0;
+        cache->entryOfFrame[frame] = -1;
+    }
+
+    FxsMD5ConditionBroadcast(&cache->decoded);
+    FxsMD5MutexUnlock(&cache->mutex);
+
+    return success ? row : NULL;
+}
+
+const float* FxsMD5AnimationAcquireFrame(
+    const FxsMD5Animation* animation, 
+    unsigned int frame
+)
+{
+    if (frame >= animation->numFrames)
+    {
+        return NULL;
+    }
+
+    if (animation->frameCache)
+    {
+        return acquireCachedFrame(animation, frame);
+    }
+
+    return animation->frames[frame].data;
+}
+
+void FxsMD5AnimationReleaseFrame(
+    const FxsMD5Animation* animation, 
+    unsigned int frame
+)
+{
+    FxsMD5FrameCache* cache = animation->frameCache;
+    int e;
+
+    if (!cache || frame >= animation->numFrames)
+    {
+        return;
+    }
+
+    FxsMD5MutexLock(&cache->mutex);
+
+    e = cache->entryOfFrame[frame];
+
+    if (e >= 0 && cache->entries[e].refCount)
+    {
+        cache->entries[e].refCount--;
+    }
+
+    FxsMD5MutexUnlock(&cache->mutex);
+}
+
+int FxsMD5AnimationCopyFrame(
+    const FxsMD5Animation* animation, 
+    unsigned int frame,
+    float* data
+)
+{
+    FxsMD5FrameCache* cache = animation->frameCache;
+    FxsMD5Parser parser;
+    const float* row;
+    int success;
+
+    if (frame >= animation->numFrames)
+    {
+        return 0;
+    }
+
+    row = FxsMD5AnimationAcquireFrame(animation, frame);
+
+    if (row)
+    {
+        memcpy(data, row, sizeof(float)*animation->numAnimatedComponents);
+        FxsMD5AnimationReleaseFrame(animation, frame);
+        return 1;
+    }
+
+    if (!cache)
+    {
+        return 0;
+    }
+
+    /* the cache is full, decode the frame into data w/o caching it, the
+    ** frame positions do not change after loading
+    */
+    FxsMD5ParserInit(&parser, cache->frameStarts[frame], cache->file.data + cache->file.size);
+    parser.started = 1;
+    success = loadFrame(animation, data, &parser);
+
+    FxsMD5MutexLock(&cache->mutex);
+    FXS_MD5_STATS_ADD(animation->stats, numFrameCacheMisses, 1);
+    FXS_MD5_STATS_ADD(animation->stats, numLines, parser.numLines);
+    FxsMD5MutexUnlock(&cache->mutex);
+
+    return success;
+}
+
 /*
 ** Loads an animation from a file.
 */
@@ -433,47 +935,77 @@ int FxsMD5AnimationCreateWithFile(
 	const char* filename
 )
 {
-    FILE* file;
-    char line[256];
-    char pline[256];
-    int isEOF = 0;
+    return FxsMD5AnimationCreateWithFileAndOptions(animation, filename, NULL);
+}
+
+int FxsMD5AnimationCreateWithFileAndOptions(
+	FxsMD5Animation** animation, 
+	const char* filename,
+	const FxsMD5AnimationLoadOptions* options
+)
+{
+    FxsMD5File file;
+    FxsMD5Parser parser;
+    FxsMD5Token token;
+    FrameJobs jobs;
+    float* data;
+    unsigned int numThreads = options ? options->numThreads : 0;
+    int isLazy = options ? options->isLazy : 0;
+    FxsMD5Stats* stats = options ? options->stats : NULL;
+    unsigned long long start;
+    unsigned int i;
     int numFrames = 0; /* # of animation frames */
 	int numJoints = 0; /* # of joints */
 	int frameRate = 0; /* frame rate of the animation */
 	int numAnimationedComponents; 
-	int scres = 0;     /* result of sscanf */
 	int frame = 0;
     int loadedFrames = 0;
     int success = 1;
     
-    file = fopen(filename, "r");
-    
-    if (!file)
+    if (!FxsMD5FileOpen(&file, filename, 0))
     {
-        ERR_MSG("Could not open file")
         return 0;
     }
     
     *animation = (FxsMD5Animation*)malloc(sizeof(FxsMD5Animation));
-	memset(*animation, 0, sizeof(animation));
     
     if (!*animation)
     {
         ERR_MSG("could not alloc animation")
+        FxsMD5FileClose(&file);
         return 0;
     }
     
-    /* load the animation from file */
-    while (1)
+	memset(*animation, 0, sizeof(FxsMD5Animation));
+    (*animation)->stats = stats;
+    
+    FXS_MD5_STATS_ALLOC(stats, sizeof(FxsMD5Animation));
+    FXS_MD5_STATS_ADD(stats, bytesRead, file.size);
+
+    if (!file.isMapped && file.size)
     {
-        isEOF = readLine(line, sizeof(line), file);
-        processLine(pline, line);
+        FXS_MD5_STATS_ALLOC(stats, file.size);
+    }
+    FxsMD5ParserInit(&parser, file.data, file.data + file.size);
+    
+    /* with more than one thread, frame blocks are only located in the file
+    ** and parsed in parallel after the rest of the file was read.
+    */
+    memset(&jobs, 0, sizeof(FrameJobs));
+    jobs.animation = *animation;
+    jobs.success = 1;
+    FxsMD5MutexInit(&jobs.mutex);
+    
+    /* load the animation from file, dispatch on the first token of a line */
+    while (success && FxsMD5ParserNextLine(&parser))
+    {
+        FxsMD5ParserReadToken(&parser, &token);
         
-        if (strstr(pline, "numFrames") == pline) /* # of frames */
+        switch (FxsMD5TokenMatch(&token, keywords, NUM_KEYWORDS))
         {
-        	scres = sscanf(pline, "numFrames %d", &numFrames);	    
-			
-			if (scres == 1) 
+        case KEYWORD_NUM_FRAMES: /* # of frames */
+        
+			if (FxsMD5ParserReadInt(&parser, &numFrames)) 
 			{
 				(*animation)->numFrames = numFrames; 
 				
@@ -489,6 +1021,8 @@ int FxsMD5AnimationCreateWithFile(
                     break;
 				}
 
+				FXS_MD5_STATS_ALLOC(stats, numFrames*sizeof(FxsMD5AnimationFrame));
+
 				memset(
 					(*animation)->frames, 
 					0, 
@@ -506,18 +1040,20 @@ int FxsMD5AnimationCreateWithFile(
                     break;
 				}
 
+				FXS_MD5_STATS_ALLOC(stats, numFrames*sizeof(FxsMD5AnimationBound));
+
 				memset(
 					(*animation)->bounds,
 					0,
 					numFrames*sizeof(FxsMD5AnimationBound)
 				);
 			}
-        }
-		else if (strstr(pline, "numJoints") == pline)  /* # of joints */
-		{
-			scres = sscanf(pline, "numJoints %d", &numJoints);
 			
-			if (scres == 1) 
+			break;
+			
+		case KEYWORD_NUM_JOINTS: /* # of joints */
+		
+			if (FxsMD5ParserReadInt(&parser, &numJoints)) 
 			{
 			  	(*animation)->numJoints = numJoints; 
 
@@ -533,6 +1069,8 @@ int FxsMD5AnimationCreateWithFile(
                     success = 0;
                     break;
 			    }		
+
+				FXS_MD5_STATS_ALLOC(stats, numJoints*sizeof(FxsMD5AnimationJoint));
 		
 				memset(
 					(*animation)->joints, 
@@ -556,6 +1094,9 @@ int FxsMD5AnimationCreateWithFile(
                     success = 0;
                     break;
 				}
+
+				FXS_MD5_STATS_ALLOC(stats, numJoints*sizeof(FxsVector3));
+				FXS_MD5_STATS_ALLOC(stats, numJoints*sizeof(FxsQuaternion));
 				
 				memset(
 					(*animation)->baseFrame.positions, 
@@ -569,86 +1110,163 @@ int FxsMD5AnimationCreateWithFile(
 					sizeof(FxsQuaternion)*numJoints
 				);
 			}
+			
+			break;
 		
-		} 
-		else if (strstr(pline, "frameRate") == pline) /* frame rate */
-		{
-			scres = sscanf(pline, "frameRate %d", &frameRate);	
+		case KEYWORD_FRAME_RATE: /* frame rate */
 		
-			if (scres == 1) 
+			if (FxsMD5ParserReadInt(&parser, &frameRate)) 
 			{
 			    (*animation)->frameRate = frameRate;
 			}
-		}
-		else if (strstr(pline, "numAnimatedComponents") == pline) /* # animated components */ 
-		{
-			scres = sscanf(
-					pline, 
-					"numAnimatedComponents %d", 
-					&numAnimationedComponents
-				);
 			
-			if (scres == 1) 
+			break;
+			
+		case KEYWORD_NUM_ANIMATED_COMPONENTS: /* # animated components */ 
+		
+			if (FxsMD5ParserReadInt(&parser, &numAnimationedComponents)) 
 			{
 				(*animation)->numAnimatedComponents = numAnimationedComponents;
 			}
-		}
-		else if (strstr(pline, "hierarchy {") == pline) /* joint hierarchy */
-		{
-			if (!loadHierarchy(*animation, file))
+			
+			break;
+			
+		case KEYWORD_HIERARCHY: /* joint hierarchy */
+		
+			start = FXS_MD5_STATS_TIME(stats);
+
+			if (FxsMD5ParserExpect(&parser, '{')
+			&& !loadHierarchy(*animation, &parser))
 			{
 			    success = 0;
-				break;
 			} 
-		}
-		else if (strstr(pline, "bounds {") == pline) /* bounds */
-		{
-			if (!loadBounds(*animation, file))
+			
+			FXS_MD5_STATS_SECTION(stats, FXS_MD5_SECTION_HIERARCHY, start);
+			break;
+			
+		case KEYWORD_BOUNDS: /* bounds */
+		
+			start = FXS_MD5_STATS_TIME(stats);
+
+			if (FxsMD5ParserExpect(&parser, '{')
+			&& !loadBounds(*animation, &parser))
 			{
 			    success = 0;
-				break;
 			}
-		}
-		else if (strstr(pline, "baseframe {") == pline) /* base frame */
-		{
-			if (!loadBaseFrame(*animation, file))
+			
+			FXS_MD5_STATS_SECTION(stats, FXS_MD5_SECTION_BOUNDS, start);
+			break;
+			
+		case KEYWORD_BASE_FRAME: /* base frame */
+		
+			start = FXS_MD5_STATS_TIME(stats);
+
+			if (FxsMD5ParserExpect(&parser, '{')
+			&& !loadBaseFrame(*animation, &parser))
 			{
 			    success = 0;
+			}
+			
+			FXS_MD5_STATS_SECTION(stats, FXS_MD5_SECTION_BASE_FRAME, start);
+			break;
+			
+		case KEYWORD_FRAME: /* frame data */
+		
+			if (!FxsMD5ParserReadInt(&parser, &frame)
+			|| !FxsMD5ParserExpect(&parser, '{'))
+			{
 				break;
 			}
-		}
-		else if (sscanf(pline, "frame %d {", &frame) == 1)
-		{
-            /* NOTE frame should occur more than one time,
-            ** this check was not implemented.
-            */
-			if (!loadFrame(*animation, frame, file)) 
+			
+			start = FXS_MD5_STATS_TIME(stats);
+			
+			/* lazy animations only remember where the frame is */
+			if (isLazy)
+			{
+			    if (!(*animation)->frameCache)
+			    {
+			        (*animation)->frameCache = createFrameCache(
+			                *animation, 
+			                options->frameCacheSize
+			            );
+			    }
+			    
+			    success = (*animation)->frameCache 
+			        && addLazyFrame(*animation, frame, &parser);
+			    
+			    loadedFrames += success;
+			    FXS_MD5_STATS_SECTION(stats, FXS_MD5_SECTION_FRAMES, start);
+			    break;
+			}
+			
+			data = frameSlot(*animation, frame);
+			
+			if (!data)
+			{
+			    success = 0;
+			}
+			else if (numThreads > 1)
+			{
+			    success = addFrameJob(&jobs, data, &parser);
+			}
+			else if (!loadFrame(*animation, data, &parser)) 
 			{
 			    success = 0;
-				break;
 			}
             else
             {
                 loadedFrames++;
             }
+            
+            FXS_MD5_STATS_SECTION(stats, FXS_MD5_SECTION_FRAMES, start);
+            break;
+            
+        default:
+            break;
 		}
-        
-        if (isEOF)
+    }
+    
+    /* parse the frame blocks found */
+    if (success && jobs.numJobs)
+    {
+        start = FXS_MD5_STATS_TIME(stats);
+        success = runFrameJobs(&jobs, numThreads);
+        loadedFrames += jobs.loadedFrames;
+        FXS_MD5_STATS_SECTION(stats, FXS_MD5_SECTION_FRAMES, start);
+
+        for (i = 0; i < jobs.numJobs; i++)
         {
-            break;
+            FXS_MD5_STATS_ADD(stats, numLines, jobs.jobs[i].parser.numLines);
         }
-        
     }
     
+    free(jobs.jobs);
+    FxsMD5MutexDestroy(&jobs.mutex);
+    
     /* complain if not all frames were loaded*/
-    if (loadedFrames != numFrames)
+    if (success && loadedFrames != numFrames)
     {
         ERR_MSG("not enough frames loaded");
         success = 0;
     }
+
+    /* prepare the frame decoding */
+    if (success)
+    {
+        success = FxsMD5AnimationCompile(*animation);
+    }
     
-    /* clean up */
-    fclose(file);
+    /* clean up, a lazy animation keeps the file */
+    if ((*animation)->frameCache)
+    {
+        (*animation)->frameCache->file = file;
+    }
+    else
+    {
+        FxsMD5FileClose(&file);
+    }
+
+    FXS_MD5_STATS_ADD(stats, numLines, parser.numLines);
 
     if (!success)
     {
@@ -662,32 +1280,33 @@ int FxsMD5AnimationCreateWithFile(
 void FxsMD5AnimationDestroy(FxsMD5Animation** animation)
 {
     int  i = 0;
-    FxsMD5AnimationFrame* frame;
+    FxsMD5File file;
     
     if (!(*animation))
     {
         return;
     }
 
-    /* delete all frames */
+    FxsMD5AnimationFreeProgram(*animation);
+
+    /* an animation loaded from a binary file lives in the file */
+    if ((*animation)->storage)
+    {
+        memcpy(&file, (*animation)->storage, sizeof(FxsMD5File));
+        FxsMD5FileClose(&file);
+        *animation = NULL;
+        return;
+    }
+
+    /* delete all frames, their data is one block */
     if ((*animation)->frames)
     {
-        for (i = 0; i < (*animation)->numFrames; i++)
-        {
-            frame = (*animation)->frames + i;
-        
-            if (frame)
-            {
-                if (frame->data)
-                {
-                    free(frame->data);
-                }
-            }
-        }
-        
         free((*animation)->frames);
     }
 
+    FxsMD5AlignedFree((*animation)->frameData);
+    destroyFrameCache((*animation)->frameCache);
+
     /* delete base frame data */
     if ((*animation)->baseFrame.positions)
     {
@@ -721,5 +1340,5 @@ void FxsMD5AnimationDestroy(FxsMD5Animation** animation)
     
     /* delete the animation */
     free(*animation);
-    animation = NULL;
+    *animation = NULL;
 }
\ No newline at end of file
@@ -6,8 +6,10 @@ extern "C"
 {
 #endif
 
+#include <stddef.h>
 #include <Fxs/Math/Vector3.h>
 #include <Fxs/Math/Quaternion.h>
+#include "MD5Stats.h"
 
 /*
 ** Bitflags that indicate the components of the Animation joint.
@@ -47,7 +49,9 @@ FxsMD5AnimationBaseFrame;
 
 typedef struct
 {
-    float* data;    /* information about the joint update for a frame */
+    float* data;    /* information about the joint update for a frame, points
+                    ** into the frameData of the animation.
+                    */
 }
 FxsMD5AnimationFrame;
 
@@ -59,16 +63,177 @@ typedef struct
     unsigned int numAnimatedComponents;
 
     FxsMD5AnimationFrame* frames;
+    float* frameData;   /* components of all frames, numFrames rows of 
+                        ** numAnimatedComponents floats, cache line aligned.
+                        */
     FxsMD5AnimationBaseFrame baseFrame;
     FxsMD5AnimationJoint* joints;
 	FxsMD5AnimationBound* bounds;
+
+    void* storage;      /* binary file the animation lives in, NULL if the 
+                        ** animation was loaded from a text file.
+                        */
+    struct FxsMD5FrameCache* frameCache;    /* decoded frames of a lazily
+                                            ** loaded animation, NULL if all
+                                            ** frames are in frameData.
+                                            */
+    struct FxsMD5DecodeProgram* program;    /* joints grouped by flags, see
+                                            ** FxsMD5AnimationCompile.
+                                            */
+    FxsMD5Stats* stats;     /* counts the frame cache lookups, NULL if they
+                            ** are not counted, see MD5Stats.h
+                            */
 }
 FxsMD5Animation;
 
 
+/*
+** Options for loading an animation from a text file.
+*/
+typedef struct
+{
+    unsigned int numThreads;    /* # of threads that parse the frames, 0 or 1
+                                ** parses them on the calling thread. 
+                                ** FxsMD5NumProcessors() is a good value for
+                                ** long animations.
+                                */
+    int isLazy;                 /* if set, frames are only located in the file
+                                ** and decoded when they are first used.
+                                ** frames[].data and frameData stay NULL, use
+                                ** FxsMD5AnimationAcquireFrame.
+                                */
+    unsigned int frameCacheSize;    /* # of decoded frames a lazy animation
+                                    ** keeps, 0 for the default.
+                                    */
+    FxsMD5Stats* stats;         /* counts the loading and later the frame
+                                ** cache lookups of the animation, may be
+                                ** NULL
+                                */
+}
+FxsMD5AnimationLoadOptions;
+
+/*
+** Default # of decoded frames of a lazy animation.
+*/
+#define FXS_MD5_DEFAULT_FRAME_CACHE_SIZE 16
+
 int FxsMD5AnimationCreateWithFile(FxsMD5Animation** animation, const char* filename);
+
+/*
+** Loads an animation from a file, options may be NULL for the defaults.
+** Returns 0 if it fails.
+*/
+int FxsMD5AnimationCreateWithFileAndOptions(
+    FxsMD5Animation** animation, 
+    const char* filename,
+    const FxsMD5AnimationLoadOptions* options
+);
+
+/*
+** Loads an animation from a binary file written by 
+** FxsMD5AnimationWriteBinaryFile. The file is mapped and the animation uses
+** its arrays in place. Returns 0 if it fails.
+*/
+int FxsMD5AnimationCreateWithBinaryFile(
+    FxsMD5Animation** animation, 
+    const char* filename
+);
+
+/*
+** Writes an animation to a binary file. Returns 0 if it fails.
+*/
+int FxsMD5AnimationWriteBinaryFile(
+    const FxsMD5Animation* animation, 
+    const char* filename
+);
+
 void FxsMD5AnimationDestroy(FxsMD5Animation** animation);
 
+/*
+** Returns the numAnimatedComponents components of a frame. Frames of lazy 
+** animations are decoded on first use and stay in the frame cache until
+** they are released. Every successful call has to be matched by 
+** FxsMD5AnimationReleaseFrame. Both functions are thread safe.
+** Returns NULL if the frame does not exist or can not be decoded, or if all
+** frames in the cache are in use.
+*/
+const float* FxsMD5AnimationAcquireFrame(
+    const FxsMD5Animation* animation, 
+    unsigned int frame
+);
+
+void FxsMD5AnimationReleaseFrame(
+    const FxsMD5Animation* animation, 
+    unsigned int frame
+);
+
+/*
+** Copies the numAnimatedComponents components of a frame to data. Frames
+** of lazy animations that are not in the frame cache are decoded into data
+** directly if all frames in the cache are in use, so unlike
+** FxsMD5AnimationAcquireFrame it does not fail on a full cache. Thread
+** safe. Returns 0 if the frame does not exist or can not be decoded.
+*/
+int FxsMD5AnimationCopyFrame(
+    const FxsMD5Animation* animation, 
+    unsigned int frame,
+    float* data
+);
+
+/*
+** Groups the joints by their flags for FxsMD5AnimationDecodeFrame, the
+** loaders call it. Returns 0 if a joint references components that are not
+** in the frames.
+*/
+int FxsMD5AnimationCompile(FxsMD5Animation* animation);
+
+/*
+** Decodes the joints of a frame into 6 arrays of numJoints floats: x, y, z
+** of the positions and of the orientations (w is not stored in the file).
+** Components that do not change come from the base frame. Returns 0 if the
+** frame does not exist or can not be decoded.
+*/
+int FxsMD5AnimationDecodeFrame(
+    const FxsMD5Animation* animation,
+    unsigned int frame,
+    float* const* components
+);
+
+/*
+** Frees the program of FxsMD5AnimationCompile along with the scratch
+** buffers, FxsMD5AnimationDestroy calls it.
+*/
+void FxsMD5AnimationFreeProgram(FxsMD5Animation* animation);
+
+/*
+** Returns a cache line aligned scratch buffer of at least size bytes for a
+** pose update, NULL if it fails. Every buffer has to be given back with
+** FxsMD5AnimationReleaseScratch. The animation keeps released buffers and
+** hands them out again, so pose updates stop allocating after the first
+** ones. Both functions are thread safe.
+*/
+void* FxsMD5AnimationAcquireScratch(
+    const FxsMD5Animation* animation,
+    size_t size
+);
+
+void FxsMD5AnimationReleaseScratch(
+    const FxsMD5Animation* animation,
+    void* buffer
+);
+
+/*
+** Completes count decoded orientations, orientations holds the x, y, z and
+** w arrays. The files store x, y, z of a unit quaternion, w is the negative
+** root that makes its length 1. Axes that are too long for that are
+** normalized and get w = 0. All pose updates and local poses get their w
+** from here, so they agree exactly.
+*/
+void FxsMD5AnimationCompleteOrientations(
+    float* const* orientations,
+    unsigned int count
+);
+
 #ifdef __cplusplus
 }
 #endif
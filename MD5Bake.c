@@ -0,0 +1,337 @@
+/*
+** Baked animations. Every frame is evaluated once on a copy of the pose of
+** the mesh and the world transforms of the joints are stored, either as
+** 3x4 matrices or compact as quantized quaternions and translations, so
+** playing a frame only copies or decodes transforms.
+*/
+
+#include "MD5Bake.h"
+#include "MD5Memory.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** Element (row, column) of a column major 4x4 matrix.
+*/
+#define AT(m, row, column) ((m)[(column)*4 + (row)])
+
+/*
+** Scale of the quaternion components of a FxsMD5BakedJoint.
+*/
+#define SNORM16_ONE 32767.0f
+
+/*
+** Encodes a joint transform as a quaternion and a translation.
+*/
+static void encodeJoint(FxsMD5BakedJoint* joint, const float* m)
+{
+    float q[4];                 /* x, y, z, w */
+    float trace = AT(m, 0, 0) + AT(m, 1, 1) + AT(m, 2, 2);
+    float s;
+    float norm;
+    int i;
+
+    /* divide by the largest of the four terms */
+    if (trace > 0.0f)
+    {
+        s = sqrtf(trace + 1.0f)*2.0f;
+        q[3] = 0.25f*s;
+        q[0] = (AT(m, 2, 1) - AT(m, 1, 2))/s;
+        q[1] = (AT(m, 0, 2) - AT(m, 2, 0))/s;
+        q[2] = (AT(m, 1, 0) - AT(m, 0, 1))/s;
+    }
+    else if (AT(m, 0, 0) > AT(m, 1, 1) && AT(m, 0, 0) > AT(m, 2, 2))
+    {
+        s = sqrtf(1.0f + AT(m, 0, 0) - AT(m, 1, 1) - AT(m, 2, 2))*2.0f;
+        q[3] = (AT(m, 2, 1) - AT(m, 1, 2))/s;
+        q[0] = 0.25f*s;
+        q[1] = (AT(m, 0, 1) + AT(m, 1, 0))/s;
+        q[2] = (AT(m, 0, 2) + AT(m, 2, 0))/s;
+    }
+    else if (AT(m, 1, 1) > AT(m, 2, 2))
+    {
+        s = sqrtf(1.0f + AT(m, 1, 1) - AT(m, 0, 0) - AT(m, 2, 2))*2.0f;
+        q[3] = (AT(m, 0, 2) - AT(m, 2, 0))/s;
+        q[0] = (AT(m, 0, 1) + AT(m, 1, 0))/s;
+        q[1] = 0.25f*s;
+        q[2] = (AT(m, 1, 2) + AT(m, 2, 1))/s;
+    }
+    else
+    {
+        s = sqrtf(1.0f + AT(m, 2, 2) - AT(m, 0, 0) - AT(m, 1, 1))*2.0f;
+        q[3] = (AT(m, 1, 0) - AT(m, 0, 1))/s;
+        q[0] = (AT(m, 0, 2) + AT(m, 2, 0))/s;
+        q[1] = (AT(m, 1, 2) + AT(m, 2, 1))/s;
+        q[2] = 0.25f*s;
+    }
+
+    norm = 1.0f/sqrtf(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+
+    for (i = 0; i < 4; i++)
+    {
+        joint->orientation[i] = (short)floorf(q[i]*norm*SNORM16_ONE + 0.5f);
+    }
+
+    joint->position[0] = AT(m, 0, 3);
+    joint->position[1] = AT(m, 1, 3);
+    joint->position[2] = AT(m, 2, 3);
+}
+
+/*
+** Decodes a FxsMD5BakedJoint into the upper 3 rows of a transform, row
+** major.
+*/
+static void decodeJoint(float* r, const FxsMD5BakedJoint* joint)
+{
+    float x = joint->orientation[0];
+    float y = joint->orientation[1];
+    float z = joint->orientation[2];
+    float w = joint->orientation[3];
+    float norm = 1.0f/sqrtf(x*x + y*y + z*z + w*w);
+
+    x *= norm;
+    y *= norm;
+    z *= norm;
+    w *= norm;
+
+    /* the rotation of FxsMatrix4MakeRotationWithQuaternion */
+    r[0] = 1.0f - 2.0f*(y*y + z*z);
+    r[1] = 2.0f*(x*y - w*z);
+    r[2] = 2.0f*(x*z + w*y);
+    r[3] = joint->position[0];
+    r[4] = 2.0f*(x*y + w*z);
+    r[5] = 1.0f - 2.0f*(x*x + z*z);
+    r[6] = 2.0f*(y*z - w*x);
+    r[7] = joint->position[1];
+    r[8] = 2.0f*(x*z - w*y);
+    r[9] = 2.0f*(y*z + w*x);
+    r[10] = 1.0f - 2.0f*(x*x + y*y);
+    r[11] = joint->position[2];
+}
+
+/*
+** Stores the upper 3 rows of a row major transform in a FxsMatrix4.
+*/
+static void storeTransform(FxsMatrix4* transform, const float* r)
+{
+    float* t = (float*)transform;
+    int c;
+
+    for (c = 0; c < 4; c++)
+    {
+        AT(t, 0, c) = r[0*4 + c];
+        AT(t, 1, c) = r[1*4 + c];
+        AT(t, 2, c) = r[2*4 + c];
+        AT(t, 3, c) = c < 3 ? 0.0f : 1.0f;
+    }
+}
+
+int FxsMD5BakedAnimationCreate(
+    FxsMD5BakedAnimation** baked,
+    const FxsMD5Mesh* mesh,
+    const FxsMD5Animation* animation,
+    int encoding
+)
+{
+    FxsMD5Mesh scratch;
+    size_t jointSize;
+    char* frameData;
+    const float* m;
+    unsigned int f;
+    int i, c;
+
+    *baked = NULL;
+
+    if (encoding != FXS_MD5_BAKE_MATRIX && encoding != FXS_MD5_BAKE_COMPACT)
+    {
+        ERR_MSG("Unknown encoding");
+        return 0;
+    }
+
+    if (animation->numJoints != (unsigned int)mesh->currentPose.numJoints)
+    {
+        /* animation does not apply to this mesh ... */
+        return 0;
+    }
+
+    jointSize = encoding == FXS_MD5_BAKE_MATRIX ? sizeof(FxsMD5BakedMatrix)
+        : sizeof(FxsMD5BakedJoint);
+
+    *baked = (FxsMD5BakedAnimation*)malloc(sizeof(FxsMD5BakedAnimation));
+
+    if (!*baked)
+    {
+        ERR_MSG("malloc failed");
+        return 0;
+    }
+
+    memset(*baked, 0, sizeof(FxsMD5BakedAnimation));
+
+    (*baked)->numFrames = animation->numFrames;
+    (*baked)->numJoints = animation->numJoints;
+    (*baked)->encoding = encoding;
+    (*baked)->frameSize = jointSize*animation->numJoints;
+    (*baked)->data = FxsMD5AlignedAlloc(
+            (*baked)->frameSize*animation->numFrames,
+            FXS_MD5_ALIGNMENT
+        );
+
+    /* the frames are evaluated on a copy of the pose, not on the mesh */
+    memset(&scratch, 0, sizeof(FxsMD5Mesh));
+    scratch.currentPose.numJoints = mesh->currentPose.numJoints;
+
+    if (mesh->currentPose.numJoints)
+    {
+        scratch.currentPose.joints = (FxsMD5Joint*)malloc(
+                sizeof(FxsMD5Joint)*mesh->currentPose.numJoints
+            );
+
+        if (scratch.currentPose.joints)
+        {
+            memcpy(
+                scratch.currentPose.joints,
+                mesh->currentPose.joints,
+                sizeof(FxsMD5Joint)*mesh->currentPose.numJoints
+            );
+        }
+    }
+
+    if (!(*baked)->data
+    || (mesh->currentPose.numJoints && !scratch.currentPose.joints))
+    {
+        ERR_MSG("malloc failed");
+        free(scratch.currentPose.joints);
+        FxsMD5BakedAnimationDestroy(baked);
+        return 0;
+    }
+
+    for (f = 0; f < animation->numFrames; f++)
+    {
+        if (!FxsMD5MeshUpdatePoseWithAnimationFrame(&scratch, animation, f))
+        {
+            free(scratch.currentPose.joints);
+            FxsMD5BakedAnimationDestroy(baked);
+            return 0;
+        }
+
+        frameData = (char*)(*baked)->data + f*(*baked)->frameSize;
+
+        for (i = 0; i < scratch.currentPose.numJoints; i++)
+        {
+            m = (const float*)&scratch.currentPose.joints[i].transform;
+
+            if (encoding == FXS_MD5_BAKE_COMPACT)
+            {
+                encodeJoint((FxsMD5BakedJoint*)frameData + i, m);
+                continue;
+            }
+
+            for (c = 0; c < 4; c++)
+            {
+                ((FxsMD5BakedMatrix*)frameData)[i].m[0*4 + c] = AT(m, 0, c);
+                ((FxsMD5BakedMatrix*)frameData)[i].m[1*4 + c] = AT(m, 1, c);
+                ((FxsMD5BakedMatrix*)frameData)[i].m[2*4 + c] = AT(m, 2, c);
+            }
+        }
+    }
+
+    free(scratch.currentPose.joints);
+
+    return 1;
+}
+
+void FxsMD5BakedAnimationDestroy(FxsMD5BakedAnimation** baked)
+{
+    if (!*baked)
+    {
+        return;
+    }
+
+    FxsMD5AlignedFree((*baked)->data);
+    free(*baked);
+
+    *baked = NULL;
+}
+
+const void* FxsMD5BakedAnimationFrame(
+    const FxsMD5BakedAnimation* baked,
+    unsigned int frame
+)
+{
+    if (frame >= baked->numFrames)
+    {
+        return NULL;
+    }
+
+    return (const char*)baked->data + frame*baked->frameSize;
+}
+
+/*
+** Decodes the transform of a joint of a frame.
+*/
+static void jointTransform(
+    const FxsMD5BakedAnimation* baked,
+    const void* frameData,
+    unsigned int joint,
+    FxsMatrix4* transform
+)
+{
+    float r[12];
+
+    if (baked->encoding == FXS_MD5_BAKE_COMPACT)
+    {
+        decodeJoint(r, (const FxsMD5BakedJoint*)frameData + joint);
+        storeTransform(transform, r);
+    }
+    else
+    {
+        storeTransform(transform, ((const FxsMD5BakedMatrix*)frameData)[joint].m);
+    }
+}
+
+int FxsMD5BakedAnimationJointTransform(
+    const FxsMD5BakedAnimation* baked,
+    unsigned int frame,
+    unsigned int joint,
+    FxsMatrix4* transform
+)
+{
+    const void* frameData = FxsMD5BakedAnimationFrame(baked, frame);
+
+    if (!frameData || joint >= baked->numJoints)
+    {
+        return 0;
+    }
+
+    jointTransform(baked, frameData, joint, transform);
+
+    return 1;
+}
+
+int FxsMD5MeshUpdatePoseWithBakedFrame(
+    FxsMD5Mesh* mesh,
+    const FxsMD5BakedAnimation* baked,
+    unsigned int frame
+)
+{
+    const void* frameData = FxsMD5BakedAnimationFrame(baked, frame);
+    unsigned int i;
+
+    if (!frameData || baked->numJoints != (unsigned int)mesh->currentPose.numJoints)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < baked->numJoints; i++)
+    {
+        jointTransform(baked, frameData, i, &mesh->currentPose.joints[i].transform);
+    }
+
+    FXS_MD5_STATS_ADD(mesh->stats, numPoseUpdates, 1);
+
+    return 1;
+}
@@ -0,0 +1,106 @@
+#ifndef MD5BAKE_H
+#define MD5BAKE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include "MD5Mesh.h"
+
+/*
+** Encodings of the joint transforms of a baked animation.
+*/
+#define FXS_MD5_BAKE_MATRIX     0   /* FxsMD5BakedMatrix, 48 bytes */
+#define FXS_MD5_BAKE_COMPACT    1   /* FxsMD5BakedJoint, 20 bytes */
+
+/*
+** Upper 3 rows of a joint transform, row major, like a
+** FXS_MD5_PALETTE_3X4 palette entry.
+*/
+typedef struct
+{
+    float m[12];
+}
+FxsMD5BakedMatrix;
+
+/*
+** A joint transform as a rotation and a translation. The rotation is a
+** quaternion x, y, z, w with components scaled to [-32767, 32767].
+*/
+typedef struct
+{
+    short orientation[4];
+    float position[3];
+}
+FxsMD5BakedJoint;
+
+/*
+** The world transforms of all joints in all frames of an animation, frame
+** after frame in one block.
+*/
+typedef struct
+{
+    unsigned int numFrames;
+    unsigned int numJoints;
+    int encoding;               /* FXS_MD5_BAKE_* */
+    size_t frameSize;           /* bytes per frame */
+    void* data;                 /* frame f starts at data + f*frameSize */
+}
+FxsMD5BakedAnimation;
+
+/*
+** Evaluates every frame of an animation for the skeleton of a mesh and
+** stores the joint transforms with an encoding. The mesh is not changed.
+** Returns 0 if it fails, e.g. if the animation does not fit the mesh.
+*/
+int FxsMD5BakedAnimationCreate(
+    FxsMD5BakedAnimation** baked,
+    const FxsMD5Mesh* mesh,
+    const FxsMD5Animation* animation,
+    int encoding
+);
+
+/*
+** Releases the baked animation.
+*/
+void FxsMD5BakedAnimationDestroy(FxsMD5BakedAnimation** baked);
+
+/*
+** Returns the joint transforms of a frame, numJoints FxsMD5BakedMatrix or
+** FxsMD5BakedJoint depending on the encoding, NULL if the frame does not
+** exist.
+*/
+const void* FxsMD5BakedAnimationFrame(
+    const FxsMD5BakedAnimation* baked,
+    unsigned int frame
+);
+
+/*
+** Decodes the transform of a joint in a frame. Returns 0 if the frame or
+** joint does not exist.
+*/
+int FxsMD5BakedAnimationJointTransform(
+    const FxsMD5BakedAnimation* baked,
+    unsigned int frame,
+    unsigned int joint,
+    FxsMatrix4* transform
+);
+
+/*
+** Sets the joint transforms of the current pose of a mesh to a baked frame.
+** The local positions and orientations of the joints are not changed.
+** Returns 0 if the frame does not exist or does not fit the mesh.
+*/
+int FxsMD5MeshUpdatePoseWithBakedFrame(
+    FxsMD5Mesh* mesh,
+    const FxsMD5BakedAnimation* baked,
+    unsigned int frame
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5BAKE_H */
@@ -0,0 +1,825 @@
+/*
+** Binary files of meshes and animations.
+**
+** A binary file is an image of the objects as they are in memory: the
+** structs and arrays are stored as they are, pointers are stored as offsets
+** from the beginning of the file. Loading maps the file (copy on write) and
+** turns the offsets back into pointers, the arrays are used in place.
+**
+** The file starts with a header followed by a FxsMD5File slot, which is
+** filled in on load, so that the object knows how to release its storage.
+** Binary files are specific to the struct layouts (and hence the platform)
+** they were written with, the header records the layout and the loader
+** rejects files that do not match.
+*/
+
+#include "MD5Mesh.h"
+#include "MD5Parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** Version of the binary format, increment on any change.
+*/
+#define FXS_MD5_BINARY_VERSION 7
+
+#define MESH_MAGIC "FXSMD5M"
+#define ANIMATION_MAGIC "FXSMD5A"
+
+/*
+** Alignment of the blocks in a binary file, frame data is aligned to cache
+** lines.
+*/
+#define BLOCK_ALIGNMENT 16
+#define FRAME_ALIGNMENT 64
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t layout;        /* signature of the struct layouts */
+    uint64_t size;          /* size of the file */
+    uint64_t root;          /* offset of the mesh/animation */
+    uint64_t storage;       /* offset of the FxsMD5File slot */
+}
+BinaryHeader;
+
+/*
+** A binary file that is built in memory. Blocks are addressed by their
+** offset as the data moves when it grows.
+*/
+typedef struct
+{
+    char* data;
+    size_t size;
+    size_t capacity;
+    int failed;             /* set if an allocation failed */
+}
+Image;
+
+#define IMAGE_AT(image, offset, type) ((type*)((image)->data + (offset)))
+
+/*
+** Signature of the layouts of all structs in a binary file.
+*/
+static uint32_t layoutSignature(void)
+{
+    const size_t sizes[] = {
+            sizeof(void*),
+            sizeof(FxsMD5File),
+            sizeof(FxsMD5Mesh),
+            sizeof(FxsMD5Joint),
+            sizeof(FxsMD5SubMesh),
+            sizeof(FxsMD5Face),
+            sizeof(FxsMD5Vertex),
+            sizeof(FxsMD5Weight),
+            sizeof(FxsMD5Animation),
+            sizeof(FxsMD5AnimationFrame),
+            sizeof(FxsMD5AnimationJoint),
+            sizeof(FxsMD5AnimationBound),
+            sizeof(FxsVector3),
+            sizeof(FxsQuaternion),
+            sizeof(FxsMatrix4)
+        };
+    uint32_t hash = 2166136261u;
+    size_t i = 0;
+
+    /* FNV-1a over the sizes, plus a word to detect the byte order */
+    for (i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+    {
+        hash = (hash ^ (uint32_t)sizes[i])*16777619u;
+    }
+
+    return (hash ^ 0x01020304u)*16777619u;
+}
+
+/*
+** Reserves a zeroed block in the image. Returns its offset.
+*/
+static size_t imageAlloc(Image* image, size_t size, size_t alignment)
+{
+    size_t offset = (image->size + alignment - 1) & ~(alignment - 1);
+    size_t capacity = image->capacity;
+    char* data;
+
+    if (image->failed)
+    {
+        return 0;
+    }
+
+    if (offset + size > capacity)
+    {
+        while (offset + size > capacity)
+        {
+            capacity = capacity ? capacity*2 : 4096;
+        }
+
+        data = (char*)realloc(image->data, capacity);
+
+        if (!data)
+        {
+            ERR_MSG("malloc failed")
+            image->failed = 1;
+            return 0;
+        }
+
+        image->data = data;
+        image->capacity = capacity;
+    }
+
+    memset(image->data + image->size, 0, offset + size - image->size);
+    image->size = offset + size;
+
+    return offset;
+}
+
+/*
+** Copies an array to the image. Returns its offset, 0 for empty arrays.
+*/
+static size_t imageArray(
+    Image* image,
+    const void* data,
+    size_t size,
+    size_t alignment
+)
+{
+    size_t offset;
+
+    if (!data || !size)
+    {
+        return 0;
+    }
+
+    offset = imageAlloc(image, size, alignment);
+
+    if (!image->failed)
+    {
+        memcpy(image->data + offset, data, size);
+    }
+
+    return offset;
+}
+
+static size_t imageString(Image* image, const char* str)
+{
+    return str ? imageArray(image, str, strlen(str) + 1, 1) : 0;
+}
+
+/*
+** Stores an offset in a pointer field of a struct in the image.
+*/
+static void storeOffset(Image* image, size_t fieldOffset, size_t offset)
+{
+    uintptr_t value = (uintptr_t)offset;
+
+    if (!image->failed)
+    {
+        memcpy(image->data + fieldOffset, &value, sizeof(value));
+    }
+}
+
+#define STORE_OFFSET(image, structOffset, type, field, offset) \
+    storeOffset( \
+        (image), \
+        (structOffset) + offsetof(type, field), \
+        (offset) \
+    )
+
+/*
+** Starts an image with the file header and the storage slot.
+*/
+static void imageInit(Image* image, const char* magic)
+{
+    BinaryHeader* header;
+    size_t offset;
+
+    memset(image, 0, sizeof(Image));
+
+    imageAlloc(image, sizeof(BinaryHeader), BLOCK_ALIGNMENT);
+    offset = imageAlloc(image, sizeof(FxsMD5File), BLOCK_ALIGNMENT);
+
+    if (image->failed)
+    {
+        return;
+    }
+
+    header = IMAGE_AT(image, 0, BinaryHeader);
+    memcpy(header->magic, magic, sizeof(header->magic));
+    header->version = FXS_MD5_BINARY_VERSION;
+    header->layout = layoutSignature();
+    header->storage = offset;
+}
+
+/*
+** Finishes the header and writes the image to a file, releases the image.
+** Returns 0 if it fails.
+*/
+static int imageWrite(Image* image, size_t root, const char* filename)
+{
+    FILE* file;
+    int success = 0;
+
+    if (!image->failed)
+    {
+        IMAGE_AT(image, 0, BinaryHeader)->size = image->size;
+        IMAGE_AT(image, 0, BinaryHeader)->root = root;
+
+        file = fopen(filename, "wb");
+
+        if (!file)
+        {
+            ERR_MSG("Could not open file")
+        }
+        else
+        {
+            success = fwrite(image->data, 1, image->size, file) == image->size;
+            success = (fclose(file) == 0) && success;
+
+            if (!success)
+            {
+                ERR_MSG("Could not write file")
+            }
+        }
+    }
+
+    free(image->data);
+
+    return success;
+}
+
+/*
+** Maps a binary file and checks its header. Returns the root object or NULL
+** if the file is not a valid binary file.
+*/
+static void* openBinary(
+    FxsMD5File* file,
+    const char* filename,
+    const char* magic,
+    size_t rootSize
+)
+{
+    BinaryHeader* header;
+
+    if (!FxsMD5FileOpen(file, filename, 1))
+    {
+        return NULL;
+    }
+
+    header = (BinaryHeader*)file->data;
+
+    if (file->size < sizeof(BinaryHeader)
+    || memcmp(header->magic, magic, sizeof(header->magic)) != 0)
+    {
+        ERR_MSG("Not a binary MD5 file")
+    }
+    else if (header->version != FXS_MD5_BINARY_VERSION
+    || header->layout != layoutSignature())
+    {
+        ERR_MSG("Binary MD5 file has an incompatible version or layout")
+    }
+    else if (header->size != file->size
+    || header->root < sizeof(BinaryHeader)
+    || header->root % BLOCK_ALIGNMENT
+    || header->root + rootSize > file->size
+    || header->storage < sizeof(BinaryHeader)
+    || header->storage % BLOCK_ALIGNMENT
+    || header->storage + sizeof(FxsMD5File) > file->size)
+    {
+        ERR_MSG("Binary MD5 file is corrupt")
+    }
+    else
+    {
+        /* the storage slot remembers how to release the file */
+        memcpy(file->data + header->storage, file, sizeof(FxsMD5File));
+
+        return file->data + header->root;
+    }
+
+    FxsMD5FileClose(file);
+
+    return NULL;
+}
+
+/*
+** Turns the offset in a pointer field into a pointer to a block of count
+** elements. Returns 0 if the block is not within the file or misaligned.
+*/
+static int relocateAligned(
+    const FxsMD5File* file,
+    void* field,
+    long long count,
+    size_t elementSize,
+    size_t alignment
+)
+{
+    uintptr_t offset;
+    void* ptr;
+
+    memcpy(&offset, field, sizeof(offset));
+
+    if (count < 0)
+    {
+        return 0;
+    }
+
+    /* empty arrays might be NULL */
+    if (offset == 0)
+    {
+        return count == 0;
+    }
+
+    if (offset < sizeof(BinaryHeader)
+    || offset > file->size
+    || offset % alignment
+    || (size_t)count > (file->size - offset)/elementSize)
+    {
+        return 0;
+    }
+
+    ptr = file->data + offset;
+    memcpy(field, &ptr, sizeof(ptr));
+
+    return 1;
+}
+
+/*
+** Relocates an array that starts a block.
+*/
+static int relocate(
+    const FxsMD5File* file,
+    void* field,
+    long long count,
+    size_t elementSize
+)
+{
+    return relocateAligned(file, field, count, elementSize, BLOCK_ALIGNMENT);
+}
+
+/*
+** Same as relocate, for zero terminated strings.
+*/
+static int relocateString(const FxsMD5File* file, char** field)
+{
+    uintptr_t offset;
+
+    memcpy(&offset, field, sizeof(offset));
+
+    if (offset == 0)
+    {
+        return 1;
+    }
+
+    if (offset < sizeof(BinaryHeader)
+    || offset >= file->size
+    || !memchr(file->data + offset, '\0', file->size - offset))
+    {
+        return 0;
+    }
+
+    *field = file->data + offset;
+
+    return 1;
+}
+
+/*
+** Copies joints and their names to the image. Returns the offset of the
+** joints.
+*/
+static size_t imageJoints(Image* image, const FxsMD5Skeleton* skeleton)
+{
+    size_t offset;
+    int i = 0;
+
+    offset = imageArray(
+            image,
+            skeleton->joints,
+            sizeof(FxsMD5Joint)*skeleton->numJoints,
+            BLOCK_ALIGNMENT
+        );
+
+    for (i = 0; i < skeleton->numJoints; i++)
+    {
+        STORE_OFFSET(
+            image,
+            offset + i*sizeof(FxsMD5Joint),
+            FxsMD5Joint,
+            name,
+            imageString(image, skeleton->joints[i].name)
+        );
+    }
+
+    return offset;
+}
+
+static int relocateJoints(const FxsMD5File* file, FxsMD5Skeleton* skeleton)
+{
+    int i = 0;
+
+    if (!relocate(file, &skeleton->joints, skeleton->numJoints, sizeof(FxsMD5Joint)))
+    {
+        return 0;
+    }
+
+    for (i = 0; i < skeleton->numJoints; i++)
+    {
+        if (!relocateString(file, &skeleton->joints[i].name))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+** Relocates the compacted weights of a submesh, if it has any.
+*/
+static int relocateInfluences(const FxsMD5File* file, FxsMD5SubMesh* sm)
+{
+    FxsMD5Influences* influences = &sm->influences;
+    long long count = (long long)influences->numInfluences*sm->numVertices;
+
+    if (!influences->numInfluences)
+    {
+        return !influences->joints && !influences->weights
+            && !influences->positions;
+    }
+
+    if (sm->numVertices < 0
+    || (influences->indexSize != 1 && influences->indexSize != 2))
+    {
+        return 0;
+    }
+
+    return relocate(file, &influences->joints, count, influences->indexSize)
+        && relocate(file, &influences->weights, count, sizeof(unsigned short))
+        && relocate(file, &influences->positions, 3LL*sm->numVertices, sizeof(float));
+}
+
+int FxsMD5MeshWriteBinaryFile(const FxsMD5Mesh* mesh, const char* filename)
+{
+    Image image;
+    size_t root;
+    size_t meshes;
+    size_t subMesh;
+    const FxsMD5SubMesh* sm;
+    unsigned int i = 0;
+
+    imageInit(&image, MESH_MAGIC);
+
+    root = imageArray(&image, mesh, sizeof(FxsMD5Mesh), BLOCK_ALIGNMENT);
+    STORE_OFFSET(&image, root, FxsMD5Mesh, storage, 0);
+    STORE_OFFSET(&image, root, FxsMD5Mesh, stats, 0);
+
+    STORE_OFFSET(
+        &image, root, FxsMD5Mesh, bindPose.joints,
+        imageJoints(&image, &mesh->bindPose)
+    );
+
+    STORE_OFFSET(
+        &image, root, FxsMD5Mesh, currentPose.joints,
+        imageJoints(&image, &mesh->currentPose)
+    );
+
+    /* sub-meshes */
+    meshes = imageArray(
+            &image,
+            mesh->meshes,
+            sizeof(FxsMD5SubMesh)*mesh->numSubMeshes,
+            BLOCK_ALIGNMENT
+        );
+
+    STORE_OFFSET(&image, root, FxsMD5Mesh, meshes, meshes);
+    STORE_OFFSET(
+        &image, root, FxsMD5Mesh, inverseBindPose,
+        imageArray(
+            &image,
+            mesh->inverseBindPose,
+            sizeof(FxsMatrix4)*mesh->bindPose.numJoints,
+            BLOCK_ALIGNMENT
+        )
+    );
+
+    for (i = 0; i < mesh->numSubMeshes; i++)
+    {
+        sm = &mesh->meshes[i];
+        subMesh = meshes + i*sizeof(FxsMD5SubMesh);
+
+        STORE_OFFSET(
+            &image, subMesh, FxsMD5SubMesh, shader,
+            imageString(&image, sm->shader)
+        );
+
+        STORE_OFFSET(
+            &image, subMesh, FxsMD5SubMesh, faces,
+            imageArray(
+                &image,
+                sm->faces,
+                sizeof(FxsMD5Face)*sm->numFaces,
+                BLOCK_ALIGNMENT
+            )
+        );
+
+        STORE_OFFSET(
+            &image, subMesh, FxsMD5SubMesh, weights,
+            imageArray(
+                &image,
+                sm->weights,
+                sizeof(FxsMD5Weight)*sm->numWeights,
+                BLOCK_ALIGNMENT
+            )
+        );
+
+        STORE_OFFSET(
+            &image, subMesh, FxsMD5SubMesh, vertices,
+            imageArray(
+                &image,
+                sm->vertices,
+                sizeof(FxsMD5Vertex)*sm->numVertices,
+                BLOCK_ALIGNMENT
+            )
+        );
+
+        STORE_OFFSET(
+            &image, subMesh, FxsMD5SubMesh, influences.joints,
+            imageArray(
+                &image,
+                sm->influences.joints,
+                (size_t)sm->influences.indexSize*sm->influences.numInfluences
+                    *sm->numVertices,
+                BLOCK_ALIGNMENT
+            )
+        );
+
+        STORE_OFFSET(
+            &image, subMesh, FxsMD5SubMesh, influences.weights,
+            imageArray(
+                &image,
+                sm->influences.weights,
+                sizeof(unsigned short)*sm->influences.numInfluences
+                    *sm->numVertices,
+                BLOCK_ALIGNMENT
+            )
+        );
+
+        STORE_OFFSET(
+            &image, subMesh, FxsMD5SubMesh, influences.positions,
+            imageArray(
+                &image,
+                sm->influences.positions,
+                sm->influences.numInfluences ? sizeof(float)*3*sm->numVertices : 0,
+                BLOCK_ALIGNMENT
+            )
+        );
+    }
+
+    return imageWrite(&image, root, filename);
+}
+
+int FxsMD5MeshCreateWithBinaryFile(FxsMD5Mesh** mesh, const char* filename)
+{
+    FxsMD5File file;
+    FxsMD5Mesh* m;
+    FxsMD5SubMesh* sm;
+    BinaryHeader* header;
+    unsigned int i = 0;
+    int success = 1;
+
+    *mesh = NULL;
+    m = (FxsMD5Mesh*)openBinary(&file, filename, MESH_MAGIC, sizeof(FxsMD5Mesh));
+
+    if (!m)
+    {
+        return 0;
+    }
+
+    header = (BinaryHeader*)file.data;
+
+    success = relocateJoints(&file, &m->bindPose)
+        && relocateJoints(&file, &m->currentPose)
+        && m->bindPose.numJoints == m->currentPose.numJoints
+        && relocate(&file, &m->meshes, m->numSubMeshes, sizeof(FxsMD5SubMesh))
+        && relocate(&file, &m->inverseBindPose, m->bindPose.numJoints, sizeof(FxsMatrix4));
+
+    for (i = 0; success && i < m->numSubMeshes; i++)
+    {
+        sm = &m->meshes[i];
+
+        success = relocateString(&file, &sm->shader)
+            && relocate(&file, &sm->faces, sm->numFaces, sizeof(FxsMD5Face))
+            && relocate(&file, &sm->weights, sm->numWeights, sizeof(FxsMD5Weight))
+            && relocate(&file, &sm->vertices, sm->numVertices, sizeof(FxsMD5Vertex))
+            && relocateInfluences(&file, sm);
+    }
+
+    if (!success)
+    {
+        ERR_MSG("Binary MD5 file is corrupt")
+        FxsMD5FileClose(&file);
+        return 0;
+    }
+
+    m->storage = file.data + header->storage;
+    *mesh = m;
+
+    return 1;
+}
+
+int FxsMD5AnimationWriteBinaryFile(
+    const FxsMD5Animation* animation,
+    const char* filename
+)
+{
+    Image image;
+    size_t root;
+    size_t frames;
+    size_t frameData;
+    size_t joints;
+    size_t frameSize = sizeof(float)*animation->numAnimatedComponents;
+    const float* data;
+    unsigned int i = 0;
+
+    imageInit(&image, ANIMATION_MAGIC);
+
+    root = imageArray(&image, animation, sizeof(FxsMD5Animation), BLOCK_ALIGNMENT);
+    STORE_OFFSET(&image, root, FxsMD5Animation, storage, 0);
+
+    /* frames, their data is stored in one block */
+    frames = imageAlloc(
+            &image,
+            sizeof(FxsMD5AnimationFrame)*animation->numFrames,
+            BLOCK_ALIGNMENT
+        );
+
+    frameData = imageAlloc(&image, frameSize*animation->numFrames, FRAME_ALIGNMENT);
+
+    STORE_OFFSET(&image, root, FxsMD5Animation, frames, frames);
+    STORE_OFFSET(&image, root, FxsMD5Animation, frameData, frameData);
+    STORE_OFFSET(&image, root, FxsMD5Animation, frameCache, 0);
+    STORE_OFFSET(&image, root, FxsMD5Animation, program, 0);
+    STORE_OFFSET(&image, root, FxsMD5Animation, stats, 0);
+
+    for (i = 0; i < animation->numFrames; i++)
+    {
+        /* frames of lazy animations are decoded one at a time */
+        data = FxsMD5AnimationAcquireFrame(animation, i);
+
+        if (!data)
+        {
+            free(image.data);
+            return 0;
+        }
+
+        if (!image.failed)
+        {
+            memcpy(IMAGE_AT(&image, frameData + i*frameSize, char), data, frameSize);
+        }
+
+        FxsMD5AnimationReleaseFrame(animation, i);
+
+        STORE_OFFSET(
+            &image,
+            frames + i*sizeof(FxsMD5AnimationFrame),
+            FxsMD5AnimationFrame,
+            data,
+            frameData + i*frameSize
+        );
+    }
+
+    /* base frame */
+    STORE_OFFSET(
+        &image, root, FxsMD5Animation, baseFrame.positions,
+        imageArray(
+            &image,
+            animation->baseFrame.positions,
+            sizeof(FxsVector3)*animation->numJoints,
+            BLOCK_ALIGNMENT
+        )
+    );
+
+    STORE_OFFSET(
+        &image, root, FxsMD5Animation, baseFrame.orientations,
+        imageArray(
+            &image,
+            animation->baseFrame.orientations,
+            sizeof(FxsQuaternion)*animation->numJoints,
+            BLOCK_ALIGNMENT
+        )
+    );
+
+    /* joints and their names */
+    joints = imageArray(
+            &image,
+            animation->joints,
+            sizeof(FxsMD5AnimationJoint)*animation->numJoints,
+            BLOCK_ALIGNMENT
+        );
+
+    STORE_OFFSET(&image, root, FxsMD5Animation, joints, joints);
+
+    for (i = 0; i < animation->numJoints; i++)
+    {
+        STORE_OFFSET(
+            &image,
+            joints + i*sizeof(FxsMD5AnimationJoint),
+            FxsMD5AnimationJoint,
+            name,
+            imageString(&image, animation->joints[i].name)
+        );
+    }
+
+    /* bounds */
+    STORE_OFFSET(
+        &image, root, FxsMD5Animation, bounds,
+        imageArray(
+            &image,
+            animation->bounds,
+            sizeof(FxsMD5AnimationBound)*animation->numFrames,
+            BLOCK_ALIGNMENT
+        )
+    );
+
+    return imageWrite(&image, root, filename);
+}
+
+int FxsMD5AnimationCreateWithBinaryFile(
+    FxsMD5Animation** animation,
+    const char* filename
+)
+{
+    FxsMD5File file;
+    FxsMD5Animation* a;
+    BinaryHeader* header;
+    unsigned int i = 0;
+    int success = 1;
+
+    *animation = NULL;
+    a = (FxsMD5Animation*)openBinary(
+            &file,
+            filename,
+            ANIMATION_MAGIC,
+            sizeof(FxsMD5Animation)
+        );
+
+    if (!a)
+    {
+        return 0;
+    }
+
+    header = (BinaryHeader*)file.data;
+
+    success = relocate(&file, &a->frames, a->numFrames, sizeof(FxsMD5AnimationFrame))
+        && relocateAligned(
+            &file,
+            &a->frameData,
+            (long long)a->numFrames*a->numAnimatedComponents,
+            sizeof(float),
+            FRAME_ALIGNMENT
+        )
+        && relocate(&file, &a->baseFrame.positions, a->numJoints, sizeof(FxsVector3))
+        && relocate(&file, &a->baseFrame.orientations, a->numJoints, sizeof(FxsQuaternion))
+        && relocate(&file, &a->joints, a->numJoints, sizeof(FxsMD5AnimationJoint))
+        && relocate(&file, &a->bounds, a->numFrames, sizeof(FxsMD5AnimationBound));
+
+    for (i = 0; success && i < a->numFrames; i++)
+    {
+        success = relocateAligned(
+                &file,
+                &a->frames[i].data,
+                a->numAnimatedComponents,
+                sizeof(float),
+                sizeof(float)
+            );
+    }
+
+    for (i = 0; success && i < a->numJoints; i++)
+    {
+        success = relocateString(&file, &a->joints[i].name);
+    }
+
+    if (!success)
+    {
+        ERR_MSG("Binary MD5 file is corrupt")
+        FxsMD5FileClose(&file);
+        return 0;
+    }
+
+    a->frameCache = NULL;
+    a->program = NULL;
+    a->storage = file.data + header->storage;
+
+    /* also checks the frame components of the joints */
+    if (!FxsMD5AnimationCompile(a))
+    {
+        FxsMD5FileClose(&file);
+        return 0;
+    }
+
+    *animation = a;
+
+    return 1;
+}
@@ -0,0 +1,490 @@
+/*
+** Blending and layering of local poses. The loops run over chunks of
+** joints with one array per component, so they vectorize.
+*/
+
+#include "MD5Blend.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** # of joints that are blended together.
+*/
+#define BLEND_CHUNK 16
+
+int FxsMD5BlendTreeCreate(
+    FxsMD5BlendTree** tree,
+    unsigned int numJoints,
+    unsigned int numNodes
+)
+{
+    unsigned int i;
+
+    *tree = NULL;
+
+    if (!numNodes)
+    {
+        ERR_MSG("A blend tree needs at least one node");
+        return 0;
+    }
+
+    *tree = (FxsMD5BlendTree*)malloc(sizeof(FxsMD5BlendTree));
+
+    if (!*tree)
+    {
+        ERR_MSG("malloc failed");
+        return 0;
+    }
+
+    memset(*tree, 0, sizeof(FxsMD5BlendTree));
+
+    (*tree)->numJoints = numJoints;
+    (*tree)->numNodes = numNodes;
+    (*tree)->nodes = (FxsMD5BlendNode*)calloc(numNodes, sizeof(FxsMD5BlendNode));
+    (*tree)->poses = (FxsMD5LocalPose**)calloc(numNodes, sizeof(FxsMD5LocalPose*));
+    (*tree)->results = (const FxsMD5LocalPose**)calloc(
+            numNodes,
+            sizeof(FxsMD5LocalPose*)
+        );
+
+    if (!(*tree)->nodes || !(*tree)->poses || !(*tree)->results)
+    {
+        ERR_MSG("malloc failed");
+        FxsMD5BlendTreeDestroy(tree);
+        return 0;
+    }
+
+    for (i = 0; i < numNodes; i++)
+    {
+        if (!FxsMD5LocalPoseCreate(&(*tree)->poses[i], numJoints))
+        {
+            FxsMD5BlendTreeDestroy(tree);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+void FxsMD5BlendTreeDestroy(FxsMD5BlendTree** tree)
+{
+    unsigned int i;
+
+    if (!*tree)
+    {
+        return;
+    }
+
+    for (i = 0; (*tree)->poses && i < (*tree)->numNodes; i++)
+    {
+        FxsMD5LocalPoseDestroy(&(*tree)->poses[i]);
+    }
+
+    free((*tree)->results);
+    free((*tree)->poses);
+    free((*tree)->nodes);
+    free(*tree);
+
+    *tree = NULL;
+}
+
+/*
+** Evaluates a node. Returns its result, NULL if the node is invalid.
+*/
+static const FxsMD5LocalPose* evaluateNode(
+    FxsMD5BlendTree* tree,
+    unsigned int index
+)
+{
+    const FxsMD5BlendNode* node = &tree->nodes[index];
+    const FxsMD5LocalPose* inputs[FXS_MD5_BLEND_MAX_INPUTS];
+    FxsMD5LocalPose* result = tree->poses[index];
+    unsigned int i;
+
+    if (node->type == FXS_MD5_BLEND_NODE_POSE)
+    {
+        if (!node->pose || node->pose->numJoints != tree->numJoints)
+        {
+            return NULL;
+        }
+
+        return node->pose;
+    }
+
+    if (node->numInputs > FXS_MD5_BLEND_MAX_INPUTS)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < node->numInputs; i++)
+    {
+        if (node->inputs[i] >= index)
+        {
+            return NULL;
+        }
+
+        inputs[i] = tree->results[node->inputs[i]];
+    }
+
+    switch (node->type)
+    {
+        case FXS_MD5_BLEND_NODE_BLEND:
+
+            if (!node->numInputs
+            || !FxsMD5LocalPoseBlendWeighted(
+                result,
+                inputs,
+                node->weights,
+                node->numInputs,
+                node->mask)
+            )
+            {
+                return NULL;
+            }
+
+            break;
+
+        case FXS_MD5_BLEND_NODE_DIFFERENCE:
+
+            if (node->numInputs != 2
+            || !FxsMD5LocalPoseDifference(result, inputs[0], inputs[1]))
+            {
+                return NULL;
+            }
+
+            break;
+
+        case FXS_MD5_BLEND_NODE_ADD:
+
+            if (node->numInputs != 2
+            || !FxsMD5LocalPoseAdd(
+                result,
+                inputs[0],
+                inputs[1],
+                node->weights[1],
+                node->mask)
+            )
+            {
+                return NULL;
+            }
+
+            break;
+
+        default:
+            return NULL;
+    }
+
+    return result;
+}
+
+const FxsMD5LocalPose* FxsMD5BlendTreeEvaluate(FxsMD5BlendTree* tree)
+{
+    const FxsMD5LocalPose* result = NULL;
+    unsigned int i;
+
+    for (i = 0; i < tree->numNodes; i++)
+    {
+        result = evaluateNode(tree, i);
+
+        if (!result)
+        {
+            ERR_MSG("Invalid blend tree node");
+            return NULL;
+        }
+
+        tree->results[i] = result;
+    }
+
+    return result;
+}
+
+int FxsMD5LocalPoseBlendWeighted(
+    FxsMD5LocalPose* result,
+    const FxsMD5LocalPose* const* poses,
+    const float* weights,
+    unsigned int count,
+    const float* mask
+)
+{
+    float p[3][BLEND_CHUNK];
+    float q[4][BLEND_CHUNK];
+    float total[BLEND_CHUNK];
+    float w[BLEND_CHUNK];
+    const FxsMD5LocalPose* pose;
+    const FxsMD5LocalPose* first;
+    unsigned int numJoints = result->numJoints;
+    unsigned int i, j, k, n;
+    int c;
+
+    /* poses[0] is the reference of the blend */
+    if (!count)
+    {
+        return 0;
+    }
+
+    first = poses[0];
+
+    for (k = 0; k < count; k++)
+    {
+        if (poses[k]->numJoints != numJoints)
+        {
+            return 0;
+        }
+    }
+
+    for (i = 0; i < numJoints; i += BLEND_CHUNK)
+    {
+        n = numJoints - i < BLEND_CHUNK ? numJoints - i : BLEND_CHUNK;
+
+        for (j = 0; j < n; j++)
+        {
+            total[j] = weights[0];
+        }
+
+        for (c = 0; c < 3; c++)
+        {
+            for (j = 0; j < n; j++)
+            {
+                p[c][j] = weights[0]*first->positions[c][i + j];
+            }
+        }
+
+        for (c = 0; c < 4; c++)
+        {
+            for (j = 0; j < n; j++)
+            {
+                q[c][j] = weights[0]*first->orientations[c][i + j];
+            }
+        }
+
+        for (k = 1; k < count; k++)
+        {
+            pose = poses[k];
+
+            for (j = 0; j < n; j++)
+            {
+                w[j] = mask ? weights[k]*mask[i + j] : weights[k];
+                total[j] += w[j];
+            }
+
+            for (c = 0; c < 3; c++)
+            {
+                for (j = 0; j < n; j++)
+                {
+                    p[c][j] += w[j]*pose->positions[c][i + j];
+                }
+            }
+
+            /* along the shorter arc to the first pose */
+            for (j = 0; j < n; j++)
+            {
+                float dot = first->orientations[0][i + j]*pose->orientations[0][i + j]
+                    + first->orientations[1][i + j]*pose->orientations[1][i + j]
+                    + first->orientations[2][i + j]*pose->orientations[2][i + j]
+                    + first->orientations[3][i + j]*pose->orientations[3][i + j];
+
+                w[j] = dot < 0.0f ? -w[j] : w[j];
+            }
+
+            for (c = 0; c < 4; c++)
+            {
+                for (j = 0; j < n; j++)
+                {
+                    q[c][j] += w[j]*pose->orientations[c][i + j];
+                }
+            }
+        }
+
+        for (j = 0; j < n; j++)
+        {
+            float norm = q[0][j]*q[0][j] + q[1][j]*q[1][j]
+                + q[2][j]*q[2][j] + q[3][j]*q[3][j];
+
+            /* joints without weight keep the first pose */
+            if (total[j] <= 0.0f || norm <= 0.0f)
+            {
+                for (c = 0; c < 3; c++)
+                {
+                    p[c][j] = first->positions[c][i + j];
+                }
+
+                for (c = 0; c < 4; c++)
+                {
+                    q[c][j] = first->orientations[c][i + j];
+                }
+
+                continue;
+            }
+
+            norm = 1.0f/sqrtf(norm);
+
+            for (c = 0; c < 3; c++)
+            {
+                p[c][j] /= total[j];
+            }
+
+            for (c = 0; c < 4; c++)
+            {
+                q[c][j] *= norm;
+            }
+        }
+
+        /* the inputs of the chunk are read, result may be an input */
+        for (c = 0; c < 3; c++)
+        {
+            memcpy(&result->positions[c][i], p[c], sizeof(float)*n);
+        }
+
+        for (c = 0; c < 4; c++)
+        {
+            memcpy(&result->orientations[c][i], q[c], sizeof(float)*n);
+        }
+    }
+
+    return 1;
+}
+
+int FxsMD5LocalPoseDifference(
+    FxsMD5LocalPose* additive,
+    const FxsMD5LocalPose* pose,
+    const FxsMD5LocalPose* reference
+)
+{
+    unsigned int i;
+    int c;
+
+    if (additive->numJoints != pose->numJoints
+    || pose->numJoints != reference->numJoints)
+    {
+        return 0;
+    }
+
+    for (c = 0; c < 3; c++)
+    {
+        for (i = 0; i < pose->numJoints; i++)
+        {
+            additive->positions[c][i] = pose->positions[c][i]
+                - reference->positions[c][i];
+        }
+    }
+
+    /* inverse(reference)*pose, the inverse of a unit quaternion is its
+    ** conjugate
+    */
+    for (i = 0; i < pose->numJoints; i++)
+    {
+        float ax = -reference->orientations[0][i];
+        float ay = -reference->orientations[1][i];
+        float az = -reference->orientations[2][i];
+        float aw = reference->orientations[3][i];
+        float bx = pose->orientations[0][i];
+        float by = pose->orientations[1][i];
+        float bz = pose->orientations[2][i];
+        float bw = pose->orientations[3][i];
+
+        additive->orientations[0][i] = aw*bx + ax*bw + ay*bz - az*by;
+        additive->orientations[1][i] = aw*by - ax*bz + ay*bw + az*bx;
+        additive->orientations[2][i] = aw*bz + ax*by - ay*bx + az*bw;
+        additive->orientations[3][i] = aw*bw - ax*bx - ay*by - az*bz;
+    }
+
+    return 1;
+}
+
+int FxsMD5LocalPoseAdd(
+    FxsMD5LocalPose* result,
+    const FxsMD5LocalPose* base,
+    const FxsMD5LocalPose* additive,
+    float weight,
+    const float* mask
+)
+{
+    unsigned int i;
+    int c;
+
+    if (result->numJoints != base->numJoints
+    || base->numJoints != additive->numJoints)
+    {
+        return 0;
+    }
+
+    for (c = 0; c < 3; c++)
+    {
+        for (i = 0; i < base->numJoints; i++)
+        {
+            float w = mask ? weight*mask[i] : weight;
+
+            result->positions[c][i] = base->positions[c][i]
+                + w*additive->positions[c][i];
+        }
+    }
+
+    /* base*nlerp(identity, additive, w) */
+    for (i = 0; i < base->numJoints; i++)
+    {
+        float w = mask ? weight*mask[i] : weight;
+        float s = additive->orientations[3][i] < 0.0f ? -w : w;
+        float bx = s*additive->orientations[0][i];
+        float by = s*additive->orientations[1][i];
+        float bz = s*additive->orientations[2][i];
+        float bw = s*additive->orientations[3][i] + (1.0f - w);
+        float ax = base->orientations[0][i];
+        float ay = base->orientations[1][i];
+        float az = base->orientations[2][i];
+        float aw = base->orientations[3][i];
+        float x = aw*bx + ax*bw + ay*bz - az*by;
+        float y = aw*by - ax*bz + ay*bw + az*bx;
+        float z = aw*bz + ax*by - ay*bx + az*bw;
+        float qw = aw*bw - ax*bx - ay*by - az*bz;
+        float norm = 1.0f/sqrtf(x*x + y*y + z*z + qw*qw);
+
+        result->orientations[0][i] = x*norm;
+        result->orientations[1][i] = y*norm;
+        result->orientations[2][i] = z*norm;
+        result->orientations[3][i] = qw*norm;
+    }
+
+    return 1;
+}
+
+void FxsMD5BlendMaskSetBranch(
+    float* mask,
+    const FxsMD5Skeleton* skeleton,
+    int joint,
+    float weight
+)
+{
+    int i, parent;
+
+    if (joint < 0 || joint >= skeleton->numJoints)
+    {
+        return;
+    }
+
+    mask[joint] = weight;
+
+    /* children come after their parents */
+    for (i = joint + 1; i < skeleton->numJoints; i++)
+    {
+        parent = skeleton->joints[i].parent;
+
+        if (parent >= i)
+        {
+            continue;
+        }
+
+        while (parent > joint && skeleton->joints[parent].parent < parent)
+        {
+            parent = skeleton->joints[parent].parent;
+        }
+
+        if (parent == joint)
+        {
+            mask[i] = weight;
+        }
+    }
+}
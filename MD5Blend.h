@@ -0,0 +1,142 @@
+#ifndef MD5BLEND_H
+#define MD5BLEND_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "MD5Mesh.h"
+
+/*
+** Largest # of inputs of a node of a blend tree.
+*/
+#define FXS_MD5_BLEND_MAX_INPUTS 8
+
+/*
+** Types of the nodes of a blend tree.
+*/
+#define FXS_MD5_BLEND_NODE_POSE         0   /* the local pose of the node,
+                                            ** e.g. the pose of a sampler
+                                            */
+#define FXS_MD5_BLEND_NODE_BLEND        1   /* weighted blend of the inputs */
+#define FXS_MD5_BLEND_NODE_DIFFERENCE   2   /* inputs[0] relative to
+                                            ** inputs[1], an additive pose
+                                            */
+#define FXS_MD5_BLEND_NODE_ADD          3   /* inputs[0] with the additive
+                                            ** pose inputs[1] added with
+                                            ** weights[1]
+                                            */
+
+/*
+** A node of a blend tree. Inputs are nodes that come before the node. A
+** mask holds a weight for each joint that scales the weights of all inputs
+** but the first, so a mask selects the joints an overlay applies to.
+*/
+typedef struct
+{
+    int type;                                   /* FXS_MD5_BLEND_NODE_* */
+    const FxsMD5LocalPose* pose;                /* pose of a POSE node */
+    unsigned int numInputs;
+    unsigned int inputs[FXS_MD5_BLEND_MAX_INPUTS];
+    float weights[FXS_MD5_BLEND_MAX_INPUTS];
+    const float* mask;                          /* NULL for all joints */
+}
+FxsMD5BlendNode;
+
+/*
+** Nodes that are evaluated in order, the last node is the result. Each
+** node has a local pose for its result, all poses are in SoA form.
+*/
+typedef struct
+{
+    unsigned int numJoints;
+    unsigned int numNodes;
+    FxsMD5BlendNode* nodes;
+    FxsMD5LocalPose** poses;    /* pose of each node for its result */
+    const FxsMD5LocalPose** results;    /* result of each node, poses[i] or
+                                        ** the pose of a POSE node
+                                        */
+}
+FxsMD5BlendTree;
+
+/*
+** Creates a tree of numNodes nodes for poses of numJoints joints. The nodes
+** are zeroed, fill them in before evaluating the tree. Returns 0 if it
+** fails or numNodes is 0.
+*/
+int FxsMD5BlendTreeCreate(
+    FxsMD5BlendTree** tree,
+    unsigned int numJoints,
+    unsigned int numNodes
+);
+
+/*
+** Releases the tree.
+*/
+void FxsMD5BlendTreeDestroy(FxsMD5BlendTree** tree);
+
+/*
+** Evaluates the nodes. Returns the result of the last node, NULL if a node
+** is invalid, e.g. if it has an input that does not come before it or a
+** pose with the wrong # of joints. Use FxsMD5MeshUpdatePoseWithLocalPose
+** to build the joint transforms from the result.
+*/
+const FxsMD5LocalPose* FxsMD5BlendTreeEvaluate(FxsMD5BlendTree* tree);
+
+/*
+** Blends count poses with weights, the weights are normalized for each
+** joint. mask scales the weights of poses[1..count - 1], it may be NULL.
+** Orientations are blended along the shorter arcs to the orientations of
+** poses[0] and normalized. result may be one of the poses. Returns 0 if
+** count is 0 or the # of joints do not match.
+*/
+int FxsMD5LocalPoseBlendWeighted(
+    FxsMD5LocalPose* result,
+    const FxsMD5LocalPose* const* poses,
+    const float* weights,
+    unsigned int count,
+    const float* mask
+);
+
+/*
+** Makes the additive pose that takes reference to pose, per joint the
+** rotation inverse(reference)*pose and the translation pose - reference.
+** Returns 0 if the # of joints do not match.
+*/
+int FxsMD5LocalPoseDifference(
+    FxsMD5LocalPose* additive,
+    const FxsMD5LocalPose* pose,
+    const FxsMD5LocalPose* reference
+);
+
+/*
+** Adds weight of an additive pose to a base pose, weight is scaled by mask
+** if it is not NULL. result may be base. Returns 0 if the # of joints do
+** not match.
+*/
+int FxsMD5LocalPoseAdd(
+    FxsMD5LocalPose* result,
+    const FxsMD5LocalPose* base,
+    const FxsMD5LocalPose* additive,
+    float weight,
+    const float* mask
+);
+
+/*
+** Sets the mask weight of a joint and all joints below it in the skeleton
+** to weight, the other weights are not changed. Parents have to come
+** before their children, as in MD5 files.
+*/
+void FxsMD5BlendMaskSetBranch(
+    float* mask,
+    const FxsMD5Skeleton* skeleton,
+    int joint,
+    float weight
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5BLEND_H */
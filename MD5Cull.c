@@ -0,0 +1,269 @@
+/*
+** Frustum culling of instances with the bounds of their animation frames.
+** Boxes are transformed to world space a chunk of instances at a time into
+** one array per component, then the planes are tested against 4 boxes per
+** instruction.
+*/
+
+#include "MD5Cull.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** SSE is part of x86-64, the kernel is used whenever the compiler targets
+** SSE.
+*/
+#if !defined(FXS_MD5_NO_SIMD) \
+    && (defined(__SSE__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define FXS_MD5_SIMD_CULL
+#include <xmmintrin.h>
+#endif
+
+/*
+** Element (row, column) of a column major 4x4 matrix.
+*/
+#define AT(m, row, column) ((m)[(column)*4 + (row)])
+
+/*
+** # of instances that are transformed and tested together, a multiple of
+** 4.
+*/
+#define CULL_CHUNK 64
+
+/*
+** World space boxes of a chunk of instances as centers and half extents.
+*/
+typedef struct
+{
+    float cx[CULL_CHUNK];
+    float cy[CULL_CHUNK];
+    float cz[CULL_CHUNK];
+    float ex[CULL_CHUNK];
+    float ey[CULL_CHUNK];
+    float ez[CULL_CHUNK];
+    unsigned char always[CULL_CHUNK];   /* visible without a test */
+}
+CullChunk;
+
+void FxsMD5FrustumSetWithMatrix(
+    FxsMD5Frustum* frustum,
+    const FxsMatrix4* viewProjection
+)
+{
+    const float* m = (const float*)viewProjection;
+    float length;
+    int i, c;
+
+    /* row 3 plus or minus rows 0, 1, 2: -w <= x, y, z <= w */
+    for (i = 0; i < 6; i++)
+    {
+        float sign = (i & 1) ? -1.0f : 1.0f;
+
+        for (c = 0; c < 4; c++)
+        {
+            frustum->planes[i][c] = AT(m, 3, c) + sign*AT(m, i/2, c);
+        }
+
+        length = sqrtf(
+                frustum->planes[i][0]*frustum->planes[i][0]
+                + frustum->planes[i][1]*frustum->planes[i][1]
+                + frustum->planes[i][2]*frustum->planes[i][2]
+            );
+
+        if (length > 0.0f)
+        {
+            for (c = 0; c < 4; c++)
+            {
+                frustum->planes[i][c] /= length;
+            }
+        }
+    }
+}
+
+/*
+** Transforms the box of an instance to world space and stores it in lane j
+** of a chunk.
+*/
+static void loadBox(
+    CullChunk* chunk,
+    unsigned int j,
+    const FxsMatrix4* transform,
+    const FxsMD5Animation* animation,
+    unsigned int frame
+)
+{
+    const FxsMD5AnimationBound* bound;
+    const float* m;
+    float c[3], e[3];
+
+    if (!animation || !animation->bounds || frame >= animation->numFrames)
+    {
+        chunk->cx[j] = chunk->cy[j] = chunk->cz[j] = 0.0f;
+        chunk->ex[j] = chunk->ey[j] = chunk->ez[j] = 0.0f;
+        chunk->always[j] = 1;
+        return;
+    }
+
+    bound = &animation->bounds[frame];
+
+    /* the conversation matrix maps (x, y, z) to (-x, z, y) */
+    c[0] = -0.5f*(bound->min.x + bound->max.x);
+    c[1] = 0.5f*(bound->min.z + bound->max.z);
+    c[2] = 0.5f*(bound->min.y + bound->max.y);
+    e[0] = 0.5f*(bound->max.x - bound->min.x);
+    e[1] = 0.5f*(bound->max.z - bound->min.z);
+    e[2] = 0.5f*(bound->max.y - bound->min.y);
+
+    chunk->always[j] = 0;
+
+    if (!transform)
+    {
+        chunk->cx[j] = c[0];
+        chunk->cy[j] = c[1];
+        chunk->cz[j] = c[2];
+        chunk->ex[j] = e[0];
+        chunk->ey[j] = e[1];
+        chunk->ez[j] = e[2];
+        return;
+    }
+
+    m = (const float*)transform;
+
+    /* the half extents of the box around the transformed box */
+    chunk->cx[j] = AT(m, 0, 0)*c[0] + AT(m, 0, 1)*c[1] + AT(m, 0, 2)*c[2] + AT(m, 0, 3);
+    chunk->cy[j] = AT(m, 1, 0)*c[0] + AT(m, 1, 1)*c[1] + AT(m, 1, 2)*c[2] + AT(m, 1, 3);
+    chunk->cz[j] = AT(m, 2, 0)*c[0] + AT(m, 2, 1)*c[1] + AT(m, 2, 2)*c[2] + AT(m, 2, 3);
+    chunk->ex[j] = fabsf(AT(m, 0, 0))*e[0] + fabsf(AT(m, 0, 1))*e[1] + fabsf(AT(m, 0, 2))*e[2];
+    chunk->ey[j] = fabsf(AT(m, 1, 0))*e[0] + fabsf(AT(m, 1, 1))*e[1] + fabsf(AT(m, 1, 2))*e[2];
+    chunk->ez[j] = fabsf(AT(m, 2, 0))*e[0] + fabsf(AT(m, 2, 1))*e[1] + fabsf(AT(m, 2, 2))*e[2];
+}
+
+/*
+** Tests the first n boxes of a chunk, appends the visible ones to visible
+** with their index offset by first. Returns the # of visible boxes. A box
+** is outside if it is behind one of the planes.
+*/
+static unsigned int testChunk(
+    const FxsMD5Frustum* frustum,
+    const CullChunk* chunk,
+    unsigned int n,
+    unsigned int first,
+    unsigned int* visible
+)
+{
+    unsigned int count = 0;
+    unsigned int j;
+    int bits, i;
+
+#ifdef FXS_MD5_SIMD_CULL
+    unsigned int l;
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.0f);
+
+    for (j = 0; j < n; j += 4)
+    {
+        __m128 cx = _mm_loadu_ps(chunk->cx + j);
+        __m128 cy = _mm_loadu_ps(chunk->cy + j);
+        __m128 cz = _mm_loadu_ps(chunk->cz + j);
+        __m128 ex = _mm_loadu_ps(chunk->ex + j);
+        __m128 ey = _mm_loadu_ps(chunk->ey + j);
+        __m128 ez = _mm_loadu_ps(chunk->ez + j);
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+
+        for (i = 0; i < 6; i++)
+        {
+            const float* p = frustum->planes[i];
+            __m128 a = _mm_set1_ps(p[0]);
+            __m128 b = _mm_set1_ps(p[1]);
+            __m128 c = _mm_set1_ps(p[2]);
+            __m128 d = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)),
+                    _mm_add_ps(_mm_mul_ps(c, cz), _mm_set1_ps(p[3]))
+                );
+            __m128 r = _mm_add_ps(
+                    _mm_add_ps(
+                        _mm_mul_ps(_mm_andnot_ps(sign, a), ex),
+                        _mm_mul_ps(_mm_andnot_ps(sign, b), ey)
+                    ),
+                    _mm_mul_ps(_mm_andnot_ps(sign, c), ez)
+                );
+
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), zero));
+        }
+
+        bits = _mm_movemask_ps(inside);
+
+        for (l = 0; l < 4 && j + l < n; l++)
+        {
+            if (((bits >> l) & 1) || chunk->always[j + l])
+            {
+                visible[count++] = first + j + l;
+            }
+        }
+    }
+#else
+    for (j = 0; j < n; j++)
+    {
+        bits = 1;
+
+        for (i = 0; i < 6 && bits; i++)
+        {
+            const float* p = frustum->planes[i];
+            float d = p[0]*chunk->cx[j] + p[1]*chunk->cy[j]
+                + p[2]*chunk->cz[j] + p[3];
+            float r = fabsf(p[0])*chunk->ex[j] + fabsf(p[1])*chunk->ey[j]
+                + fabsf(p[2])*chunk->ez[j];
+
+            bits = d + r >= 0.0f;
+        }
+
+        if (bits || chunk->always[j])
+        {
+            visible[count++] = first + j;
+        }
+    }
+#endif
+
+    return count;
+}
+
+unsigned int FxsMD5CullInstances(
+    const FxsMD5Frustum* frustum,
+    const FxsMatrix4* transforms,
+    const FxsMD5Animation* const* animations,
+    const unsigned int* frames,
+    unsigned int count,
+    unsigned int* visible
+)
+{
+    CullChunk chunk;
+    unsigned int numVisible = 0;
+    unsigned int i, j, n;
+
+    /* lanes past the last instance of a chunk are tested, but not used */
+    memset(&chunk, 0, sizeof(CullChunk));
+
+    for (i = 0; i < count; i += CULL_CHUNK)
+    {
+        n = count - i < CULL_CHUNK ? count - i : CULL_CHUNK;
+
+        for (j = 0; j < n; j++)
+        {
+            loadBox(
+                &chunk,
+                j,
+                transforms ? &transforms[i + j] : NULL,
+                animations[i + j],
+                frames[i + j]
+            );
+        }
+
+        numVisible += testChunk(frustum, &chunk, n, i, visible + numVisible);
+    }
+
+    return numVisible;
+}
@@ -0,0 +1,57 @@
+#ifndef MD5CULL_H
+#define MD5CULL_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <Fxs/Math/Matrix4.h>
+#include "MD5Animation.h"
+
+/*
+** Planes of a view frustum, a point (x, y, z) is inside a plane if
+** a*x + b*y + c*z + d >= 0. The planes are in the order left, right,
+** bottom, top, near, far.
+*/
+typedef struct
+{
+    float planes[6][4];
+}
+FxsMD5Frustum;
+
+/*
+** Sets the planes of the frustum of a view projection matrix, OpenGL
+** conventions. With a projection matrix only, the planes are in camera
+** space.
+*/
+void FxsMD5FrustumSetWithMatrix(
+    FxsMD5Frustum* frustum,
+    const FxsMatrix4* viewProjection
+);
+
+/*
+** Culls count instances against a frustum. Instance i has the model matrix
+** transforms[i] and plays frames[i] of animations[i], the box of the frame
+** from the bounds of the animation is tested. The indices of the visible
+** instances are written to visible in order, returns their #.
+**
+** transforms may be NULL for instances without a model matrix. Instances
+** without an animation or with a frame out of range are visible. The boxes
+** are in the space of the joint transforms of a mesh, that is after the
+** conversation matrix of MD5Mesh.c.
+*/
+unsigned int FxsMD5CullInstances(
+    const FxsMD5Frustum* frustum,
+    const FxsMatrix4* transforms,
+    const FxsMD5Animation* const* animations,
+    const unsigned int* frames,
+    unsigned int count,
+    unsigned int* visible
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5CULL_H */
@@ -0,0 +1,467 @@
+/*
+** Frame decoding. An animation is "compiled" once after loading: its joints
+** are grouped by their flags and each group is decoded by a routine made
+** for exactly those flags, so decoding a frame does not test any flags.
+*/
+
+#include "MD5Animation.h"
+#include "MD5Memory.h"
+#include "MD5Thread.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** # of flag combinations.
+*/
+#define NUM_FLAGS 64
+
+typedef struct FxsMD5DecodeProgram FxsMD5DecodeProgram;
+
+/*
+** A scratch buffer of the pose updates. The header takes a whole cache
+** line, so the buffer behind it stays cache line aligned.
+*/
+typedef struct Scratch
+{
+    struct Scratch* next;       /* next released buffer */
+    size_t size;                /* bytes behind the header */
+}
+Scratch;
+
+#define SCRATCH_HEADER_SIZE FXS_MD5_ALIGNMENT
+
+/*
+** Joints that have the same flags.
+*/
+typedef struct
+{
+    unsigned int flags;
+    unsigned int numJoints;
+    const unsigned int* joints;         /* index of each joint */
+    const unsigned int* frameIndices;   /* first component of each joint */
+}
+DecodeGroup;
+
+/*
+** The program lives in a single block: the struct, then the joint and
+** component indices of the groups, then the base frame. It also keeps the
+** scratch buffers of the pose updates with the animation.
+*/
+struct FxsMD5DecodeProgram
+{
+    unsigned int numGroups;
+    DecodeGroup groups[NUM_FLAGS];
+    float* base[6];                     /* base frame, x, y, z of the
+                                        ** positions and orientations
+                                        */
+    Scratch* scratch;                   /* released scratch buffers */
+    FxsMD5Mutex mutex;                  /* guards scratch */
+};
+
+typedef void (*DecodeRoutine)(
+    const DecodeGroup* group,
+    const float* frameData,
+    float* const* components
+);
+
+/*
+** Decodes a group of joints with the flags 0HILO (octal). flags is a
+** constant, so the compiler drops the tests and k is known for each
+** component.
+*/
+#define DECODE_ROUTINE(HI, LO)                                              \
+static void decode##HI##LO(                                                 \
+    const DecodeGroup* group,                                               \
+    const float* frameData,                                                 \
+    float* const* components                                                \
+)                                                                           \
+{                                                                           \
+    const unsigned int flags = 0##HI##LO;                                   \
+    unsigned int i;                                                         \
+                                                                            \
+    for (i = 0; i < group->numJoints; i++)                                  \
+    {                                                                       \
+        const float* in = frameData + group->frameIndices[i];               \
+        unsigned int joint = group->joints[i];                              \
+        int k = 0;                                                          \
+                                                                            \
+        if (flags & FXS_MD5_ANIM_XPOS) components[0][joint] = in[k++];     \
+        if (flags & FXS_MD5_ANIM_YPOS) components[1][joint] = in[k++];     \
+        if (flags & FXS_MD5_ANIM_ZPOS) components[2][joint] = in[k++];     \
+        if (flags & FXS_MD5_ANIM_XQUAT) components[3][joint] = in[k++];    \
+        if (flags & FXS_MD5_ANIM_YQUAT) components[4][joint] = in[k++];    \
+        if (flags & FXS_MD5_ANIM_ZQUAT) components[5][joint] = in[k++];    \
+    }                                                                       \
+}
+
+#define DECODE_ROUTINES(HI)                                                 \
+    DECODE_ROUTINE(HI, 0) DECODE_ROUTINE(HI, 1)                             \
+    DECODE_ROUTINE(HI, 2) DECODE_ROUTINE(HI, 3)                             \
+    DECODE_ROUTINE(HI, 4) DECODE_ROUTINE(HI, 5)                             \
+    DECODE_ROUTINE(HI, 6) DECODE_ROUTINE(HI, 7)
+
+DECODE_ROUTINES(0)
+DECODE_ROUTINES(1)
+DECODE_ROUTINES(2)
+DECODE_ROUTINES(3)
+DECODE_ROUTINES(4)
+DECODE_ROUTINES(5)
+DECODE_ROUTINES(6)
+DECODE_ROUTINES(7)
+
+#define DECODE_ENTRIES(HI)                                                  \
+    decode##HI##0, decode##HI##1, decode##HI##2, decode##HI##3,             \
+    decode##HI##4, decode##HI##5, decode##HI##6, decode##HI##7
+
+/*
+** Decode routines by flags.
+*/
+static const DecodeRoutine decoders[NUM_FLAGS] = {
+        DECODE_ENTRIES(0),
+        DECODE_ENTRIES(1),
+        DECODE_ENTRIES(2),
+        DECODE_ENTRIES(3),
+        DECODE_ENTRIES(4),
+        DECODE_ENTRIES(5),
+        DECODE_ENTRIES(6),
+        DECODE_ENTRIES(7)
+    };
+
+/*
+** Returns the # of components a joint with the flags has in a frame.
+*/
+static int numComponents(unsigned int flags)
+{
+    int n = 0;
+
+    for (flags &= NUM_FLAGS - 1; flags; flags >>= 1)
+    {
+        n += flags & 1;
+    }
+
+    return n;
+}
+
+int FxsMD5AnimationCompile(FxsMD5Animation* animation)
+{
+    FxsMD5DecodeProgram* program;
+    unsigned int counts[NUM_FLAGS];
+    unsigned int* joints;
+    unsigned int* frameIndices;
+    unsigned int next[NUM_FLAGS];
+    unsigned int numJoints = animation->numJoints;
+    unsigned int offset = 0;
+    size_t size;
+    unsigned int i, flags;
+
+    memset(counts, 0, sizeof(counts));
+
+    for (i = 0; i < numJoints; i++)
+    {
+        const FxsMD5AnimationJoint* joint = &animation->joints[i];
+
+        if (joint->frameIndex < 0
+        || (unsigned int)(joint->frameIndex + numComponents(joint->flags))
+            > animation->numAnimatedComponents)
+        {
+            ERR_MSG("Joint references invalid frame components");
+            return 0;
+        }
+
+        counts[joint->flags & (NUM_FLAGS - 1)]++;
+    }
+
+    /* struct, 2 indices per joint, 6 base frame floats per joint */
+    size = sizeof(FxsMD5DecodeProgram)
+        + sizeof(unsigned int)*2*numJoints
+        + sizeof(float)*6*numJoints;
+    program = (FxsMD5DecodeProgram*)malloc(size);
+
+    if (!program)
+    {
+        ERR_MSG("malloc failed");
+        return 0;
+    }
+
+    FXS_MD5_STATS_ALLOC(animation->stats, size);
+    memset(program, 0, sizeof(FxsMD5DecodeProgram));
+    FxsMD5MutexInit(&program->mutex);
+
+    joints = (unsigned int*)(program + 1);
+    frameIndices = joints + numJoints;
+
+    for (i = 0; i < 6; i++)
+    {
+        program->base[i] = (float*)(frameIndices + numJoints) + i*numJoints;
+    }
+
+    /* joints w/o animated components keep their base frame values */
+    for (flags = 1; flags < NUM_FLAGS; flags++)
+    {
+        if (!counts[flags])
+        {
+            continue;
+        }
+
+        program->groups[program->numGroups].flags = flags;
+        program->groups[program->numGroups].numJoints = counts[flags];
+        program->groups[program->numGroups].joints = joints + offset;
+        program->groups[program->numGroups].frameIndices = frameIndices + offset;
+        program->numGroups++;
+        next[flags] = offset;
+        offset += counts[flags];
+    }
+
+    for (i = 0; i < numJoints; i++)
+    {
+        const FxsMD5AnimationJoint* joint = &animation->joints[i];
+
+        program->base[0][i] = animation->baseFrame.positions[i].x;
+        program->base[1][i] = animation->baseFrame.positions[i].y;
+        program->base[2][i] = animation->baseFrame.positions[i].z;
+        program->base[3][i] = animation->baseFrame.orientations[i].x;
+        program->base[4][i] = animation->baseFrame.orientations[i].y;
+        program->base[5][i] = animation->baseFrame.orientations[i].z;
+
+        flags = joint->flags & (NUM_FLAGS - 1);
+
+        if (flags)
+        {
+            joints[next[flags]] = i;
+            frameIndices[next[flags]] = joint->frameIndex;
+            next[flags]++;
+        }
+    }
+
+    FxsMD5AnimationFreeProgram(animation);
+    animation->program = program;
+
+    return 1;
+}
+
+void FxsMD5AnimationFreeProgram(FxsMD5Animation* animation)
+{
+    FxsMD5DecodeProgram* program = animation->program;
+    Scratch* scratch;
+
+    if (!program)
+    {
+        return;
+    }
+
+    while (program->scratch)
+    {
+        scratch = program->scratch;
+        program->scratch = scratch->next;
+        FxsMD5AlignedFree(scratch);
+    }
+
+    FxsMD5MutexDestroy(&program->mutex);
+    free(program);
+    animation->program = NULL;
+}
+
+void* FxsMD5AnimationAcquireScratch(
+    const FxsMD5Animation* animation,
+    size_t size
+)
+{
+    FxsMD5DecodeProgram* program = animation->program;
+    Scratch* scratch = NULL;
+    Scratch** link;
+
+    /* the first released buffer that is large enough */
+    if (program)
+    {
+        FxsMD5MutexLock(&program->mutex);
+
+        for (link = &program->scratch; *link; link = &(*link)->next)
+        {
+            if ((*link)->size >= size)
+            {
+                scratch = *link;
+                *link = scratch->next;
+                break;
+            }
+        }
+
+        FxsMD5MutexUnlock(&program->mutex);
+    }
+
+    if (!scratch)
+    {
+        scratch = (Scratch*)FxsMD5AlignedAlloc(
+                SCRATCH_HEADER_SIZE + size,
+                FXS_MD5_ALIGNMENT
+            );
+
+        if (!scratch)
+        {
+            ERR_MSG("malloc failed");
+            return NULL;
+        }
+
+        scratch->size = size;
+    }
+
+    return (char*)scratch + SCRATCH_HEADER_SIZE;
+}
+
+void FxsMD5AnimationReleaseScratch(
+    const FxsMD5Animation* animation,
+    void* buffer
+)
+{
+    FxsMD5DecodeProgram* program = animation->program;
+    Scratch* scratch;
+
+    if (!buffer)
+    {
+        return;
+    }
+
+    scratch = (Scratch*)((char*)buffer - SCRATCH_HEADER_SIZE);
+
+    /* an animation w/o program does not keep buffers */
+    if (!program)
+    {
+        FxsMD5AlignedFree(scratch);
+        return;
+    }
+
+    FxsMD5MutexLock(&program->mutex);
+    scratch->next = program->scratch;
+    program->scratch = scratch;
+    FxsMD5MutexUnlock(&program->mutex);
+}
+
+/*
+** Decodes a frame of an animation that was not compiled.
+*/
+static void decodeJoints(
+    const FxsMD5Animation* animation,
+    const float* frameData,
+    float* const* components
+)
+{
+    unsigned int i;
+    int c, k;
+
+    for (i = 0; i < animation->numJoints; i++)
+    {
+        const FxsMD5AnimationJoint* joint = &animation->joints[i];
+
+        components[0][i] = animation->baseFrame.positions[i].x;
+        components[1][i] = animation->baseFrame.positions[i].y;
+        components[2][i] = animation->baseFrame.positions[i].z;
+        components[3][i] = animation->baseFrame.orientations[i].x;
+        components[4][i] = animation->baseFrame.orientations[i].y;
+        components[5][i] = animation->baseFrame.orientations[i].z;
+
+        for (c = 0, k = 0; c < 6; c++)
+        {
+            if (joint->flags & (1 << c))
+            {
+                components[c][i] = frameData[joint->frameIndex + k++];
+            }
+        }
+    }
+}
+
+int FxsMD5AnimationDecodeFrame(
+    const FxsMD5Animation* animation,
+    unsigned int frame,
+    float* const* components
+)
+{
+    const FxsMD5DecodeProgram* program = animation->program;
+    const float* frameData;
+    float* copy = NULL;     /* the frame if the frame cache is full */
+    int isAcquired;
+    unsigned int i;
+
+    frameData = FxsMD5AnimationAcquireFrame(animation, frame);
+    isAcquired = frameData != NULL;
+
+    /* the frame cache is full, copy the frame instead */
+    if (!frameData && frame < animation->numFrames)
+    {
+        copy = (float*)FxsMD5AnimationAcquireScratch(
+                animation,
+                sizeof(float)*animation->numAnimatedComponents
+            );
+
+        if (copy && FxsMD5AnimationCopyFrame(animation, frame, copy))
+        {
+            frameData = copy;
+        }
+    }
+
+    if (!frameData)
+    {
+        /* the frame does not exist or could not be decoded */
+        FxsMD5AnimationReleaseScratch(animation, copy);
+        return 0;
+    }
+
+    if (!program)
+    {
+        decodeJoints(animation, frameData, components);
+    }
+    else
+    {
+        for (i = 0; i < 6; i++)
+        {
+            memcpy(components[i], program->base[i], sizeof(float)*animation->numJoints);
+        }
+
+        for (i = 0; i < program->numGroups; i++)
+        {
+            decoders[program->groups[i].flags](&program->groups[i], frameData, components);
+        }
+    }
+
+    if (isAcquired)
+    {
+        FxsMD5AnimationReleaseFrame(animation, frame);
+    }
+
+    FxsMD5AnimationReleaseScratch(animation, copy);
+
+    return 1;
+}
+
+/*
+** The loop has no branches, gcc vectorizes it over the joints of a frame
+** and over the lanes of a batch with -fno-math-errno -fno-trapping-math.
+*/
+void FxsMD5AnimationCompleteOrientations(
+    float* const* orientations,
+    unsigned int count
+)
+{
+    float* x = orientations[0];
+    float* y = orientations[1];
+    float* z = orientations[2];
+    float* w = orientations[3];
+    float d, s, t;
+    unsigned int i;
+
+    for (i = 0; i < count; i++)
+    {
+        d = x[i]*x[i] + y[i]*y[i] + z[i]*z[i];
+        t = 1.0f - d;
+        t = t > 0.0f ? t : 0.0f;
+        s = d > 1.0f ? d : 1.0f;
+        s = 1.0f/sqrtf(s);
+
+        x[i] *= s;
+        y[i] *= s;
+        z[i] *= s;
+        w[i] = 0.0f - sqrtf(t);
+    }
+}
@@ -0,0 +1,460 @@
+/*
+** Welding of equal vertices and tight index and vertex arrays of submeshes.
+*/
+
+#include "MD5Geometry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** Marks empty slots of the hash table and weights that are not used.
+*/
+#define NO_INDEX 0xFFFFFFFFu
+
+/*
+** Adds size bytes to a FNV-1a hash.
+*/
+static unsigned int hashBytes(unsigned int hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i])*16777619u;
+    }
+
+    return hash;
+}
+
+/*
+** Hash of the texture coordinates and the weights of a vertex.
+*/
+static unsigned int hashVertex(const FxsMD5SubMesh* sm, const FxsMD5Vertex* vertex)
+{
+    unsigned int hash = 2166136261u;
+    int i;
+
+    hash = hashBytes(hash, &vertex->texCoords, sizeof(FxsVector2));
+
+    for (i = 0; i < vertex->numWeights; i++)
+    {
+        const FxsMD5Weight* weight = &sm->weights[vertex->weightId + i];
+
+        hash = hashBytes(hash, &weight->jointId, sizeof(int));
+        hash = hashBytes(hash, &weight->value, sizeof(float));
+        hash = hashBytes(hash, &weight->position, sizeof(FxsVector3));
+    }
+
+    return hash;
+}
+
+/*
+** Returns 1 if two vertices have the same texture coordinates and weights.
+*/
+static int isEqualVertex(
+    const FxsMD5SubMesh* sm,
+    const FxsMD5Vertex* a,
+    const FxsMD5Vertex* b
+)
+{
+    int i;
+
+    if (a->numWeights != b->numWeights
+    || memcmp(&a->texCoords, &b->texCoords, sizeof(FxsVector2)))
+    {
+        return 0;
+    }
+
+    for (i = 0; i < a->numWeights; i++)
+    {
+        const FxsMD5Weight* wa = &sm->weights[a->weightId + i];
+        const FxsMD5Weight* wb = &sm->weights[b->weightId + i];
+
+        if (wa->jointId != wb->jointId
+        || memcmp(&wa->value, &wb->value, sizeof(float))
+        || memcmp(&wa->position, &wb->position, sizeof(FxsVector3)))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+** Moves element i of the per vertex array data to remap[i] for the first
+** vertex of each group, remap[i] <= i.
+*/
+static void compactArray(
+    void* data,
+    size_t size,
+    const unsigned int* remap,
+    const unsigned char* isFirst,
+    unsigned int count
+)
+{
+    unsigned int i;
+
+    if (!data)
+    {
+        return;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (isFirst[i] && remap[i] != i)
+        {
+            memcpy((char*)data + remap[i]*size, (char*)data + i*size, size);
+        }
+    }
+}
+
+/*
+** Shrinks an array allocated with malloc to size bytes.
+*/
+static void shrinkArray(void** data, size_t size, FxsMD5Stats* stats)
+{
+    void* shrunk;
+
+    if (!*data || !size)
+    {
+        return;
+    }
+
+    shrunk = realloc(*data, size);
+
+    if (shrunk)
+    {
+        *data = shrunk;
+        FXS_MD5_STATS_ALLOC(stats, size);
+    }
+}
+
+/*
+** Welds the vertices of a submesh. Returns the # of removed vertices, -1
+** if it fails.
+*/
+static int weldSubMesh(FxsMD5SubMesh* sm, FxsMD5Stats* stats)
+{
+    unsigned int numVertices = sm->numVertices;
+    unsigned int numWeights = sm->numWeights;
+    unsigned int tableSize = 1;
+    unsigned int* table;        /* open addressing, first vertex of a group */
+    unsigned int* remap;        /* new index of each vertex */
+    unsigned int* weightRemap;  /* new index of each weight */
+    unsigned char* isFirst;     /* vertex is the first of its group */
+    FxsMD5Influences* influences = &sm->influences;
+    unsigned int next = 0;
+    size_t size;
+    unsigned int i, slot;
+    int k;
+
+    for (i = 0; i < numVertices; i++)
+    {
+        const FxsMD5Vertex* vertex = &sm->vertices[i];
+
+        if (vertex->weightId < 0 || vertex->numWeights < 0
+        || vertex->numWeights > sm->numWeights - vertex->weightId)
+        {
+            ERR_MSG("Vertex references invalid weights");
+            return -1;
+        }
+    }
+
+    for (i = 0; i < (unsigned int)sm->numFaces; i++)
+    {
+        if (sm->faces[i].v1 >= numVertices || sm->faces[i].v2 >= numVertices
+        || sm->faces[i].v3 >= numVertices)
+        {
+            ERR_MSG("Face references invalid vertex");
+            return -1;
+        }
+    }
+
+    if (!numVertices)
+    {
+        return 0;
+    }
+
+    while (tableSize < numVertices*2)
+    {
+        tableSize *= 2;
+    }
+
+    size = sizeof(unsigned int)*(tableSize + numVertices + numWeights) + numVertices;
+    table = (unsigned int*)malloc(size);
+
+    if (!table)
+    {
+        ERR_MSG("malloc failed");
+        return -1;
+    }
+
+    FXS_MD5_STATS_ALLOC(stats, size);
+
+    remap = table + tableSize;
+    weightRemap = remap + numVertices;
+    isFirst = (unsigned char*)(weightRemap + numWeights);
+
+    for (i = 0; i < tableSize; i++)
+    {
+        table[i] = NO_INDEX;
+    }
+
+    /* group the vertices, the first vertex of a group represents it */
+    for (i = 0; i < numVertices; i++)
+    {
+        slot = hashVertex(sm, &sm->vertices[i]) & (tableSize - 1);
+
+        while (table[slot] != NO_INDEX
+        && !isEqualVertex(sm, &sm->vertices[table[slot]], &sm->vertices[i]))
+        {
+            slot = (slot + 1) & (tableSize - 1);
+        }
+
+        if (table[slot] == NO_INDEX)
+        {
+            table[slot] = i;
+            remap[i] = next++;
+            isFirst[i] = 1;
+        }
+        else
+        {
+            remap[i] = remap[table[slot]];
+            isFirst[i] = 0;
+        }
+    }
+
+    /* keep the weights of the first vertices, in order */
+    for (i = 0; i < numWeights; i++)
+    {
+        weightRemap[i] = NO_INDEX;
+    }
+
+    for (i = 0; i < numVertices; i++)
+    {
+        for (k = 0; isFirst[i] && k < sm->vertices[i].numWeights; k++)
+        {
+            weightRemap[sm->vertices[i].weightId + k] = 0;
+        }
+    }
+
+    for (i = 0, slot = 0; i < numWeights; i++)
+    {
+        if (weightRemap[i] != NO_INDEX)
+        {
+            weightRemap[i] = slot;
+            sm->weights[slot] = sm->weights[i];
+            sm->weights[slot].id = (int)slot;
+            slot++;
+        }
+    }
+
+    sm->numWeights = (int)slot;
+
+    for (i = 0; i < numVertices; i++)
+    {
+        if (isFirst[i] && sm->vertices[i].numWeights)
+        {
+            sm->vertices[i].weightId = (int)weightRemap[sm->vertices[i].weightId];
+        }
+    }
+
+    /* move the first vertices to the front, remap[i] <= i */
+    compactArray(sm->vertices, sizeof(FxsMD5Vertex), remap, isFirst, numVertices);
+
+    if (influences->numInfluences)
+    {
+        compactArray(
+            influences->joints,
+            influences->indexSize*influences->numInfluences,
+            remap,
+            isFirst,
+            numVertices
+        );
+        compactArray(
+            influences->weights,
+            sizeof(unsigned short)*influences->numInfluences,
+            remap,
+            isFirst,
+            numVertices
+        );
+        compactArray(influences->positions, sizeof(float)*3, remap, isFirst, numVertices);
+    }
+
+    sm->numVertices = (int)next;
+
+    for (i = 0; i < next; i++)
+    {
+        sm->vertices[i].id = (int)i;
+    }
+
+    for (i = 0; i < (unsigned int)sm->numFaces; i++)
+    {
+        sm->faces[i].v1 = remap[sm->faces[i].v1];
+        sm->faces[i].v2 = remap[sm->faces[i].v2];
+        sm->faces[i].v3 = remap[sm->faces[i].v3];
+    }
+
+    free(table);
+
+    /* give the unused memory back, the arrays stay if that fails */
+    shrinkArray((void**)&sm->vertices, sizeof(FxsMD5Vertex)*next, stats);
+    shrinkArray((void**)&sm->weights, sizeof(FxsMD5Weight)*sm->numWeights, stats);
+
+    return (int)(numVertices - next);
+}
+
+int FxsMD5MeshWeldVertices(FxsMD5Mesh* mesh, unsigned int* numWelded)
+{
+    unsigned int i;
+    int removed;
+
+    if (numWelded)
+    {
+        *numWelded = 0;
+    }
+
+    if (mesh->storage)
+    {
+        ERR_MSG("Meshes loaded from binary files can not be changed");
+        return 0;
+    }
+
+    for (i = 0; i < mesh->numSubMeshes; i++)
+    {
+        removed = weldSubMesh(&mesh->meshes[i], mesh->stats);
+
+        if (removed < 0)
+        {
+            return 0;
+        }
+
+        if (numWelded)
+        {
+            *numWelded += removed;
+        }
+    }
+
+    return 1;
+}
+
+int FxsMD5GeometryCreate(
+    FxsMD5Geometry** geometry,
+    const FxsMD5Mesh* mesh,
+    unsigned int subMesh
+)
+{
+    const FxsMD5SubMesh* sm;
+    unsigned int numVertices;
+    unsigned int v[3];
+    int i, k;
+
+    *geometry = NULL;
+
+    if (subMesh >= mesh->numSubMeshes)
+    {
+        return 0;
+    }
+
+    sm = &mesh->meshes[subMesh];
+    numVertices = sm->numVertices;
+
+    *geometry = (FxsMD5Geometry*)malloc(sizeof(FxsMD5Geometry));
+
+    if (!*geometry)
+    {
+        ERR_MSG("malloc failed");
+        return 0;
+    }
+
+    memset(*geometry, 0, sizeof(FxsMD5Geometry));
+
+    (*geometry)->numVertices = numVertices;
+    (*geometry)->numIndices = sm->numFaces*3;
+    (*geometry)->indexSize = numVertices <= 65536 ? 2 : 4;
+
+    if (!numVertices)
+    {
+        if (sm->numFaces)
+        {
+            ERR_MSG("Face references invalid vertex");
+            FxsMD5GeometryDestroy(geometry);
+            return 0;
+        }
+
+        /* an empty submesh keeps NULL arrays */
+        return 1;
+    }
+
+    (*geometry)->indices = malloc((*geometry)->indexSize*(*geometry)->numIndices);
+    (*geometry)->texCoords = (float*)malloc(sizeof(float)*numVertices*2);
+    (*geometry)->positions = (float*)malloc(sizeof(float)*numVertices*3);
+
+    if (!(*geometry)->texCoords || !(*geometry)->positions
+    || ((*geometry)->numIndices && !(*geometry)->indices))
+    {
+        ERR_MSG("malloc failed");
+        FxsMD5GeometryDestroy(geometry);
+        return 0;
+    }
+
+    for (i = 0; i < sm->numFaces; i++)
+    {
+        v[0] = sm->faces[i].v1;
+        v[1] = sm->faces[i].v2;
+        v[2] = sm->faces[i].v3;
+
+        for (k = 0; k < 3; k++)
+        {
+            if (v[k] >= numVertices)
+            {
+                ERR_MSG("Face references invalid vertex");
+                FxsMD5GeometryDestroy(geometry);
+                return 0;
+            }
+
+            if ((*geometry)->indexSize == 2)
+            {
+                ((unsigned short*)(*geometry)->indices)[i*3 + k] = (unsigned short)v[k];
+            }
+            else
+            {
+                ((unsigned int*)(*geometry)->indices)[i*3 + k] = v[k];
+            }
+        }
+    }
+
+    for (i = 0; i < sm->numVertices; i++)
+    {
+        (*geometry)->texCoords[i*2 + 0] = sm->vertices[i].texCoords.x;
+        (*geometry)->texCoords[i*2 + 1] = sm->vertices[i].texCoords.y;
+    }
+
+    if (!FxsMD5MeshBindPositions(mesh, subMesh, (*geometry)->positions, 0))
+    {
+        FxsMD5GeometryDestroy(geometry);
+        return 0;
+    }
+
+    return 1;
+}
+
+void FxsMD5GeometryDestroy(FxsMD5Geometry** geometry)
+{
+    if (!*geometry)
+    {
+        return;
+    }
+
+    free((*geometry)->indices);
+    free((*geometry)->texCoords);
+    free((*geometry)->positions);
+    free(*geometry);
+
+    *geometry = NULL;
+}
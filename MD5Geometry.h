@@ -0,0 +1,49 @@
+#ifndef MD5GEOMETRY_H
+#define MD5GEOMETRY_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "MD5Mesh.h"
+
+/*
+** Tight arrays of a submesh for vertex and index buffers, without the ids
+** of FxsMD5Face and FxsMD5Vertex. Indices are 16 bit if the submesh has at
+** most 65536 vertices, 6 bytes per face instead of 16.
+*/
+typedef struct
+{
+    unsigned int numVertices;
+    unsigned int numIndices;    /* 3 per face */
+    unsigned int indexSize;     /* bytes per index, 2 or 4 */
+    void* indices;              /* unsigned 16 or 32 bit */
+    float* texCoords;           /* u, v of each vertex */
+    float* positions;           /* bind pose position of each vertex, x, y,
+                                ** z, see FxsMD5MeshBindPositions
+                                */
+}
+FxsMD5Geometry;
+
+/*
+** Creates the arrays of a submesh. Weld the vertices of the mesh first
+** (FxsMD5MeshWeldVertices) to get the smallest arrays. Returns 0 if it
+** fails, e.g. if a face references an invalid vertex.
+*/
+int FxsMD5GeometryCreate(
+    FxsMD5Geometry** geometry,
+    const FxsMD5Mesh* mesh,
+    unsigned int subMesh
+);
+
+/*
+** Releases the geometry.
+*/
+void FxsMD5GeometryDestroy(FxsMD5Geometry** geometry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5GEOMETRY_H */
@@ -0,0 +1,277 @@
+/*
+** Compaction of the vertex weights of a mesh into a fixed # of influences
+** per vertex, the layout GPU skinning fetches from.
+*/
+
+#include "MD5Mesh.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** Largest # of influences per vertex.
+*/
+#define MAX_INFLUENCES 8
+
+/*
+** Largest unorm16 value, the sum of the weights of a vertex.
+*/
+#define UNORM16_ONE 65535
+
+typedef struct
+{
+    int joint;
+    float weight;
+}
+Influence;
+
+/*
+** Merges the weights of a vertex by joint and sorts them, strongest first.
+** Returns the # of influences or -1 if a weight is invalid.
+*/
+static int gatherInfluences(
+    Influence* influences,
+    const FxsMD5Mesh* mesh,
+    const FxsMD5SubMesh* sm,
+    const FxsMD5Vertex* vertex
+)
+{
+    const FxsMD5Weight* weight;
+    Influence temp;
+    int n = 0;
+    int i, j;
+
+    for (i = 0; i < vertex->numWeights; i++)
+    {
+        weight = &sm->weights[vertex->weightId + i];
+
+        if (weight->jointId < 0 || weight->jointId >= mesh->bindPose.numJoints)
+        {
+            ERR_MSG("Weight references invalid joint");
+            return -1;
+        }
+
+        for (j = 0; j < n && influences[j].joint != weight->jointId; j++)
+        {
+        }
+
+        if (j == n)
+        {
+            influences[n].joint = weight->jointId;
+            influences[n].weight = 0.0f;
+            n++;
+        }
+
+        influences[j].weight += weight->value;
+    }
+
+    /* insertion sort, vertices have few weights */
+    for (i = 1; i < n; i++)
+    {
+        temp = influences[i];
+
+        for (j = i; j > 0 && influences[j - 1].weight < temp.weight; j--)
+        {
+            influences[j] = influences[j - 1];
+        }
+
+        influences[j] = temp;
+    }
+
+    return n;
+}
+
+/*
+** Compacts the weights of a submesh. Returns 0 if it fails.
+*/
+static int compactSubMesh(
+    const FxsMD5Mesh* mesh,
+    unsigned int subMesh,
+    unsigned int maxInfluences,
+    float weightThreshold,
+    FxsMD5Influences* result
+)
+{
+    const FxsMD5SubMesh* sm = &mesh->meshes[subMesh];
+    Influence* influences = NULL;
+    unsigned short q[MAX_INFLUENCES];
+    float sum;
+    float error;
+    int numVertices = sm->numVertices;
+    int n, kept;
+    int i, j, k;
+
+    memset(result, 0, sizeof(FxsMD5Influences));
+
+    result->numInfluences = maxInfluences;
+    result->indexSize = mesh->bindPose.numJoints <= 256 ? 1 : 2;
+
+    /* an empty submesh keeps NULL arrays */
+    if (!numVertices)
+    {
+        return 1;
+    }
+
+    result->joints = malloc((size_t)result->indexSize*maxInfluences*numVertices);
+    result->weights = (unsigned short*)malloc(
+            sizeof(unsigned short)*maxInfluences*numVertices
+        );
+    result->positions = (float*)malloc(sizeof(float)*3*numVertices);
+
+    if (sm->numWeights)
+    {
+        influences = (Influence*)malloc(sizeof(Influence)*sm->numWeights);
+    }
+
+    if (!result->joints || !result->weights || !result->positions
+    || (sm->numWeights && !influences))
+    {
+        ERR_MSG("malloc failed");
+        free(influences);
+        return 0;
+    }
+
+    FXS_MD5_STATS_ALLOC(mesh->stats, (size_t)result->indexSize*maxInfluences*numVertices);
+    FXS_MD5_STATS_ALLOC(mesh->stats, sizeof(unsigned short)*maxInfluences*numVertices);
+    FXS_MD5_STATS_ALLOC(mesh->stats, sizeof(float)*3*numVertices);
+
+    if (influences)
+    {
+        FXS_MD5_STATS_ALLOC(mesh->stats, sizeof(Influence)*sm->numWeights);
+    }
+
+    /* checks the weight ranges of the vertices */
+    if (!FxsMD5MeshBindPositions(mesh, subMesh, result->positions, 0))
+    {
+        free(influences);
+        return 0;
+    }
+
+    for (i = 0; i < numVertices; i++)
+    {
+        n = gatherInfluences(influences, mesh, sm, &sm->vertices[i]);
+
+        if (n < 0)
+        {
+            free(influences);
+            return 0;
+        }
+
+        /* the strongest influence always stays */
+        for (kept = n ? 1 : 0; kept < n && kept < (int)maxInfluences; kept++)
+        {
+            if (influences[kept].weight < weightThreshold)
+            {
+                break;
+            }
+        }
+
+        for (j = 0, sum = 0.0f; j < kept; j++)
+        {
+            sum += influences[j].weight;
+        }
+
+        /* quantize, the rounding error goes to the strongest influence */
+        for (j = 0, k = 0; j < (int)maxInfluences; j++)
+        {
+            q[j] = 0;
+
+            if (j < kept && sum > 0.0f && influences[j].weight > 0.0f)
+            {
+                q[j] = (unsigned short)floorf(
+                        influences[j].weight/sum*UNORM16_ONE + 0.5f
+                    );
+                k += q[j];
+            }
+        }
+
+        if (kept > 0)
+        {
+            q[0] = (unsigned short)(q[0] + UNORM16_ONE - k);
+        }
+
+        /* error against the original weights, dropped ones included */
+        for (j = 0, error = 0.0f; j < n; j++)
+        {
+            float weight = j < kept ? (float)q[j]/UNORM16_ONE : 0.0f;
+
+            error += fabsf(influences[j].weight - weight);
+        }
+
+        if (error > result->maxError)
+        {
+            result->maxError = error;
+        }
+
+        for (j = 0; j < (int)maxInfluences; j++)
+        {
+            int joint = j < kept ? influences[j].joint : 0;
+
+            if (result->indexSize == 1)
+            {
+                ((unsigned char*)result->joints)[i*maxInfluences + j] = (unsigned char)joint;
+            }
+            else
+            {
+                ((unsigned short*)result->joints)[i*maxInfluences + j] = (unsigned short)joint;
+            }
+
+            result->weights[i*maxInfluences + j] = q[j];
+        }
+    }
+
+    free(influences);
+
+    return 1;
+}
+
+int FxsMD5MeshCompactInfluences(
+    FxsMD5Mesh* mesh,
+    unsigned int maxInfluences,
+    float weightThreshold
+)
+{
+    FxsMD5Influences influences;
+    FxsMD5Influences* old;
+    unsigned int i;
+
+    if (maxInfluences != 4 && maxInfluences != 8)
+    {
+        ERR_MSG("Influences can be compacted to 4 or 8 per vertex");
+        return 0;
+    }
+
+    if (mesh->storage)
+    {
+        ERR_MSG("Meshes loaded from binary files can not be changed");
+        return 0;
+    }
+
+    if (mesh->bindPose.numJoints > 65536)
+    {
+        ERR_MSG("Too many joints for 16 bit joint indices");
+        return 0;
+    }
+
+    for (i = 0; i < mesh->numSubMeshes; i++)
+    {
+        if (!compactSubMesh(mesh, i, maxInfluences, weightThreshold, &influences))
+        {
+            free(influences.joints);
+            free(influences.weights);
+            free(influences.positions);
+            return 0;
+        }
+
+        old = &mesh->meshes[i].influences;
+        free(old->joints);
+        free(old->weights);
+        free(old->positions);
+        *old = influences;
+    }
+
+    return 1;
+}
@@ -0,0 +1,211 @@
+/*
+** Mesh instances. The pose functions of meshes are used through a view: a
+** copy of the mesh struct whose current pose is the pose of the instance,
+** so they only write to the instance.
+*/
+
+#include "MD5Instance.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** Makes a view of the mesh of an instance with the pose of the instance.
+*/
+static void makeView(FxsMD5Mesh* view, const FxsMD5MeshInstance* instance)
+{
+    *view = *instance->mesh;
+    view->currentPose = instance->currentPose;
+
+    /* the stats of the mesh may be in use on other threads */
+    view->stats = instance->stats;
+}
+
+int FxsMD5MeshInstanceCreate(
+    FxsMD5MeshInstance** instance,
+    const FxsMD5Mesh* mesh
+)
+{
+    int numJoints = mesh->bindPose.numJoints;
+
+    *instance = (FxsMD5MeshInstance*)malloc(sizeof(FxsMD5MeshInstance));
+
+    if (!*instance)
+    {
+        ERR_MSG("malloc failed");
+        return 0;
+    }
+
+    memset(*instance, 0, sizeof(FxsMD5MeshInstance));
+
+    (*instance)->mesh = mesh;
+    (*instance)->currentPose.numJoints = numJoints;
+
+    if (numJoints)
+    {
+        (*instance)->currentPose.joints = (FxsMD5Joint*)malloc(
+                sizeof(FxsMD5Joint)*numJoints
+            );
+
+        if (!(*instance)->currentPose.joints)
+        {
+            ERR_MSG("malloc failed");
+            free(*instance);
+            *instance = NULL;
+            return 0;
+        }
+
+        memcpy(
+            (*instance)->currentPose.joints,
+            mesh->bindPose.joints,
+            sizeof(FxsMD5Joint)*numJoints
+        );
+    }
+
+    return 1;
+}
+
+void FxsMD5MeshInstanceDestroy(FxsMD5MeshInstance** instance)
+{
+    if (!*instance)
+    {
+        return;
+    }
+
+    free((*instance)->currentPose.joints);
+    free(*instance);
+
+    *instance = NULL;
+}
+
+int FxsMD5MeshInstanceUpdatePoseWithAnimationFrame(
+    FxsMD5MeshInstance* instance,
+    const FxsMD5Animation* animation,
+    unsigned int frame
+)
+{
+    FxsMD5Mesh view;
+
+    makeView(&view, instance);
+
+    if (!FxsMD5MeshUpdatePoseWithAnimationFrame(&view, animation, frame))
+    {
+        return 0;
+    }
+
+    instance->currentAnimationFrame = frame;
+
+    return 1;
+}
+
+int FxsMD5MeshInstanceUpdatePoseWithLocalPose(
+    FxsMD5MeshInstance* instance,
+    const FxsMD5LocalPose* pose
+)
+{
+    FxsMD5Mesh view;
+
+    makeView(&view, instance);
+
+    return FxsMD5MeshUpdatePoseWithLocalPose(&view, pose);
+}
+
+int FxsMD5MeshInstanceUpdatePoseWithAnimationTime(
+    FxsMD5MeshInstance* instance,
+    FxsMD5Sampler* sampler,
+    float seconds
+)
+{
+    FxsMD5Mesh view;
+
+    makeView(&view, instance);
+
+    return FxsMD5MeshUpdatePoseWithAnimationTime(&view, sampler, seconds);
+}
+
+int FxsMD5MeshInstanceUpdatePoseWithBakedFrame(
+    FxsMD5MeshInstance* instance,
+    const FxsMD5BakedAnimation* baked,
+    unsigned int frame
+)
+{
+    FxsMD5Mesh view;
+
+    makeView(&view, instance);
+
+    if (!FxsMD5MeshUpdatePoseWithBakedFrame(&view, baked, frame))
+    {
+        return 0;
+    }
+
+    instance->currentAnimationFrame = frame;
+
+    return 1;
+}
+
+int FxsMD5MeshInstancesUpdatePosesWithAnimationFrames(
+    FxsMD5MeshInstance* const* instances,
+    const unsigned int* frames,
+    unsigned int count,
+    const FxsMD5Animation* animation
+)
+{
+    FxsMD5Mesh* views;
+    FxsMD5Mesh** meshes;
+    unsigned int i;
+    int success;
+
+    if (!count)
+    {
+        return 1;
+    }
+
+    views = (FxsMD5Mesh*)malloc(sizeof(FxsMD5Mesh)*count);
+    meshes = (FxsMD5Mesh**)malloc(sizeof(FxsMD5Mesh*)*count);
+
+    if (!views || !meshes)
+    {
+        ERR_MSG("malloc failed");
+        free(views);
+        free(meshes);
+        return 0;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        makeView(&views[i], instances[i]);
+        meshes[i] = &views[i];
+    }
+
+    success = FxsMD5MeshUpdatePosesWithAnimationFrames(
+            meshes,
+            frames,
+            count,
+            animation
+        );
+
+    for (i = 0; success && i < count; i++)
+    {
+        instances[i]->currentAnimationFrame = frames[i];
+    }
+
+    free(views);
+    free(meshes);
+
+    return success;
+}
+
+int FxsMD5MeshInstanceSkinningPalette(
+    const FxsMD5MeshInstance* instance,
+    float* palette,
+    int format
+)
+{
+    FxsMD5Mesh view;
+
+    makeView(&view, instance);
+
+    return FxsMD5MeshSkinningPalette(&view, palette, format);
+}
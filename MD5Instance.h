@@ -0,0 +1,101 @@
+#ifndef MD5INSTANCE_H
+#define MD5INSTANCE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "MD5Mesh.h"
+#include "MD5Bake.h"
+
+/*
+** An animated copy of a mesh. The instance owns only its pose, the
+** geometry stays in the mesh, which is shared by all instances and not
+** changed by them. Different instances can be updated from different
+** threads at the same time, also when they share a mesh or an animation,
+** unless the library is built with FXS_MD5_NO_THREADS (see MD5Thread.h).
+*/
+typedef struct
+{
+    const FxsMD5Mesh* mesh;
+    unsigned int currentAnimationFrame; /* frame of the last update with an
+                                        ** animation frame
+                                        */
+    FxsMD5Skeleton currentPose;         /* joint names are those of the
+                                        ** bind pose of the mesh
+                                        */
+    FxsMD5Stats* stats;                 /* counts the pose updates of the
+                                        ** instance, NULL (the default) if
+                                        ** they are not counted. Instances
+                                        ** that are posed on different
+                                        ** threads need their own stats.
+                                        */
+}
+FxsMD5MeshInstance;
+
+/*
+** Creates an instance of a mesh in the bind pose, the mesh has to outlive
+** the instance. Returns 0 if it fails.
+*/
+int FxsMD5MeshInstanceCreate(
+    FxsMD5MeshInstance** instance,
+    const FxsMD5Mesh* mesh
+);
+
+/*
+** Releases the instance.
+*/
+void FxsMD5MeshInstanceDestroy(FxsMD5MeshInstance** instance);
+
+/*
+** Same as the FxsMD5MeshUpdatePose* functions, for the pose of an instance.
+*/
+int FxsMD5MeshInstanceUpdatePoseWithAnimationFrame(
+    FxsMD5MeshInstance* instance,
+    const FxsMD5Animation* animation,
+    unsigned int frame
+);
+
+int FxsMD5MeshInstanceUpdatePoseWithLocalPose(
+    FxsMD5MeshInstance* instance,
+    const FxsMD5LocalPose* pose
+);
+
+/*
+** The sampler belongs to the instance, samplers must not be shared by
+** threads.
+*/
+int FxsMD5MeshInstanceUpdatePoseWithAnimationTime(
+    FxsMD5MeshInstance* instance,
+    FxsMD5Sampler* sampler,
+    float seconds
+);
+
+int FxsMD5MeshInstanceUpdatePoseWithBakedFrame(
+    FxsMD5MeshInstance* instance,
+    const FxsMD5BakedAnimation* baked,
+    unsigned int frame
+);
+
+int FxsMD5MeshInstancesUpdatePosesWithAnimationFrames(
+    FxsMD5MeshInstance* const* instances,
+    const unsigned int* frames,
+    unsigned int count,
+    const FxsMD5Animation* animation
+);
+
+/*
+** Same as FxsMD5MeshSkinningPalette, for the pose of an instance.
+*/
+int FxsMD5MeshInstanceSkinningPalette(
+    const FxsMD5MeshInstance* instance,
+    float* palette,
+    int format
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5INSTANCE_H */
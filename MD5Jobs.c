@@ -0,0 +1,406 @@
+#include "MD5Jobs.h"
+#include "MD5Thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** Tasks [begin, end) of a submit call.
+*/
+typedef struct
+{
+    FxsMD5TaskFunc func;
+    void* arg;
+    unsigned int begin;
+    unsigned int end;
+}
+TaskRange;
+
+/*
+** A worker thread and its queue. The queue is a ring of ranges, the worker
+** takes tasks from the front, thieves take them from the back.
+*/
+typedef struct
+{
+    FxsMD5WorkPool* pool;
+    FxsMD5Thread thread;
+    FxsMD5Mutex mutex;          /* guards the queue */
+    TaskRange* ranges;
+    unsigned int capacity;
+    unsigned int head;          /* first range of the queue */
+    unsigned int count;         /* # of ranges in the queue */
+    unsigned int index;         /* index of the worker in the pool */
+}
+Worker;
+
+struct FxsMD5WorkPool
+{
+    Worker* workers;
+    unsigned int numThreads;    /* # of workers */
+    unsigned int numWorkers;    /* # of started workers */
+    FxsMD5Mutex mutex;          /* guards generation, quit and isStarted */
+    FxsMD5Condition wake;       /* signaled when tasks were queued */
+    unsigned long generation;   /* incremented for each submit */
+    int quit;
+    int isStarted;              /* 1 once all workers were started */
+};
+
+/*
+** Appends a range to the back of the queue, the worker's mutex needs to be
+** locked. Returns 0 if it fails.
+*/
+static int pushRange(Worker* worker, const TaskRange* range)
+{
+    TaskRange* grown;
+    unsigned int i;
+
+    if (worker->count == worker->capacity)
+    {
+        /* unroll the ring into a larger array */
+        grown = (TaskRange*)malloc(sizeof(TaskRange)*(worker->capacity*2 + 8));
+
+        if (!grown)
+        {
+            ERR_MSG("malloc failed");
+            return 0;
+        }
+
+        for (i = 0; i < worker->count; i++)
+        {
+            grown[i] = worker->ranges[(worker->head + i) % worker->capacity];
+        }
+
+        free(worker->ranges);
+        worker->ranges = grown;
+        worker->capacity = worker->capacity*2 + 8;
+        worker->head = 0;
+    }
+
+    worker->ranges[(worker->head + worker->count) % worker->capacity] = *range;
+    worker->count++;
+
+    return 1;
+}
+
+/*
+** Takes the first task of the worker's queue. Returns 0 if it is empty.
+*/
+static int takeOwnTask(Worker* worker, TaskRange* task)
+{
+    TaskRange* front;
+    int found = 0;
+
+    FxsMD5MutexLock(&worker->mutex);
+
+    if (worker->count)
+    {
+        front = &worker->ranges[worker->head];
+        *task = *front;
+        task->end = task->begin + 1;
+        front->begin++;
+
+        if (front->begin == front->end)
+        {
+            worker->head = (worker->head + 1) % worker->capacity;
+            worker->count--;
+        }
+
+        found = 1;
+    }
+
+    FxsMD5MutexUnlock(&worker->mutex);
+
+    return found;
+}
+
+/*
+** Moves the upper half of the last range of the victim to the thief's queue.
+** Returns 0 if the victim has nothing to steal.
+*/
+static int stealTasks(Worker* thief, Worker* victim)
+{
+    TaskRange* back;
+    TaskRange stolen;
+    int found = 0;
+
+    FxsMD5MutexLock(&victim->mutex);
+
+    if (victim->count)
+    {
+        back = &victim->ranges[(victim->head + victim->count - 1) % victim->capacity];
+        stolen = *back;
+        stolen.begin = back->begin + (back->end - back->begin)/2;
+        back->end = stolen.begin;
+
+        if (back->begin == back->end)
+        {
+            victim->count--;
+        }
+
+        found = 1;
+    }
+
+    FxsMD5MutexUnlock(&victim->mutex);
+
+    if (!found)
+    {
+        return 0;
+    }
+
+    FxsMD5MutexLock(&thief->mutex);
+    found = pushRange(thief, &stolen);
+    FxsMD5MutexUnlock(&thief->mutex);
+
+    /* run what could not be queued right away */
+    if (!found)
+    {
+        for (; stolen.begin < stolen.end; stolen.begin++)
+        {
+            stolen.func(stolen.arg, stolen.begin);
+        }
+    }
+
+    return 1;
+}
+
+/*
+** Takes a task from the worker's queue or steals one. Returns 0 if all
+** queues are empty.
+*/
+static int takeTask(Worker* worker, TaskRange* task)
+{
+    FxsMD5WorkPool* pool = worker->pool;
+    unsigned int i;
+
+    while (!takeOwnTask(worker, task))
+    {
+        for (i = 1; i < pool->numWorkers; i++)
+        {
+            if (stealTasks(worker, &pool->workers[(worker->index + i) % pool->numWorkers]))
+            {
+                break;
+            }
+        }
+
+        if (i >= pool->numWorkers)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void* runWorker(void* arg)
+{
+    Worker* worker = (Worker*)arg;
+    FxsMD5WorkPool* pool = worker->pool;
+    TaskRange task;
+    unsigned long generation;
+
+    /* wait until numWorkers is final */
+    FxsMD5MutexLock(&pool->mutex);
+
+    while (!pool->isStarted)
+    {
+        FxsMD5ConditionWait(&pool->wake, &pool->mutex);
+    }
+
+    FxsMD5MutexUnlock(&pool->mutex);
+
+    while (1)
+    {
+        FxsMD5MutexLock(&pool->mutex);
+        generation = pool->generation;
+        FxsMD5MutexUnlock(&pool->mutex);
+
+        while (takeTask(worker, &task))
+        {
+            task.func(task.arg, task.begin);
+        }
+
+        /* sleep unless tasks were submitted while the queues were searched */
+        FxsMD5MutexLock(&pool->mutex);
+
+        if (pool->generation == generation)
+        {
+            if (pool->quit)
+            {
+                FxsMD5MutexUnlock(&pool->mutex);
+                break;
+            }
+
+            FxsMD5ConditionWait(&pool->wake, &pool->mutex);
+        }
+
+        FxsMD5MutexUnlock(&pool->mutex);
+    }
+
+    return NULL;
+}
+
+/*
+** Spreads the tasks evenly over the workers, neighbouring tasks stay on the
+** same worker.
+*/
+static int submitTasks(void* context, FxsMD5TaskFunc func, void* arg, unsigned int count)
+{
+    FxsMD5WorkPool* pool = (FxsMD5WorkPool*)context;
+    TaskRange range;
+    unsigned int i;
+    int success = 1;
+
+    /* w/o workers the submitting thread runs the tasks */
+    if (!pool->numWorkers)
+    {
+        for (i = 0; i < count; i++)
+        {
+            func(arg, i);
+        }
+
+        return 1;
+    }
+
+    range.func = func;
+    range.arg = arg;
+
+    for (i = 0; i < pool->numWorkers; i++)
+    {
+        range.begin = (unsigned int)((unsigned long long)count*i/pool->numWorkers);
+        range.end = (unsigned int)((unsigned long long)count*(i + 1)/pool->numWorkers);
+
+        if (range.begin == range.end)
+        {
+            continue;
+        }
+
+        if (success)
+        {
+            FxsMD5MutexLock(&pool->workers[i].mutex);
+            success = pushRange(&pool->workers[i], &range);
+            FxsMD5MutexUnlock(&pool->workers[i].mutex);
+        }
+
+        /* run the tasks that could not be queued */
+        for (; !success && range.begin < range.end; range.begin++)
+        {
+            func(arg, range.begin);
+        }
+    }
+
+    FxsMD5MutexLock(&pool->mutex);
+    pool->generation++;
+    FxsMD5ConditionBroadcast(&pool->wake);
+    FxsMD5MutexUnlock(&pool->mutex);
+
+    return 1;
+}
+
+int FxsMD5WorkPoolCreate(FxsMD5WorkPool** pool, unsigned int numThreads)
+{
+    unsigned int i;
+
+    if (!numThreads)
+    {
+        numThreads = FxsMD5NumProcessors();
+    }
+
+    *pool = (FxsMD5WorkPool*)malloc(sizeof(FxsMD5WorkPool));
+
+    if (!*pool)
+    {
+        ERR_MSG("malloc failed");
+        return 0;
+    }
+
+    memset(*pool, 0, sizeof(FxsMD5WorkPool));
+
+    (*pool)->workers = (Worker*)calloc(numThreads, sizeof(Worker));
+
+    if (!(*pool)->workers)
+    {
+        ERR_MSG("malloc failed");
+        free(*pool);
+        *pool = NULL;
+        return 0;
+    }
+
+    FxsMD5MutexInit(&(*pool)->mutex);
+    FxsMD5ConditionInit(&(*pool)->wake);
+
+    for (i = 0; i < numThreads; i++)
+    {
+        FxsMD5MutexInit(&(*pool)->workers[i].mutex);
+        (*pool)->workers[i].pool = *pool;
+        (*pool)->workers[i].index = i;
+    }
+
+    (*pool)->numThreads = numThreads;
+
+    for (i = 0; i < numThreads; i++)
+    {
+        if (!FxsMD5ThreadCreate(
+            &(*pool)->workers[i].thread,
+            runWorker,
+            &(*pool)->workers[i])
+        )
+        {
+            break;
+        }
+    }
+
+    /* workers only look at the workers that were started */
+    FxsMD5MutexLock(&(*pool)->mutex);
+    (*pool)->numWorkers = i;
+    (*pool)->isStarted = 1;
+    FxsMD5ConditionBroadcast(&(*pool)->wake);
+    FxsMD5MutexUnlock(&(*pool)->mutex);
+
+    return 1;
+}
+
+void FxsMD5WorkPoolDestroy(FxsMD5WorkPool** pool)
+{
+    unsigned int i;
+
+    if (!*pool)
+    {
+        return;
+    }
+
+    FxsMD5MutexLock(&(*pool)->mutex);
+    (*pool)->quit = 1;
+    (*pool)->generation++;
+    FxsMD5ConditionBroadcast(&(*pool)->wake);
+    FxsMD5MutexUnlock(&(*pool)->mutex);
+
+    for (i = 0; i < (*pool)->numWorkers; i++)
+    {
+        FxsMD5ThreadJoin(&(*pool)->workers[i].thread);
+    }
+
+    for (i = 0; i < (*pool)->numThreads; i++)
+    {
+        FxsMD5MutexDestroy(&(*pool)->workers[i].mutex);
+        free((*pool)->workers[i].ranges);
+    }
+
+    FxsMD5ConditionDestroy(&(*pool)->wake);
+    FxsMD5MutexDestroy(&(*pool)->mutex);
+    free((*pool)->workers);
+    free(*pool);
+
+    *pool = NULL;
+}
+
+FxsMD5Scheduler FxsMD5WorkPoolScheduler(FxsMD5WorkPool* pool)
+{
+    FxsMD5Scheduler scheduler;
+
+    scheduler.context = pool;
+    scheduler.submit = submitTasks;
+
+    return scheduler;
+}
@@ -0,0 +1,56 @@
+#ifndef MD5JOBS_H
+#define MD5JOBS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+** A task of a job, index is in [0, count) of the submit call.
+*/
+typedef void (*FxsMD5TaskFunc)(void* arg, unsigned int index);
+
+/*
+** Interface to the thread pool that runs the tasks of the library's jobs,
+** callers can plug in their own pool. submit has to run func(arg, i) once
+** for each i in [0, count), on any thread and in any order, and may return
+** before the tasks ran. It returns 0 if the tasks could not be queued.
+** Built with FXS_MD5_NO_THREADS (see MD5Thread.h), submit has to run all
+** tasks before it returns.
+*/
+typedef struct
+{
+    void* context;
+    int (*submit)(void* context, FxsMD5TaskFunc func, void* arg, unsigned int count);
+}
+FxsMD5Scheduler;
+
+/*
+** The library's default pool. Each worker owns a queue of task ranges and
+** steals half a range from another worker when its queue runs empty.
+*/
+typedef struct FxsMD5WorkPool FxsMD5WorkPool;
+
+/*
+** Starts a pool with numThreads workers, 0 means one per processor. If no
+** thread can be started the tasks run on the submitting thread. Returns 0
+** if it fails.
+*/
+int FxsMD5WorkPoolCreate(FxsMD5WorkPool** pool, unsigned int numThreads);
+
+/*
+** Runs the queued tasks, stops the workers and releases the pool.
+*/
+void FxsMD5WorkPoolDestroy(FxsMD5WorkPool** pool);
+
+/*
+** Returns the scheduler interface of the pool.
+*/
+FxsMD5Scheduler FxsMD5WorkPoolScheduler(FxsMD5WorkPool* pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5JOBS_H */
@@ -0,0 +1,53 @@
+/* posix_memalign is POSIX, not C99 */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "MD5Memory.h"
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+void* FxsMD5AlignedAlloc(size_t size, size_t alignment)
+{
+    void* ptr = NULL;
+
+    /* posix_memalign needs a multiple of sizeof(void*) */
+    if (alignment < sizeof(void*))
+    {
+        alignment = sizeof(void*);
+    }
+
+    /* always hand out a valid pointer, even for empty blocks */
+    if (size == 0)
+    {
+        size = alignment;
+    }
+
+#ifdef _WIN32
+    ptr = _aligned_malloc(size, alignment);
+#else
+    if (posix_memalign(&ptr, alignment, size) != 0)
+    {
+        ptr = NULL;
+    }
+#endif
+
+    return ptr;
+}
+
+void FxsMD5AlignedFree(void* ptr)
+{
+    if (!ptr)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
@@ -0,0 +1,31 @@
+#ifndef MD5MEMORY_H
+#define MD5MEMORY_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+
+/*
+** Alignment of large arrays, one cache line.
+*/
+#define FXS_MD5_ALIGNMENT 64
+
+/*
+** Allocates size bytes aligned to alignment, which needs to be a power of 
+** two. Returns NULL if it fails.
+*/
+void* FxsMD5AlignedAlloc(size_t size, size_t alignment);
+
+/*
+** Releases memory allocated with FxsMD5AlignedAlloc.
+*/
+void FxsMD5AlignedFree(void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5MEMORY_H */
@@ -7,6 +7,7 @@
 
 
 #include "MD5Mesh.h"
+#include "MD5Parser.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,213 +25,200 @@ static FxsMatrix4 conversation = {
     };
 
 /*
-** read a line from a file. return 1 in case of EOF.
-*/ 
-static int readLine(char* line, int maxChars, FILE* file)
-{
-	char c;
-	int numChars = 0;
-
-	do
-	{
-		c = fgetc(file);
-		line[numChars] = c;
-		numChars++;
-	} 
-	while (c != EOF && c != '\r' && c != '\n' && numChars < maxChars - 1);
-
-    /* finish the string */
-	line[numChars - 1] = '\0';
-    
-    
-    /* swallow the line feed as well */
-    if (c == '\r')
-    {
-        c = fgetc(file);
-    }
-    
-    /* check for end of file */
-    if (c == EOF)
-    {
-        return 1;
-    }
-    else
-    {
-        return 0;
-    }
-}
+** Skeletons with up to this many joints decode frames on the stack, larger
+** ones into a scratch buffer of the animation.
+*/
+#define DECODE_STACK_JOINTS 128
 
 /*
-** Trims the line and removes comments. replace tabs with spaces and 
-** dont allow more than two spaces in a row.
+** Sets transform to parent*translation*rotation of a joint. A joint
+** transform is affine, so only the upper 3 rows are computed from the
+** rotation and the position, without building and multiplying the
+** translation and rotation matrices. The rotation is the one
+** FxsMatrix4MakeRotationWithQuaternion makes, and the sums are in the same
+** order as FxsMatrix4Multiply and updatePoses.
 */
-static void processLine(char* pline, const char* line)
+static void composeTransform(
+    FxsMatrix4* transform,
+    const FxsMatrix4* parent,
+    const FxsVector3* position,
+    const FxsQuaternion* orientation
+)
 {
-    int i = 0;
-    int l = 0;
-    char* c;
-    int isPrevSpace = 0;
-    
-    /* find first non blank char in the line */
-    while (line[i] == ' ' || line[i] == '\t')
-    {
-        i++;
-    }
-    
-    /* cut line where comment is found */
-    c = strstr(line, "//");
-    
-    if (c)
-    {
-        *c = '\0';
-    }
-    
-    /* replace tabs and no more two or more spaces in a row */
-    while (line[i] != '\0')
+    const float* p = (const float*)parent;
+    float* t = (float*)transform;
+    float x = orientation->x;
+    float y = orientation->y;
+    float z = orientation->z;
+    float w = orientation->w;
+    float l[12];                /* rotation then position, column major */
+    int c, e;
+
+    l[0] = 1.0f - 2.0f*(y*y + z*z);
+    l[1] = 2.0f*(x*y + w*z);
+    l[2] = 2.0f*(x*z - w*y);
+    l[3] = 2.0f*(x*y - w*z);
+    l[4] = 1.0f - 2.0f*(x*x + z*z);
+    l[5] = 2.0f*(y*z + w*x);
+    l[6] = 2.0f*(x*z + w*y);
+    l[7] = 2.0f*(y*z - w*x);
+    l[8] = 1.0f - 2.0f*(x*x + y*y);
+    l[9] = position->x;
+    l[10] = position->y;
+    l[11] = position->z;
+
+    for (c = 0; c < 3; c++)
     {
-        if ((line[i] == '\t' || line[i] == ' ') && !isPrevSpace)
-        {
-            pline[l] = ' ';
-            l++;
-            isPrevSpace = 1;
-        }
-        else
+        for (e = 0; e < 3; e++)
         {
-            isPrevSpace = 0;
-            pline[l] = line[i];
-            l++;
+            t[c*4 + e] = p[0*4 + e]*l[c*3 + 0]
+                + p[1*4 + e]*l[c*3 + 1]
+                + p[2*4 + e]*l[c*3 + 2];
         }
-        
-        i++;
-    }
-    
-    /* make sure: no spaces at the end of the line*/
-    if (l > 1 && pline[l - 1] == ' ')
-    {
-        pline[l-1] = '\0';
+
+        t[c*4 + 3] = 0.0f;
     }
-    else
+
+    for (e = 0; e < 3; e++)
     {
-        pline[l] = '\0';
+        t[3*4 + e] = p[0*4 + e]*l[9] + p[1*4 + e]*l[10] + p[2*4 + e]*l[11]
+            + p[3*4 + e];
     }
+
+    t[3*4 + 3] = 1.0f;
 }
 
+/*
+** Keywords at the beginning of a line of the mesh file.
+*/
+enum
+{
+    KEYWORD_NUM_JOINTS,
+    KEYWORD_NUM_MESHES,
+    KEYWORD_JOINTS,
+    KEYWORD_MESH,
+    NUM_KEYWORDS
+};
+
+static const char* const keywords[NUM_KEYWORDS] = {
+        "numJoints",
+        "numMeshes",
+        "joints",
+        "mesh"
+    };
+
+/*
+** Keywords at the beginning of a line of a sub-mesh.
+*/
+enum
+{
+    SUB_MESH_KEYWORD_SHADER,
+    SUB_MESH_KEYWORD_NUM_VERTS,
+    SUB_MESH_KEYWORD_VERT,
+    SUB_MESH_KEYWORD_NUM_TRIS,
+    SUB_MESH_KEYWORD_TRI,
+    SUB_MESH_KEYWORD_NUM_WEIGHTS,
+    SUB_MESH_KEYWORD_WEIGHT,
+    SUB_MESH_KEYWORD_CLOSE,
+    NUM_SUB_MESH_KEYWORDS
+};
+
+static const char* const subMeshKeywords[NUM_SUB_MESH_KEYWORDS] = {
+        "shader",
+        "numverts",
+        "vert",
+        "numtris",
+        "tri",
+        "numweights",
+        "weight",
+        "}"
+    };
+
 /*
 ** Loads joints, returns 1 if everything was okay 0 otherwise/
 */
-static int loadJoints(FxsMD5Mesh* mesh, FILE* file)
+static int loadJoints(FxsMD5Mesh* mesh, FxsMD5Parser* parser)
 {
-    int i = 0, j = 0;               /* loop var */
-    char line[256];
-    char pline[256];
-    char name[256];
-    char pname[256];                /* name of the joints w/o quotation marks*/
-    size_t nameLength;
+    FxsMD5Token name;
+    float p[3];                 /* position */
+    float o[3];                 /* orientation axis */
     FxsVector3 position;
     FxsVector3 orientationAxis;
     int parent;
-    int scres;                  /* result of sscanf */
     int loaded = 0;             /* counts loaded joints */
-    FxsMatrix4 trans;
-    FxsMatrix4 rot;
-    FxsMatrix4 temp;
 
     /* read in joints */
     while (1)
     {
-        /* read in line */
-        if (readLine(line, sizeof(line), file))
+        /* move to the next line */
+        if (!FxsMD5ParserNextLine(parser))
         {
             /* if file end unexpectedly, complain ... */
             ERR_MSG("File ended unexpectedly");
             return 0;
         }
         
-        processLine(pline, line);
-        
-        /* scan line for joint data */
-        scres = sscanf(
-                pline,
-                "%s %d ( %f %f %f ) ( %f %f %f )",
-                name,
-                &parent,
-                &position.x,
-                &position.y,
-                &position.z,
-                &orientationAxis.x,
-                &orientationAxis.y,
-                &orientationAxis.z
-            );
+        FxsMD5ParserReadToken(parser, &name);
+
+        /* stop when we reach the closing curly brace*/
+        if (FxsMD5TokenIs(&name, "}"))
+        {
+            break;
+        }
         
-        /* if full data was found copy it to our mesh's bindPose */
-        if (scres == 8)
+        /* scan line for joint data, ignore the line if it is incomplete */
+        if (!FxsMD5ParserReadInt(parser, &parent)
+        || !FxsMD5ParserReadTuple(parser, p, 3)
+        || !FxsMD5ParserReadTuple(parser, o, 3))
         {
-            if (loaded >= mesh->bindPose.numJoints)
-            {
-                ERR_MSG("Too many joints found");
-                return 0;
-            }
-            
-            nameLength = strlen(name);
+            continue;
+        }
         
-            /* remove quotation marks of name*/
-            j = 0;
-            for (i = 0; i < nameLength; i++)
-            {
-                if (name[i] != '"')
-                {
-                    pname[j] = name[i];
-                    j++;
-                }
-            }
+        if (loaded >= mesh->bindPose.numJoints)
+        {
+            ERR_MSG("Too many joints found");
+            return 0;
+        }
 
-            pname[j] = '\0';
-            nameLength = strlen(pname);
+        position.x = p[0];
+        position.y = p[1];
+        position.z = p[2];
+        orientationAxis.x = o[0];
+        orientationAxis.y = o[1];
+        orientationAxis.z = o[2];
 
-            /* copy scanned data to joint*/
-            mesh->bindPose.joints[loaded].name = (char*)malloc(nameLength + 1);
-            memcpy(mesh->bindPose.joints[loaded].name, pname, nameLength + 1);
-            mesh->bindPose.joints[loaded].parent = parent;
-            mesh->bindPose.joints[loaded].position = position;
-            
-            /* make the quaternion for the rotation of the joint*/
-            if (!FxsQuaternionMakeWithAxis(
-                &mesh->bindPose.joints[loaded].orientation,
-                &orientationAxis)
-            )
-            {
-                ERR_MSG("Invalid quaternion axis");
-                return 0;
-            }
-            
-            /* make the transformation matrix and copy to joint */
-            FxsMatrix4MakeTranslation(&trans, position.x, position.y, position.z);
-            FxsMatrix4MakeRotationWithQuaternion(
-                &rot,
-                &mesh->bindPose.joints[loaded].orientation
-            );
-
-            /* I guess its rotation first then translation ... */
-            FxsMatrix4Multiply(&temp, &trans, &rot);
-
-            /* store the transform but don't forget to convert it
-            ** to opengl space.
-            */
-            FxsMatrix4Multiply(
-                &mesh->bindPose.joints[loaded].transform,
-                &conversation,
-                &temp
-            );
+        /* copy scanned data to joint, w/o the quotation marks of the name */
+        mesh->bindPose.joints[loaded].name = FxsMD5TokenCopyUnquoted(&name);
+        mesh->bindPose.joints[loaded].parent = parent;
+        mesh->bindPose.joints[loaded].position = position;
 
-            
-            loaded++;
+        if (!mesh->bindPose.joints[loaded].name)
+        {
+            ERR_MSG("malloc failed");
+            return 0;
         }
+
+        FXS_MD5_STATS_ALLOC(mesh->stats, name.length + 1);
         
-        /* stop when we reach the closing curly brace*/
-        if (pline[0] == '}')
+        /* make the quaternion for the rotation of the joint*/
+        if (!FxsQuaternionMakeWithAxis(
+            &mesh->bindPose.joints[loaded].orientation,
+            &orientationAxis)
+        )
         {
-            break;
+            ERR_MSG("Invalid quaternion axis");
+            return 0;
         }
+        
+        /* rotation first then translation, converted to opengl space */
+        composeTransform(
+            &mesh->bindPose.joints[loaded].transform,
+            &conversation,
+            &position,
+            &mesh->bindPose.joints[loaded].orientation
+        );
+
+        loaded++;
     }
     
     /* check if the file lists the correct amount of joints */
@@ -243,19 +231,20 @@ static int loadJoints(FxsMD5Mesh* mesh, FILE* file)
     return 1;
 }
 
-static int loadSubMeshes(FxsMD5SubMesh* mesh, FILE* file)
+static int loadSubMeshes(
+    FxsMD5SubMesh* mesh,
+    FxsMD5Parser* parser,
+    FxsMD5Stats* stats
+)
 {
-    char line[256];
-    char pline[256];
-    char str[256];
-    size_t len;
-    int scres;
+    FxsMD5Token token;
+    float t[2];                 /* tex coords */
+    float p[3];                 /* position */
     
     /* vertex data */
     int numVertices = 0;
     int loadedVertices = 0;
     int vertId;
-    FxsVector2 texCoord;
     int weightIdVert;
     int numWeightsVert;
     
@@ -271,190 +260,210 @@ static int loadSubMeshes(FxsMD5SubMesh* mesh, FILE* file)
     int weightId;
     int joinIdWeight;
     float weightValue;
-    FxsVector3 weightPos;
-    
     
     /* read in the submesh mesh */
     while (1)
     {
-    
-        /* read in line */
-        if (readLine(line, sizeof(line), file))
+        /* move to the next line */
+        if (!FxsMD5ParserNextLine(parser))
         {
             /* if file end unexpectedly, complain ... */
             ERR_MSG("File ended unexpectedly");
             return 0;
         }
         
-        processLine(pline, line);
-        
-        /* read the shader filename */
-        scres = sscanf(pline, "shader %s", str);
+        FxsMD5ParserReadToken(parser, &token);
 
-        if (scres == 1)
+        /* dispatch on the first token of the line, lines that can not be
+        ** read completely are ignored.
+        */
+        switch (FxsMD5TokenMatch(&token, subMeshKeywords, NUM_SUB_MESH_KEYWORDS))
         {
-            len = strlen(str);
+            /* read the shader filename */
+            case SUB_MESH_KEYWORD_SHADER:
             
-            mesh->shader = (char*)malloc(len + 1);
-            memcpy(mesh->shader, str, len + 1);
+                if (!FxsMD5ParserReadToken(parser, &token))
+                {
+                    break;
+                }
+                
+                mesh->shader = FxsMD5TokenCopy(&token);
+                
+                if (!mesh->shader)
+                {
+                    ERR_MSG("malloc failed");
+                    return 0;
+                }
+
+                FXS_MD5_STATS_ALLOC(stats, token.length + 1);
+                
+                break;
+                
+            /* read the # of vertices for this submesh, and malloc */
+            case SUB_MESH_KEYWORD_NUM_VERTS:
             
-            continue;
-        }
-        
-        /* read the # of vertices for this submesh, and malloc */
-        scres = sscanf(pline, "numverts %d", &numVertices);
-        
-        if (scres == 1)
-        {
-            mesh->numVertices = numVertices;
-            mesh->vertices = (FxsMD5Vertex*)malloc(sizeof(FxsMD5Vertex)*numVertices);
-        
-            if (!mesh->vertices)
-            {
-                ERR_MSG("malloc failed");
-                return 0;
-            }
+                if (!FxsMD5ParserReadInt(parser, &numVertices))
+                {
+                    break;
+                }
+                
+                mesh->numVertices = numVertices;
+                mesh->vertices = (FxsMD5Vertex*)malloc(sizeof(FxsMD5Vertex)*numVertices);
             
-            continue;
-        }
-        
-        /* read each vertex */
-        scres = sscanf(
-                pline,
-                "vert %d ( %f %f ) %d %d",
-                &vertId,
-                &texCoord.x,
-                &texCoord.y,
-                &weightIdVert,
-                &numWeightsVert
-            );
-        
-        if (scres == 5)
-        {
-            /* check for array overflow */
-            if (loadedVertices >= mesh->numVertices)
-            {
-                ERR_MSG("Too many vertices found")
-                return  0;
-            }
-        
-            mesh->vertices[loadedVertices].id = vertId;
-            mesh->vertices[loadedVertices].texCoords = texCoord;
-            mesh->vertices[loadedVertices].weightId = weightIdVert;
-            mesh->vertices[loadedVertices].numWeights = numWeightsVert;
+                if (!mesh->vertices)
+                {
+                    ERR_MSG("malloc failed");
+                    return 0;
+                }
+
+                FXS_MD5_STATS_ALLOC(stats, sizeof(FxsMD5Vertex)*numVertices);
+                
+                break;
+                
+            /* read each vertex */
+            case SUB_MESH_KEYWORD_VERT:
             
-            loadedVertices++;
+                if (!FxsMD5ParserReadInt(parser, &vertId)
+                || !FxsMD5ParserReadTuple(parser, t, 2)
+                || !FxsMD5ParserReadInt(parser, &weightIdVert)
+                || !FxsMD5ParserReadInt(parser, &numWeightsVert))
+                {
+                    break;
+                }
+                
+                /* check for array overflow */
+                if (loadedVertices >= mesh->numVertices)
+                {
+                    ERR_MSG("Too many vertices found")
+                    return  0;
+                }
             
-            continue;
-        }
-    
-        /* read the number of triangles */
-        scres = sscanf(pline, "numtris %d", &numTriangles);
+                mesh->vertices[loadedVertices].id = vertId;
+                mesh->vertices[loadedVertices].texCoords.x = t[0];
+                mesh->vertices[loadedVertices].texCoords.y = t[1];
+                mesh->vertices[loadedVertices].weightId = weightIdVert;
+                mesh->vertices[loadedVertices].numWeights = numWeightsVert;
+                
+                loadedVertices++;
+                
+                break;
         
-        if (scres == 1)
-        {
-            mesh->numFaces = numTriangles;
-            mesh->faces = (FxsMD5Face*)malloc(sizeof(FxsMD5Face)*numTriangles);
+            /* read the number of triangles */
+            case SUB_MESH_KEYWORD_NUM_TRIS:
+            
+                if (!FxsMD5ParserReadInt(parser, &numTriangles))
+                {
+                    break;
+                }
+                
+                mesh->numFaces = numTriangles;
+                mesh->faces = (FxsMD5Face*)malloc(sizeof(FxsMD5Face)*numTriangles);
 
-            if (!mesh->faces)
-            {
-                ERR_MSG("malloc failed");
-                return 0;
-            }
+                if (!mesh->faces)
+                {
+                    ERR_MSG("malloc failed");
+                    return 0;
+                }
+
+                FXS_MD5_STATS_ALLOC(stats, sizeof(FxsMD5Face)*numTriangles);
+                
+                break;
+
+            /* read triangles */
+            case SUB_MESH_KEYWORD_TRI:
             
-            continue;
-        }
+                if (!FxsMD5ParserReadInt(parser, &triId)
+                || !FxsMD5ParserReadInt(parser, &v1)
+                || !FxsMD5ParserReadInt(parser, &v2)
+                || !FxsMD5ParserReadInt(parser, &v3))
+                {
+                    break;
+                }
+                
+                /* check for array overflow */
+                if (loadedTriangles >= mesh->numFaces)
+                {
+                    ERR_MSG("Too many vertices found")
+                    return  0;
+                }
+            
+                mesh->faces[loadedTriangles].id = triId;
+                mesh->faces[loadedTriangles].v1 = v1;
+                mesh->faces[loadedTriangles].v2 = v2;
+                mesh->faces[loadedTriangles].v3 = v3;
+                
+                loadedTriangles++;
+                
+                break;
 
-        /* read triangles */
-        scres = sscanf(
-                pline,
-                "tri %d %d %d %d",
-                &triId,
-                &v1,
-                &v2,
-                &v3
-            );
-        
-        if (scres == 4)
-        {
-            /* check for array overflow */
-            if (loadedTriangles >= mesh->numFaces)
-            {
-                ERR_MSG("Too many vertices found")
-                return  0;
-            }
-        
-            mesh->faces[loadedTriangles].id = triId;
-            mesh->faces[loadedTriangles].v1 = v1;
-            mesh->faces[loadedTriangles].v2 = v2;
-            mesh->faces[loadedTriangles].v3 = v3;
+            /* read # of weights */
+            case SUB_MESH_KEYWORD_NUM_WEIGHTS:
             
-            loadedTriangles++;
-        }
+                if (!FxsMD5ParserReadInt(parser, &numWeights))
+                {
+                    break;
+                }
+                
+                mesh->numWeights = numWeights;
+                mesh->weights = (FxsMD5Weight*)malloc(sizeof(FxsMD5Weight)*numWeights);
 
-        /* read # of weights */
-        scres = sscanf(pline, "numweights %d", &numWeights);
-        
-        if (scres == 1)
-        {
-            mesh->numWeights = numWeights;
-            mesh->weights = (FxsMD5Weight*)malloc(sizeof(FxsMD5Weight)*numWeights);
+                if (!mesh->weights)
+                {
+                    ERR_MSG("malloc failed");
+                    return 0;
+                }
 
-            if (!mesh->weights)
-            {
-                ERR_MSG("malloc failed");
-                return 0;
-            }
-            
-            continue;
-        }
+                FXS_MD5_STATS_ALLOC(stats, sizeof(FxsMD5Weight)*numWeights);
+                
+                break;
 
-        /* read weights */
-        scres = sscanf(
-                pline,
-                "weight %d %d %f ( %f %f %f )",
-                &weightId,
-                &joinIdWeight,
-                &weightValue,
-                &weightPos.x,
-                &weightPos.y,
-                &weightPos.z
-            );
-        
-        if (scres == 6)
-        {
-            /* overflow check */
-            if (loadedWeights >= mesh->numWeights)
-            {
-                ERR_MSG("Too many weights found");
-                return 0;
-            }
+            /* read weights */
+            case SUB_MESH_KEYWORD_WEIGHT:
             
-            mesh->weights[loadedWeights].id = weightId;
-            mesh->weights[loadedWeights].jointId = joinIdWeight;
-            mesh->weights[loadedWeights].value = weightValue;
-            mesh->weights[loadedWeights].position = weightPos;
+                if (!FxsMD5ParserReadInt(parser, &weightId)
+                || !FxsMD5ParserReadInt(parser, &joinIdWeight)
+                || !FxsMD5ParserReadFloat(parser, &weightValue)
+                || !FxsMD5ParserReadTuple(parser, p, 3))
+                {
+                    break;
+                }
+                
+                /* overflow check */
+                if (loadedWeights >= mesh->numWeights)
+                {
+                    ERR_MSG("Too many weights found");
+                    return 0;
+                }
+                
+                mesh->weights[loadedWeights].id = weightId;
+                mesh->weights[loadedWeights].jointId = joinIdWeight;
+                mesh->weights[loadedWeights].value = weightValue;
+                mesh->weights[loadedWeights].position.x = p[0];
+                mesh->weights[loadedWeights].position.y = p[1];
+                mesh->weights[loadedWeights].position.z = p[2];
+                
+                loadedWeights++;
+                
+                break;
+                
+            /* stop when we reach the closing curly brace */
+            case SUB_MESH_KEYWORD_CLOSE:
             
-            loadedWeights++;
-        }
-
-        /* stop when we reach the closing curly brace*/
-        if (pline[0] == '}')
-        {
-            break;
+                /* check if all vertices, weights and triangles were loaded */
+                if (numVertices != loadedVertices
+                || numTriangles != loadedTriangles
+                || numWeights != loadedWeights)
+                {
+                    ERR_MSG("Invalid number of vertices, triangles or weights");
+                    return 0;
+                }
+                
+                return 1;
+                
+            default:
+                break;
         }
     }
-    
-    /* check if all vertices, weights and triangles were loaded */
-    if (numVertices != loadedVertices
-    || numTriangles != loadedTriangles
-    || numWeights != loadedWeights)
-    {
-        ERR_MSG("Invalid number of vertices, triangles or weights");
-        return 0;
-    }
-
-    return 1;
 }
 
 /*
@@ -462,10 +471,20 @@ static int loadSubMeshes(FxsMD5SubMesh* mesh, FILE* file)
 */ 
 int FxsMD5MeshCreateWithFile(FxsMD5Mesh** mesh, const char* filename)
 {
-	FILE* file;
-    char line[256];
-    char pline[256];
-    int isEOF;
+    return FxsMD5MeshCreateWithFileAndOptions(mesh, filename, NULL);
+}
+
+int FxsMD5MeshCreateWithFileAndOptions(
+    FxsMD5Mesh** mesh,
+    const char* filename,
+    const FxsMD5MeshLoadOptions* options
+)
+{
+    FxsMD5File file;
+    FxsMD5Parser parser;
+    FxsMD5Token token;
+    FxsMD5Stats* stats = options ? options->stats : NULL;
+    unsigned long long start;
     int numJoints = 0; /* # of joints */
     int numMeshes = 0; /* # of meshes */
     int loadedMeshes = 0;
@@ -473,128 +492,208 @@ int FxsMD5MeshCreateWithFile(FxsMD5Mesh** mesh, const char* filename)
 
 	*mesh = (FxsMD5Mesh*)malloc(sizeof(FxsMD5Mesh));	
 
-	if (!mesh) 
+	if (!*mesh) 
 	{
 	    return 0;
 	}
     
     /* init mesh to zero */
     memset(*mesh, 0, sizeof(FxsMD5Mesh));
+    (*mesh)->stats = stats;
 	
-	file = fopen(filename, "r");
-
-	if (!file) 
+	if (!FxsMD5FileOpen(&file, filename, 0)) 
 	{
-        ERR_MSG("Could not open file")
 		free(*mesh);
+        *mesh = NULL;
 	    return 0;
 	}
 
-	/* load the file ...  */
-	while (1)
+    FXS_MD5_STATS_ALLOC(stats, sizeof(FxsMD5Mesh));
+    FXS_MD5_STATS_ADD(stats, bytesRead, file.size);
+
+    if (!file.isMapped && file.size)
+    {
+        FXS_MD5_STATS_ALLOC(stats, file.size);
+    }
+
+    FxsMD5ParserInit(&parser, file.data, file.data + file.size);
+
+	/* load the file line by line, dispatch on the first token ...  */
+	while (FxsMD5ParserNextLine(&parser))
 	{
-        isEOF = readLine(line, sizeof(line), file);
-        processLine(pline, line);
+        FxsMD5ParserReadToken(&parser, &token);
         
-        /* find the number of joints */
-        if (strstr(pline, "numJoints") == pline)
+        switch (FxsMD5TokenMatch(&token, keywords, NUM_KEYWORDS))
         {
-            sscanf(pline, "numJoints %d", &numJoints);
-            
-			/* alloc and init the bind pose */
-			(*mesh)->bindPose.joints = (FxsMD5Joint*)malloc(sizeof(FxsMD5Joint)*numJoints);
-            (*mesh)->bindPose.numJoints = numJoints;
+            /* find the number of joints */
+            case KEYWORD_NUM_JOINTS:
             
-            /* in case allocation fails */
-            if (!(*mesh)->bindPose.joints)
-            {
-                success = 0;
+                if (!FxsMD5ParserReadInt(&parser, &numJoints))
+                {
+                    break;
+                }
+                
+                /* alloc and init the bind pose */
+                (*mesh)->bindPose.joints = (FxsMD5Joint*)malloc(sizeof(FxsMD5Joint)*numJoints);
+                (*mesh)->bindPose.numJoints = numJoints;
+                
+                /* in case allocation fails */
+                if (!(*mesh)->bindPose.joints)
+                {
+                    success = 0;
+                    break;
+                }
+
+                FXS_MD5_STATS_ALLOC(stats, sizeof(FxsMD5Joint)*numJoints);
+                
+                /* default init the joints of the bind pose to zero*/
+                memset((*mesh)->bindPose.joints, 0, sizeof(FxsMD5Joint)*numJoints);
+
+                /* alloc and init the current pose */
+                (*mesh)->currentPose.joints = (FxsMD5Joint*)malloc(sizeof(FxsMD5Joint)*numJoints);
+                (*mesh)->currentPose.numJoints = numJoints;
+                
+                /* in case allocation fails */
+                if (!(*mesh)->currentPose.joints)
+                {
+                    success = 0;
+                    break;
+                }
+
+                FXS_MD5_STATS_ALLOC(stats, sizeof(FxsMD5Joint)*numJoints);
+                
+                /* default init the joints of the current pose to zero*/
+                memset((*mesh)->currentPose.joints, 0, sizeof(FxsMD5Joint)*numJoints);
+                
                 break;
-            }
             
-            /* default init the joints of the bind pose to zero*/
-            memset((*mesh)->bindPose.joints, 0, sizeof(FxsMD5Joint)*numJoints);
-
-			/* alloc and init the current pose */
-            (*mesh)->currentPose.joints = (FxsMD5Joint*)malloc(sizeof(FxsMD5Joint)*numJoints);
-            (*mesh)->currentPose.numJoints = numJoints;
+            /* find the number of meshes */
+            case KEYWORD_NUM_MESHES:
             
-            /* in case allocation fails */
-            if (!(*mesh)->currentPose.joints)
-            {
-                success = 0;
+                if (!FxsMD5ParserReadInt(&parser, &numMeshes))
+                {
+                    break;
+                }
+                
+                (*mesh)->meshes = (FxsMD5SubMesh*)malloc(sizeof(FxsMD5SubMesh)*numMeshes);
+                (*mesh)->numSubMeshes = numMeshes;
+                
+                /* in case allocation fails */
+                if (!(*mesh)->meshes)
+                {
+                    success = 0;
+                    break;
+                }
+
+                FXS_MD5_STATS_ALLOC(stats, sizeof(FxsMD5SubMesh)*numMeshes);
+                
+                /* default init all sub-meshes to zero*/
+                memset((*mesh)->meshes, 0, sizeof(FxsMD5SubMesh)*numMeshes);
+                
                 break;
-            }
             
-            /* default init the joints of the current pose to zero*/
-            memset((*mesh)->currentPose.joints, 0, sizeof(FxsMD5Joint)*numJoints);
-        }
-        
-        /* find the number of meshes */
-        if (strstr(pline, "numMeshes") == pline)
-        {
-            sscanf(pline, "numMeshes %d", &numMeshes);
-            (*mesh)->meshes = (FxsMD5SubMesh*)malloc(sizeof(FxsMD5SubMesh)*numMeshes);
-            (*mesh)->numSubMeshes = numMeshes;
+            /* load all joints */
+            case KEYWORD_JOINTS:
             
-            /* in case allocation fails */
-            if (!(*mesh)->meshes)
-            {
-                success = 0;
+                if (!FxsMD5ParserExpect(&parser, '{'))
+                {
+                    break;
+                }
+                
+                start = FXS_MD5_STATS_TIME(stats);
+
+                if (!loadJoints(*mesh, &parser))
+                {
+                    success = 0;
+                    break;
+                }
+
+                FXS_MD5_STATS_SECTION(stats, FXS_MD5_SECTION_JOINTS, start);
+
+                /* copy the bind pos data to the current pos */
+                memcpy(
+                    (*mesh)->currentPose.joints, 
+                    (*mesh)->bindPose.joints, 
+                    sizeof(FxsMD5Joint)*(*mesh)->bindPose.numJoints
+                );
+                
                 break;
-            }
             
-            /* default init all sub-meshes to zero*/
-            memset((*mesh)->meshes, 0, sizeof(FxsMD5SubMesh)*numMeshes);
-        }
-        
-        /* load all joints */
-        if (strstr(pline, "joints {") == pline)
-        {
-            if (!loadJoints(*mesh, file))
-            {
-                success = 0;
-                break;
-            }
+            /* load all sub meshes */
+            case KEYWORD_MESH:
+            
+                if (!FxsMD5ParserExpect(&parser, '{'))
+                {
+                    break;
+                }
+                
+                if (loadedMeshes >= numMeshes)
+                {
+                    ERR_MSG("Too many sub-meshes found");
+                    success = 0;
+                    break;
+                }
+                
+                start = FXS_MD5_STATS_TIME(stats);
 
-			/* copy the bind pos data to the current pos */
-			memcpy(
-				(*mesh)->currentPose.joints, 
-				(*mesh)->bindPose.joints, 
-				sizeof(FxsMD5Joint)*(*mesh)->bindPose.numJoints
-			);
-        }
-        
-        /* load all sub meshes */
-        if (strstr(pline, "mesh {") == pline)
-        {
-            if (!loadSubMeshes(&(*mesh)->meshes[loadedMeshes], file))
-            {
-                success = 0;
-                break;
-            }
-            else
-            {
+                if (!loadSubMeshes(&(*mesh)->meshes[loadedMeshes], &parser, stats))
+                {
+                    success = 0;
+                    break;
+                }
+                
+                FXS_MD5_STATS_SECTION(stats, FXS_MD5_SECTION_MESH, start);
                 loadedMeshes++;
-            }
+                
+                break;
+                
+            default:
+                break;
         }
         
-        /* quit if eof */
-        if (isEOF)
+        if (!success)
         {
             break;
         }
 	}
     
     /* check if all meshes were loaded */
-    if (loadedMeshes != numMeshes)
+    if (success && loadedMeshes != numMeshes)
     {
         ERR_MSG("Failed to load all sub-meshes");
         success = 0;
     }
 
+    if (success && !FxsMD5MeshComputeInverseBindPose(*mesh))
+    {
+        success = 0;
+    }
+
+    if (success && options && options->weldVertices
+    && !FxsMD5MeshWeldVertices(*mesh, NULL))
+    {
+        success = 0;
+    }
+
+    if (success && options && options->optimizeVertexCache
+    && !FxsMD5MeshOptimizeVertexCache(*mesh, options->cacheStats))
+    {
+        success = 0;
+    }
+
+    if (success && options && options->maxInfluences
+    && !FxsMD5MeshCompactInfluences(
+        *mesh,
+        options->maxInfluences,
+        options->weightThreshold)
+    )
+    {
+        success = 0;
+    }
+
 	/* clean up */
-	fclose(file);
+	FxsMD5FileClose(&file);
+    FXS_MD5_STATS_ADD(stats, numLines, parser.numLines);
 
     if (!success)
     {
@@ -611,12 +710,22 @@ int FxsMD5MeshCreateWithFile(FxsMD5Mesh** mesh, const char* filename)
 void FxsMD5MeshDestroy(FxsMD5Mesh** mesh)
 {
     int i = 0;
+    FxsMD5File file;
     
     if (!*mesh)
     {
         return;
     }
     
+    /* a mesh loaded from a binary file lives in the file */
+    if ((*mesh)->storage)
+    {
+        memcpy(&file, (*mesh)->storage, sizeof(FxsMD5File));
+        FxsMD5FileClose(&file);
+        *mesh = NULL;
+        return;
+    }
+    
     /* release submeshes */
     for (i = 0; i < (*mesh)->numSubMeshes; i++)
     {
@@ -625,6 +734,12 @@ void FxsMD5MeshDestroy(FxsMD5Mesh** mesh)
             FxsMD5Face* faces = (*mesh)->meshes[i].faces;
             FxsMD5Vertex* vertices = (*mesh)->meshes[i].vertices;
             FxsMD5Weight* weights = (*mesh)->meshes[i].weights;
+            char* shader = (*mesh)->meshes[i].shader;
+
+            if (shader)
+            {
+                free(shader);
+            }
 
             if (faces)
             {
@@ -640,11 +755,31 @@ void FxsMD5MeshDestroy(FxsMD5Mesh** mesh)
             {
                 free(weights);
             }
+
+            free((*mesh)->meshes[i].influences.joints);
+            free((*mesh)->meshes[i].influences.weights);
+            free((*mesh)->meshes[i].influences.positions);
         }
     }
     
+    if ((*mesh)->meshes)
+    {
+        free((*mesh)->meshes);
+    }
+
+    free((*mesh)->inverseBindPose);
+    
+    /* the current pose shares the joint names with the bind pose */
     if ((*mesh)->bindPose.joints)
     {
+        for (i = 0; i < (*mesh)->bindPose.numJoints; i++)
+        {
+            if ((*mesh)->bindPose.joints[i].name)
+            {
+                free((*mesh)->bindPose.joints[i].name);
+            }
+        }
+        
         free((*mesh)->bindPose.joints);
     }
 
@@ -671,14 +806,11 @@ int FxsMD5MeshUpdatePoseWithAnimationFrame(
 )
 {
 	FxsMD5AnimationJoint* animJoint = NULL;
-	FxsMD5AnimationFrame* animFrame = NULL;
+	float stackComponents[7*DECODE_STACK_JOINTS];
+	float* buffer = stackComponents;
+	float* components[7];   /* the 6 decoded components, then w */
 	FxsVector3 position;
-	FxsVector3 orientationAxis;
-    float orientationAxisMagnitude = 0.0;
-	FxsMatrix4 orientationMatrix;
-	FxsMatrix4 translationMatrix;
-	FxsMatrix4 transformationMatrix;
-	int i = 0, j = 0;
+	int i = 0;
 
 	if (animation->numJoints != mesh->currentPose.numJoints) 
 	{
@@ -686,130 +818,438 @@ int FxsMD5MeshUpdatePoseWithAnimationFrame(
 		return 0;
 	}
 
-	animFrame = &animation->frames[frame];
-
+	/* check the order first, so a failure leaves the pose untouched */
 	for (i = 0; i < animation->numJoints; i++)
 	{
-        j = 0;
-		animJoint = &animation->joints[i];
-		position = animation->baseFrame.positions[i];
-		orientationAxis.x = animation->baseFrame.orientations[i].x;
-		orientationAxis.y = animation->baseFrame.orientations[i].y;
-		orientationAxis.z = animation->baseFrame.orientations[i].z;
-
-		if (animJoint->flags & FXS_MD5_ANIM_XPOS) 
-		{
-		    position.x = animFrame->data[animJoint->frameIndex + j];
-			j++;
-		}		
-		
-		if (animJoint->flags & FXS_MD5_ANIM_YPOS) 
+		if (animation->joints[i].parent >= i)
 		{
-		    position.y = animFrame->data[animJoint->frameIndex + j];
-			j++;
-		}		
-	
-		if (animJoint->flags & FXS_MD5_ANIM_ZPOS) 
-		{
-		    position.z = animFrame->data[animJoint->frameIndex + j];
-			j++;
-		}		
-
-		if (animJoint->flags & FXS_MD5_ANIM_XQUAT)
-		{
-		    orientationAxis.x = animFrame->data[animJoint->frameIndex + j];
-			j++;
+			ERR_MSG("Joint comes before its parent");
+			return 0;
 		}
+	}
+
+	/* large skeletons decode into a scratch buffer of the animation */
+	if (animation->numJoints > DECODE_STACK_JOINTS)
+	{
+		buffer = (float*)FxsMD5AnimationAcquireScratch(
+			animation,
+			sizeof(float)*7*animation->numJoints
+		);
 
-		if (animJoint->flags & FXS_MD5_ANIM_YQUAT)
+		if (!buffer)
 		{
-		    orientationAxis.y = animFrame->data[animJoint->frameIndex + j];
-			j++;
+			return 0;
 		}
+	}
+
+	for (i = 0; i < 7; i++)
+	{
+		components[i] = buffer + i*animation->numJoints;
+	}
 
-		if (animJoint->flags & FXS_MD5_ANIM_ZQUAT)
+	if (!FxsMD5AnimationDecodeFrame(animation, frame, components))
+	{
+		/* the frame does not exist or could not be decoded */
+		if (buffer != stackComponents)
 		{
-		    orientationAxis.z = animFrame->data[animJoint->frameIndex + j];
-			j++;
+			FxsMD5AnimationReleaseScratch(animation, buffer);
 		}
 
+		return 0;
+	}
+
+	FxsMD5AnimationCompleteOrientations(components + 3, animation->numJoints);
+
+	for (i = 0; i < animation->numJoints; i++)
+	{
+		animJoint = &animation->joints[i];
+		position.x = components[0][i];
+		position.y = components[1][i];
+		position.z = components[2][i];
+
 		/* update the joint for the current skeleton */
 		mesh->currentPose.joints[i].parent = animJoint->parent;
 		mesh->currentPose.joints[i].position = position;
 
-        FxsVector3Length(&orientationAxisMagnitude, &orientationAxis);
+		FxsQuaternionMake(
+			&mesh->currentPose.joints[i].orientation,
+			components[3][i],
+			components[4][i],
+			components[5][i],
+			components[6][i]
+		);
+
+		/* - converstation matrix is already part of the parents transform
+		**   and hence does not need to be multiplied anymore 
+		** - parents transform was computed before this joint, the order
+		**   is checked above
+		*/
+		composeTransform(
+			&mesh->currentPose.joints[i].transform,
+			animJoint->parent < 0 ? &conversation
+				: &mesh->currentPose.joints[animJoint->parent].transform,
+			&position,
+			&mesh->currentPose.joints[i].orientation
+		);
+	}
+
+	if (buffer != stackComponents)
+	{
+		FxsMD5AnimationReleaseScratch(animation, buffer);
+	}
 
-        //
-        // TODO is the following correct??
-        //
-    
-        if (orientationAxisMagnitude >= 1.0)
+	FXS_MD5_STATS_ADD(mesh->stats, numPoseUpdates, 1);
+
+	return 1;
+}
+
+/*
+** Builds the joint transforms from the local joints, parents come before
+** their children, like in FxsMD5MeshUpdatePoseWithAnimationFrame.
+*/
+int FxsMD5MeshUpdatePoseWithLocalPose(
+    FxsMD5Mesh* mesh,
+    const FxsMD5LocalPose* pose
+)
+{
+    FxsMD5Joint* joint;
+    int i;
+
+    if (pose->numJoints != mesh->currentPose.numJoints)
+    {
+        /* pose does not apply to this mesh ... */
+        return 0;
+    }
+
+    /* check the order first, so a failure leaves the pose untouched */
+    for (i = 0; i < mesh->bindPose.numJoints; i++)
+    {
+        if (mesh->bindPose.joints[i].parent >= i)
+        {
+            ERR_MSG("Joint comes before its parent");
+            return 0;
+        }
+    }
+
+    for (i = 0; i < mesh->currentPose.numJoints; i++)
+    {
+        joint = &mesh->currentPose.joints[i];
+        joint->parent = mesh->bindPose.joints[i].parent;
+        joint->position.x = pose->positions[0][i];
+        joint->position.y = pose->positions[1][i];
+        joint->position.z = pose->positions[2][i];
+
+        FxsQuaternionMake(
+            &joint->orientation,
+            pose->orientations[0][i],
+            pose->orientations[1][i],
+            pose->orientations[2][i],
+            pose->orientations[3][i]
+        );
+
+        /* root joints get the conversation matrix, children inherit it */
+        composeTransform(
+            &joint->transform,
+            joint->parent < 0 ? &conversation
+                : &mesh->currentPose.joints[joint->parent].transform,
+            &joint->position,
+            &joint->orientation
+        );
+    }
+
+    FXS_MD5_STATS_ADD(mesh->stats, numPoseUpdates, 1);
+
+    return 1;
+}
+
+int FxsMD5MeshUpdatePoseWithAnimationTime(
+    FxsMD5Mesh* mesh,
+    FxsMD5Sampler* sampler,
+    float seconds
+)
+{
+    if (sampler->animation->numJoints != mesh->currentPose.numJoints
+    || !FxsMD5SamplerSample(sampler, seconds))
+    {
+        return 0;
+    }
+
+    return FxsMD5MeshUpdatePoseWithLocalPose(mesh, sampler->pose);
+}
+
+/*
+** # of poses that are evaluated together in a batch.
+*/
+#define POSE_LANES 8
+
+/*
+** A 4x4 affine transform for each lane of a batch. Only the upper 3 rows
+** are stored, element (row, column) is at [column*3 + row].
+*/
+typedef float PoseLanes[12][POSE_LANES];
+
+/*
+** Evaluates the joints of count <= POSE_LANES poses, lane l is posed with
+** frameData[l]. The joint loop is outside the lane loops, so the flags and
+** base frame of a joint are read once for all lanes. world holds a transform
+** per joint, the extra transform at numJoints is the conversation matrix.
+** Parents must come before their children.
+*/
+static void updatePoses(
+    FxsMD5Skeleton* const* poses,
+    const float* const* frameData,
+    unsigned int count,
+    const FxsMD5Animation* animation,
+    PoseLanes* world
+)
+{
+    float p[3][POSE_LANES];     /* position */
+    float q[4][POSE_LANES];     /* orientation */
+    float* orientations[4] = { q[0], q[1], q[2], q[3] };
+    float r[9][POSE_LANES];     /* rotation, column major */
+    const FxsMD5AnimationJoint* animJoint;
+    const float* parent;
+    float* local;
+    float* transform;
+    unsigned int i, l, c, e, j;
+
+    for (i = 0; i < animation->numJoints; i++)
+    {
+        animJoint = &animation->joints[i];
+
+        for (l = 0; l < count; l++)
+        {
+            p[0][l] = animation->baseFrame.positions[i].x;
+            p[1][l] = animation->baseFrame.positions[i].y;
+            p[2][l] = animation->baseFrame.positions[i].z;
+            q[0][l] = animation->baseFrame.orientations[i].x;
+            q[1][l] = animation->baseFrame.orientations[i].y;
+            q[2][l] = animation->baseFrame.orientations[i].z;
+        }
+
+        /* the flags are in component order x, y, z pos then x, y, z quat */
+        for (c = 0, j = 0; c < 6; c++)
+        {
+            float* component = c < 3 ? p[c] : q[c - 3];
+
+            if (!(animJoint->flags & (1 << c)))
+            {
+                continue;
+            }
+
+            for (l = 0; l < count; l++)
+            {
+                component[l] = frameData[l][animJoint->frameIndex + j];
+            }
+
+            j++;
+        }
+
+        /* the same w as FxsMD5MeshUpdatePoseWithAnimationFrame */
+        FxsMD5AnimationCompleteOrientations(orientations, count);
+
+        for (l = 0; l < count; l++)
+        {
+            float x = q[0][l], y = q[1][l], z = q[2][l], w = q[3][l];
+
+            r[0][l] = 1.0f - 2.0f*(y*y + z*z);
+            r[1][l] = 2.0f*(x*y + w*z);
+            r[2][l] = 2.0f*(x*z - w*y);
+            r[3][l] = 2.0f*(x*y - w*z);
+            r[4][l] = 1.0f - 2.0f*(x*x + z*z);
+            r[5][l] = 2.0f*(y*z + w*x);
+            r[6][l] = 2.0f*(x*z + w*y);
+            r[7][l] = 2.0f*(y*z - w*x);
+            r[8][l] = 1.0f - 2.0f*(x*x + y*y);
+        }
+
+        /* world = parent*translation*rotation */
+        parent = &world[animJoint->parent < 0 ? animation->numJoints : animJoint->parent][0][0];
+        local = &world[i][0][0];
+
+        for (c = 0; c < 4; c++)
+        {
+            for (e = 0; e < 3; e++)
+            {
+                const float* p0 = parent + (0*3 + e)*POSE_LANES;
+                const float* p1 = parent + (1*3 + e)*POSE_LANES;
+                const float* p2 = parent + (2*3 + e)*POSE_LANES;
+                const float* p3 = parent + (3*3 + e)*POSE_LANES;
+                const float* l0 = c < 3 ? r[c*3 + 0] : p[0];
+                const float* l1 = c < 3 ? r[c*3 + 1] : p[1];
+                const float* l2 = c < 3 ? r[c*3 + 2] : p[2];
+                float* out = local + (c*3 + e)*POSE_LANES;
+
+                if (c < 3)
+                {
+                    for (l = 0; l < count; l++)
+                    {
+                        out[l] = p0[l]*l0[l] + p1[l]*l1[l] + p2[l]*l2[l];
+                    }
+                }
+                else
+                {
+                    for (l = 0; l < count; l++)
+                    {
+                        out[l] = p0[l]*l0[l] + p1[l]*l1[l] + p2[l]*l2[l] + p3[l];
+                    }
+                }
+            }
+        }
+
+        /* copy the joint to the poses */
+        for (l = 0; l < count; l++)
+        {
+            FxsMD5Joint* joint = &poses[l]->joints[i];
+
+            joint->parent = animJoint->parent;
+            joint->position.x = p[0][l];
+            joint->position.y = p[1][l];
+            joint->position.z = p[2][l];
+            joint->orientation.x = q[0][l];
+            joint->orientation.y = q[1][l];
+            joint->orientation.z = q[2][l];
+            joint->orientation.w = q[3][l];
+
+            transform = (float*)&joint->transform;
+
+            for (c = 0; c < 4; c++)
+            {
+                transform[c*4 + 0] = world[i][c*3 + 0][l];
+                transform[c*4 + 1] = world[i][c*3 + 1][l];
+                transform[c*4 + 2] = world[i][c*3 + 2][l];
+                transform[c*4 + 3] = c < 3 ? 0.0f : 1.0f;
+            }
+        }
+    }
+}
+
+/*
+** Poses the meshes in batches of POSE_LANES. The frames of a batch stay
+** acquired while the batch is evaluated.
+*/
+int FxsMD5MeshUpdatePosesWithAnimationFrames(
+    FxsMD5Mesh* const* meshes,
+    const unsigned int* frames,
+    unsigned int count,
+    const FxsMD5Animation* animation
+)
+{
+    FxsMD5Skeleton* poses[POSE_LANES];
+    const float* frameData[POSE_LANES];
+    const float* conversationData = (const float*)&conversation;
+    PoseLanes* world;
+    float* scratch = NULL;      /* frames that could not be acquired */
+    unsigned char isAcquired[POSE_LANES];
+    size_t frameSize = animation->numAnimatedComponents;
+    unsigned int first, n, l, c, e;
+    int success = 1;
+
+    for (l = 0; l < count; l++)
+    {
+        if (animation->numJoints != meshes[l]->currentPose.numJoints)
         {
-            /* if the magnitude of the orientation axis is greater than one
-            ** only the orientation axis changes not and the angle of rotation
-            ** is zero.
+            /* animation does not apply to this mesh ... */
+            return 0;
+        }
+    }
+
+    /* check the order first, so a failure leaves the poses untouched */
+    for (l = 0; l < animation->numJoints; l++)
+    {
+        if (animation->joints[l].parent >= (int)l)
+        {
+            ERR_MSG("Joint comes before its parent");
+            return 0;
+        }
+    }
+
+    world = (PoseLanes*)FxsMD5AnimationAcquireScratch(
+            animation,
+            sizeof(PoseLanes)*(animation->numJoints + 1)
+        );
+
+    if (!world)
+    {
+        return 0;
+    }
+
+    /* the parent of the root joints */
+    for (c = 0; c < 4; c++)
+    {
+        for (e = 0; e < 3; e++)
+        {
+            for (l = 0; l < POSE_LANES; l++)
+            {
+                world[animation->numJoints][c*3 + e][l] = conversationData[c*4 + e];
+            }
+        }
+    }
+
+    for (first = 0; success && first < count; first += POSE_LANES)
+    {
+        n = count - first < POSE_LANES ? count - first : POSE_LANES;
+
+        for (l = 0; l < n; l++)
+        {
+            poses[l] = &meshes[first + l]->currentPose;
+            frameData[l] = FxsMD5AnimationAcquireFrame(animation, frames[first + l]);
+            isAcquired[l] = frameData[l] != NULL;
+
+            if (frameData[l])
+            {
+                continue;
+            }
+
+            /* the frame cache of a lazy animation may be too small for a
+            ** batch, then the frame is copied instead
             */
-            FxsVector3Normalize(&orientationAxis);
-
-            FxsQuaternionMake(
-                &mesh->currentPose.joints[i].orientation,
-                orientationAxis.x,
-                orientationAxis.y,
-                orientationAxis.z,
-                0.0
-            );
+            if (!scratch)
+            {
+                scratch = (float*)FxsMD5AnimationAcquireScratch(
+                        animation,
+                        sizeof(float)*frameSize*POSE_LANES
+                    );
+
+                if (!scratch)
+                {
+                    success = 0;
+                    break;
+                }
+            }
+
+            if (!FxsMD5AnimationCopyFrame(animation, frames[first + l], scratch + l*frameSize))
+            {
+                /* the frame does not exist or could not be decoded */
+                success = 0;
+                break;
+            }
+
+            frameData[l] = scratch + l*frameSize;
         }
-        else
+
+        if (success)
         {
-            FxsQuaternionMakeWithAxis(
-                &mesh->currentPose.joints[i].orientation,
-                &orientationAxis
-            );
+            updatePoses(poses, frameData, n, animation, world);
         }
 
-		FxsMatrix4MakeRotationWithQuaternion(
-			&orientationMatrix, 
-			&mesh->currentPose.joints[i].orientation
-		);
+        for (e = 0; success && e < n; e++)
+        {
+            FXS_MD5_STATS_ADD(meshes[first + e]->stats, numPoseUpdates, 1);
+        }
 
-		FxsMatrix4MakeTranslation(
-			&translationMatrix, 
-			position.x, 
-			position.y, 
-			position.z
-		); 
-
-		FxsMatrix4Multiply(
-			&transformationMatrix, 
-			&translationMatrix, 
-			&orientationMatrix
-		); 
-		
-		if (animJoint->parent < 0) 
-		{
-            mesh->currentPose.joints[i].transform = transformationMatrix;
-        
-			FxsMatrix4Multiply(
-				&mesh->currentPose.joints[i].transform,
-				&conversation,
-				&transformationMatrix
-			);
-		}
-		else
-		{
-			/* - converstation matrix is already part of the parents transform
-			**   and hence does not need to be multiplied anymore 
-			** - parents transform is assumed to be already computed before
-			**   this joint ...
-			*/
-			FxsMatrix4Multiply(
-				&mesh->currentPose.joints[i].transform,
-				&mesh->currentPose.joints[animJoint->parent].transform,
-				&transformationMatrix
-			);
-		}
+        /* release the frames that were acquired */
+        while (l-- > 0)
+        {
+            if (isAcquired[l])
+            {
+                FxsMD5AnimationReleaseFrame(animation, frames[first + l]);
+            }
+        }
+    }
 
-	}
-	
-	return 1;
+    FxsMD5AnimationReleaseScratch(animation, scratch);
+    FxsMD5AnimationReleaseScratch(animation, world);
+
+    return success;
 }
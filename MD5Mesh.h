@@ -6,11 +6,14 @@ extern "C"
 {
 #endif
 
+#include <stddef.h>
 #include <Fxs/Math/Vector2.h>
 #include <Fxs/Math/Vector3.h>
 #include <Fxs/Math/Quaternion.h>
 #include <Fxs/Math/Matrix4.h>
 #include "MD5Animation.h"
+#include "MD5Sampler.h"
+#include "MD5Stats.h"
 
 /*
 ** Submeshes contain faces that index vertices in the submesh
@@ -61,6 +64,29 @@ typedef struct
 }
 FxsMD5Skeleton;
 
+/*
+** Compacted weights of the vertices of a submesh, for skinning with a
+** skinning palette. Every vertex has numInfluences influences, influence j
+** of vertex i is at [i*numInfluences + j], unused influences have a weight
+** of 0.
+*/
+typedef struct
+{
+    unsigned int numInfluences; /* influences per vertex, 0 if the weights
+                                ** were not compacted
+                                */
+    unsigned int indexSize;     /* bytes per joint index, 1 or 2 */
+    void* joints;               /* joint indices, unsigned 8 or 16 bit */
+    unsigned short* weights;    /* unorm16 weights, those of a vertex add up
+                                ** to 65535
+                                */
+    float* positions;           /* bind pose position of each vertex, x, y, z */
+    float maxError;             /* largest sum of the absolute weight changes
+                                ** of a vertex
+                                */
+}
+FxsMD5Influences;
+
 typedef struct
 {
 	int numVertices;
@@ -73,6 +99,8 @@ typedef struct
 	FxsMD5Face* faces;
 	FxsMD5Weight* weights;
 	FxsMD5Vertex* vertices;
+
+    FxsMD5Influences influences;
 }
 FxsMD5SubMesh;
 
@@ -85,14 +113,92 @@ typedef struct
     FxsMD5Skeleton bindPose;
     FxsMD5Skeleton currentPose;
     FxsMD5SubMesh* meshes;
+    FxsMatrix4* inverseBindPose; /* inverse of the bind pose transform of
+                                 ** each joint
+                                 */
+
+    void* storage;              /* binary file the mesh lives in, NULL if the
+                                ** mesh was loaded from a text file.
+                                */
+    FxsMD5Stats* stats;         /* counts the pose updates and the blocks
+                                ** of the passes over the mesh, NULL if they
+                                ** are not counted, see MD5Stats.h
+                                */
 }
 FxsMD5Mesh;
 
+/*
+** Vertex cache efficiency of the faces of a mesh, as average cache miss
+** ratio (ACMR): transformed vertices per face with a FIFO cache of
+** FXS_MD5_VERTEX_CACHE_SIZE vertices. 3 is the worst, about 0.5 the best
+** for large regular meshes.
+*/
+#define FXS_MD5_VERTEX_CACHE_SIZE 16
+
+typedef struct
+{
+    unsigned int numFaces;
+    float acmrBefore;
+    float acmrAfter;
+}
+FxsMD5VertexCacheStats;
+
+/*
+** Options for loading a mesh from a text file.
+*/
+typedef struct
+{
+    unsigned int maxInfluences; /* 4 or 8 compacts the weights of the
+                                ** submeshes to this many influences per
+                                ** vertex, 0 does not compact them. See
+                                ** FxsMD5MeshCompactInfluences.
+                                */
+    float weightThreshold;      /* smaller weights are dropped when the
+                                ** weights are compacted
+                                */
+    int weldVertices;           /* 1 merges equal vertices, see
+                                ** FxsMD5MeshWeldVertices
+                                */
+    int optimizeVertexCache;    /* 1 reorders the faces and vertices, see
+                                ** FxsMD5MeshOptimizeVertexCache
+                                */
+    FxsMD5VertexCacheStats* cacheStats; /* receives the ACMR before and
+                                        ** after the reordering, may be
+                                        ** NULL
+                                        */
+    FxsMD5Stats* stats;         /* counts the loading and later the pose
+                                ** updates of the mesh, may be NULL
+                                */
+}
+FxsMD5MeshLoadOptions;
+
 /*
 ** Loads a MD5 mesh from a file. Returns 0 if it fails to load.
 */ 
 int FxsMD5MeshCreateWithFile(FxsMD5Mesh** mesh, const char* filename);
 
+/*
+** Loads a MD5 mesh from a file, options may be NULL for the defaults.
+** Returns 0 if it fails to load.
+*/ 
+int FxsMD5MeshCreateWithFileAndOptions(
+    FxsMD5Mesh** mesh,
+    const char* filename,
+    const FxsMD5MeshLoadOptions* options
+);
+
+/*
+** Loads a MD5 mesh from a binary file written by FxsMD5MeshWriteBinaryFile.
+** The file is mapped and the mesh uses its arrays in place. Returns 0 if it
+** fails to load.
+*/ 
+int FxsMD5MeshCreateWithBinaryFile(FxsMD5Mesh** mesh, const char* filename);
+
+/*
+** Writes a mesh to a binary file. Returns 0 if it fails.
+*/ 
+int FxsMD5MeshWriteBinaryFile(const FxsMD5Mesh* mesh, const char* filename);
+
 /*
 ** Releases the MD5 mesh.
 */ 
@@ -100,7 +206,8 @@ void FxsMD5MeshDestroy(FxsMD5Mesh** mesh);
 
 /*
 ** Updates the current pose of a mesh with the frame of an animation
-** Returns 0 if it fails, otherwise 1.
+** Returns 0 if it fails, otherwise 1. The pose is not changed if a joint
+** of the animation comes before its parent.
 */ 
 int FxsMD5MeshUpdatePoseWithAnimationFrame(
 	FxsMD5Mesh* mesh,
@@ -108,6 +215,149 @@ int FxsMD5MeshUpdatePoseWithAnimationFrame(
 	unsigned int frame
 );
 
+/*
+** Updates the current pose of a mesh with a local pose, e.g. the pose of a
+** sampler. Returns 0 if the pose does not have the joints of the mesh or
+** a joint comes before its parent, the current pose is unchanged then.
+*/
+int FxsMD5MeshUpdatePoseWithLocalPose(
+    FxsMD5Mesh* mesh,
+    const FxsMD5LocalPose* pose
+);
+
+/*
+** Samples the animation of the sampler at a time in seconds and updates the
+** current pose of the mesh with the result. Returns 0 if it fails.
+*/
+int FxsMD5MeshUpdatePoseWithAnimationTime(
+    FxsMD5Mesh* mesh,
+    FxsMD5Sampler* sampler,
+    float seconds
+);
+
+/*
+** Updates the current poses of count meshes, meshes[i] is posed with frame
+** frames[i] of the animation. Gives the same poses as calling
+** FxsMD5MeshUpdatePoseWithAnimationFrame for each mesh, but the joint
+** hierarchy is walked once for up to 8 meshes, which are evaluated side by
+** side. The frames of a batch are held in the frame cache of a lazy
+** animation while it is evaluated, frames that do not fit because the
+** cache is full (e.g. it is small or other threads hold its frames) are
+** decoded into a scratch buffer, see FxsMD5AnimationCopyFrame. So it works
+** with any cache size. Returns 0 if it fails, no pose is changed if a
+** joint comes before its parent, but the poses of some meshes may have
+** been updated if a frame can not be decoded.
+*/
+int FxsMD5MeshUpdatePosesWithAnimationFrames(
+    FxsMD5Mesh* const* meshes,
+    const unsigned int* frames,
+    unsigned int count,
+    const FxsMD5Animation* animation
+);
+
+/*
+** Layouts of a skinning palette.
+*/
+#define FXS_MD5_PALETTE_4X4 0   /* 16 floats per joint, column major like
+                                ** FxsMatrix4
+                                */
+#define FXS_MD5_PALETTE_3X4 1   /* 12 floats per joint, the upper 3 rows of
+                                ** the transform, row major
+                                */
+
+/*
+** Computes mesh->inverseBindPose from the transforms of the bind pose. The
+** loaders call it, call it again after changing the bind pose. Returns 0
+** if a transform can not be inverted.
+*/
+int FxsMD5MeshComputeInverseBindPose(FxsMD5Mesh* mesh);
+
+/*
+** Writes the skinning matrix currentPose*inverse(bindPose) of each joint
+** to palette, in the layout format (FXS_MD5_PALETTE_*). The matrices are
+** packed, joint i starts at palette + i*16 or palette + i*12 floats. A
+** palette aligned to FXS_MD5_ALIGNMENT (see FxsMD5AlignedAlloc) can be
+** uploaded as it is. Returns 0 if format is unknown.
+*/
+int FxsMD5MeshSkinningPalette(
+    const FxsMD5Mesh* mesh,
+    float* palette,
+    int format
+);
+
+/*
+** Writes the bind pose position of each vertex of a submesh, the positions
+** that the skinning palette transforms. Positions are x, y, z floats,
+** stride bytes apart (0 for packed positions). Returns 0 if a weight of
+** the submesh is invalid.
+*/
+int FxsMD5MeshBindPositions(
+    const FxsMD5Mesh* mesh,
+    unsigned int subMesh,
+    float* positions,
+    size_t stride
+);
+
+/*
+** Computes the bind pose normal and tangent of each vertex of a submesh
+** from its faces and texture coordinates, in the space of the bind
+** positions. Normals are x, y, z, tangents x, y, z, w where w (1 or -1) is
+** the handedness of the tangent frame: bitangent = w*cross(normal,
+** tangent). Either array may be NULL, entries are stride bytes apart (0
+** for packed normals and tangents). Returns 0 if a weight or a face of the
+** submesh is invalid.
+*/
+int FxsMD5MeshBindNormals(
+    const FxsMD5Mesh* mesh,
+    unsigned int subMesh,
+    float* normals,
+    float* tangents,
+    size_t stride
+);
+
+/*
+** Compacts the weights of each submesh to maxInfluences (4 or 8)
+** influences per vertex in submesh->influences. Weights of the same joint
+** are merged, weights below weightThreshold are dropped (the largest
+** weight of a vertex is always kept), the strongest maxInfluences weights
+** are kept, renormalized and quantized to unorm16. The weights themselves
+** stay as they are. Returns 0 if it fails.
+*/
+int FxsMD5MeshCompactInfluences(
+    FxsMD5Mesh* mesh,
+    unsigned int maxInfluences,
+    float weightThreshold
+);
+
+/*
+** Returns the ACMR of the faces of a submesh with a FIFO cache of
+** cacheSize vertices.
+*/
+float FxsMD5SubMeshACMR(const FxsMD5SubMesh* subMesh, unsigned int cacheSize);
+
+/*
+** Reorders the faces of each submesh for the post transform vertex cache
+** (Forsyth's linear speed algorithm), then the vertices by first use and
+** the weights by vertex, so skinning and vertex fetch read front to back.
+** Face and vertex ids are renumbered, compacted influences are reordered
+** with the vertices. stats may be NULL. Returns 0 if it fails, e.g. if a
+** face references an invalid vertex.
+*/
+int FxsMD5MeshOptimizeVertexCache(
+    FxsMD5Mesh* mesh,
+    FxsMD5VertexCacheStats* stats
+);
+
+/*
+** Merges the vertices of each submesh that have the same texture
+** coordinates and weights (joints, values and positions), the faces use
+** the first of them. Weights no vertex uses anymore are dropped, vertex and
+** weight ids are renumbered and compacted influences follow their
+** vertices. numWelded receives the # of vertices that were removed, it may
+** be NULL. Returns 0 if it fails.
+*/
+int FxsMD5MeshWeldVertices(FxsMD5Mesh* mesh, unsigned int* numWelded);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,452 @@
+/*
+** Skinning palettes: the transforms that take bind pose positions to the
+** current pose, as renderers skin on the GPU.
+*/
+
+#include "MD5Mesh.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** Element (row, column) of a column major 4x4 matrix.
+*/
+#define AT(m, row, column) ((m)[(column)*4 + (row)])
+
+/*
+** Inverts an affine transform. Returns 0 if it is singular.
+*/
+static int invertAffine(float* result, const float* m)
+{
+    float det;
+    float inv;
+    int r;
+
+    /* cofactors of the upper 3x3 */
+    AT(result, 0, 0) = AT(m, 1, 1)*AT(m, 2, 2) - AT(m, 1, 2)*AT(m, 2, 1);
+    AT(result, 0, 1) = AT(m, 0, 2)*AT(m, 2, 1) - AT(m, 0, 1)*AT(m, 2, 2);
+    AT(result, 0, 2) = AT(m, 0, 1)*AT(m, 1, 2) - AT(m, 0, 2)*AT(m, 1, 1);
+    AT(result, 1, 0) = AT(m, 1, 2)*AT(m, 2, 0) - AT(m, 1, 0)*AT(m, 2, 2);
+    AT(result, 1, 1) = AT(m, 0, 0)*AT(m, 2, 2) - AT(m, 0, 2)*AT(m, 2, 0);
+    AT(result, 1, 2) = AT(m, 0, 2)*AT(m, 1, 0) - AT(m, 0, 0)*AT(m, 1, 2);
+    AT(result, 2, 0) = AT(m, 1, 0)*AT(m, 2, 1) - AT(m, 1, 1)*AT(m, 2, 0);
+    AT(result, 2, 1) = AT(m, 0, 1)*AT(m, 2, 0) - AT(m, 0, 0)*AT(m, 2, 1);
+    AT(result, 2, 2) = AT(m, 0, 0)*AT(m, 1, 1) - AT(m, 0, 1)*AT(m, 1, 0);
+
+    det = AT(m, 0, 0)*AT(result, 0, 0)
+        + AT(m, 0, 1)*AT(result, 1, 0)
+        + AT(m, 0, 2)*AT(result, 2, 0);
+
+    if (fabsf(det) < 1e-12f)
+    {
+        return 0;
+    }
+
+    inv = 1.0f/det;
+
+    for (r = 0; r < 3; r++)
+    {
+        AT(result, r, 0) *= inv;
+        AT(result, r, 1) *= inv;
+        AT(result, r, 2) *= inv;
+    }
+
+    /* translation is -inverse(upper 3x3)*t */
+    for (r = 0; r < 3; r++)
+    {
+        AT(result, r, 3) = -(AT(result, r, 0)*AT(m, 0, 3)
+            + AT(result, r, 1)*AT(m, 1, 3)
+            + AT(result, r, 2)*AT(m, 2, 3));
+    }
+
+    AT(result, 3, 0) = 0.0f;
+    AT(result, 3, 1) = 0.0f;
+    AT(result, 3, 2) = 0.0f;
+    AT(result, 3, 3) = 1.0f;
+
+    return 1;
+}
+
+int FxsMD5MeshComputeInverseBindPose(FxsMD5Mesh* mesh)
+{
+    FxsMatrix4* inverseBindPose = NULL;
+    int i;
+
+    if (mesh->storage)
+    {
+        ERR_MSG("Meshes loaded from binary files can not be changed");
+        return 0;
+    }
+
+    if (mesh->bindPose.numJoints > 0)
+    {
+        inverseBindPose = (FxsMatrix4*)malloc(
+                sizeof(FxsMatrix4)*mesh->bindPose.numJoints
+            );
+
+        if (!inverseBindPose)
+        {
+            ERR_MSG("malloc failed");
+            return 0;
+        }
+
+        FXS_MD5_STATS_ALLOC(mesh->stats, sizeof(FxsMatrix4)*mesh->bindPose.numJoints);
+    }
+
+    for (i = 0; i < mesh->bindPose.numJoints; i++)
+    {
+        if (!invertAffine(
+            (float*)&inverseBindPose[i],
+            (const float*)&mesh->bindPose.joints[i].transform)
+        )
+        {
+            ERR_MSG("Bind pose transform can not be inverted");
+            free(inverseBindPose);
+            return 0;
+        }
+    }
+
+    free(mesh->inverseBindPose);
+    mesh->inverseBindPose = inverseBindPose;
+
+    return 1;
+}
+
+int FxsMD5MeshSkinningPalette(
+    const FxsMD5Mesh* mesh,
+    float* palette,
+    int format
+)
+{
+    const float* a;
+    const float* b;
+    float m[12];                /* upper 3 rows, row major */
+    int i, r, c;
+
+    if (format != FXS_MD5_PALETTE_4X4 && format != FXS_MD5_PALETTE_3X4)
+    {
+        ERR_MSG("Unknown palette format");
+        return 0;
+    }
+
+    for (i = 0; i < mesh->currentPose.numJoints; i++)
+    {
+        a = (const float*)&mesh->currentPose.joints[i].transform;
+        b = (const float*)&mesh->inverseBindPose[i];
+
+        /* both are affine, the last rows are 0 0 0 1 */
+        for (r = 0; r < 3; r++)
+        {
+            for (c = 0; c < 4; c++)
+            {
+                m[r*4 + c] = AT(a, r, 0)*AT(b, 0, c)
+                    + AT(a, r, 1)*AT(b, 1, c)
+                    + AT(a, r, 2)*AT(b, 2, c);
+            }
+
+            m[r*4 + 3] += AT(a, r, 3);
+        }
+
+        if (format == FXS_MD5_PALETTE_3X4)
+        {
+            memcpy(palette + i*12, m, sizeof(m));
+            continue;
+        }
+
+        for (c = 0; c < 4; c++)
+        {
+            AT(palette + i*16, 0, c) = m[0*4 + c];
+            AT(palette + i*16, 1, c) = m[1*4 + c];
+            AT(palette + i*16, 2, c) = m[2*4 + c];
+            AT(palette + i*16, 3, c) = c < 3 ? 0.0f : 1.0f;
+        }
+    }
+
+    return 1;
+}
+
+int FxsMD5MeshBindPositions(
+    const FxsMD5Mesh* mesh,
+    unsigned int subMesh,
+    float* positions,
+    size_t stride
+)
+{
+    const FxsMD5SubMesh* sm;
+    const FxsMD5Vertex* vertex;
+    const FxsMD5Weight* weight;
+    const float* t;
+    float* p;
+    int i, j;
+
+    if (subMesh >= mesh->numSubMeshes)
+    {
+        return 0;
+    }
+
+    sm = &mesh->meshes[subMesh];
+
+    if (!stride)
+    {
+        stride = sizeof(float)*3;
+    }
+
+    for (i = 0; i < sm->numVertices; i++)
+    {
+        vertex = &sm->vertices[i];
+        p = (float*)((char*)positions + i*stride);
+        p[0] = p[1] = p[2] = 0.0f;
+
+        if (vertex->weightId < 0 || vertex->numWeights < 0
+        || vertex->weightId + vertex->numWeights > sm->numWeights)
+        {
+            ERR_MSG("Vertex references invalid weights");
+            return 0;
+        }
+
+        for (j = 0; j < vertex->numWeights; j++)
+        {
+            weight = &sm->weights[vertex->weightId + j];
+
+            if (weight->jointId < 0 || weight->jointId >= mesh->bindPose.numJoints)
+            {
+                ERR_MSG("Weight references invalid joint");
+                return 0;
+            }
+
+            t = (const float*)&mesh->bindPose.joints[weight->jointId].transform;
+
+            p[0] += weight->value*(AT(t, 0, 0)*weight->position.x
+                + AT(t, 0, 1)*weight->position.y
+                + AT(t, 0, 2)*weight->position.z + AT(t, 0, 3));
+            p[1] += weight->value*(AT(t, 1, 0)*weight->position.x
+                + AT(t, 1, 1)*weight->position.y
+                + AT(t, 1, 2)*weight->position.z + AT(t, 1, 3));
+            p[2] += weight->value*(AT(t, 2, 0)*weight->position.x
+                + AT(t, 2, 1)*weight->position.y
+                + AT(t, 2, 2)*weight->position.z + AT(t, 2, 3));
+        }
+    }
+
+    return 1;
+}
+
+/*
+** Sets t to a unit vector perpendicular to the unit vector n.
+*/
+static void perpendicular(float* t, const float* n)
+{
+    float length;
+
+    /* cross(n, axis) with the axis least parallel to n */
+    if (fabsf(n[0]) < 0.9f)
+    {
+        t[0] = 0.0f;
+        t[1] = n[2];
+        t[2] = -n[1];
+    }
+    else
+    {
+        t[0] = -n[2];
+        t[1] = 0.0f;
+        t[2] = n[0];
+    }
+
+    length = sqrtf(t[0]*t[0] + t[1]*t[1] + t[2]*t[2]);
+    t[0] /= length;
+    t[1] /= length;
+    t[2] /= length;
+}
+
+int FxsMD5MeshBindNormals(
+    const FxsMD5Mesh* mesh,
+    unsigned int subMesh,
+    float* normals,
+    float* tangents,
+    size_t stride
+)
+{
+    const FxsMD5SubMesh* sm;
+    float* positions;           /* x, y, z */
+    float* frames;              /* normal, tangent, bitangent sums */
+    float* n;
+    float* t;
+    float* b;
+    float length, dot, w;
+    int i, k;
+
+    if (subMesh >= mesh->numSubMeshes)
+    {
+        return 0;
+    }
+
+    sm = &mesh->meshes[subMesh];
+
+    if (!sm->numVertices)
+    {
+        if (sm->numFaces)
+        {
+            ERR_MSG("Face references invalid vertex");
+            return 0;
+        }
+
+        return 1;
+    }
+
+    positions = (float*)malloc(sizeof(float)*sm->numVertices*12);
+
+    if (!positions)
+    {
+        ERR_MSG("malloc failed");
+        return 0;
+    }
+
+    frames = positions + sm->numVertices*3;
+    memset(frames, 0, sizeof(float)*sm->numVertices*9);
+
+    if (!FxsMD5MeshBindPositions(mesh, subMesh, positions, 0))
+    {
+        free(positions);
+        return 0;
+    }
+
+    /* sum the area weighted face normals and the face tangents */
+    for (i = 0; i < sm->numFaces; i++)
+    {
+        const FxsMD5Face* face = &sm->faces[i];
+        const float* p0;
+        const float* p1;
+        const float* p2;
+        const FxsVector2* uv0;
+        const FxsVector2* uv1;
+        const FxsVector2* uv2;
+        float e1[3], e2[3], fn[3], ft[3], fb[3];
+        float du1, dv1, du2, dv2, r;
+        unsigned int v[3];
+
+        if (face->v1 >= (unsigned int)sm->numVertices
+        || face->v2 >= (unsigned int)sm->numVertices
+        || face->v3 >= (unsigned int)sm->numVertices)
+        {
+            ERR_MSG("Face references invalid vertex");
+            free(positions);
+            return 0;
+        }
+
+        v[0] = face->v1;
+        v[1] = face->v2;
+        v[2] = face->v3;
+        p0 = positions + v[0]*3;
+        p1 = positions + v[1]*3;
+        p2 = positions + v[2]*3;
+        uv0 = &sm->vertices[v[0]].texCoords;
+        uv1 = &sm->vertices[v[1]].texCoords;
+        uv2 = &sm->vertices[v[2]].texCoords;
+
+        for (k = 0; k < 3; k++)
+        {
+            e1[k] = p1[k] - p0[k];
+            e2[k] = p2[k] - p0[k];
+        }
+
+        fn[0] = e1[1]*e2[2] - e1[2]*e2[1];
+        fn[1] = e1[2]*e2[0] - e1[0]*e2[2];
+        fn[2] = e1[0]*e2[1] - e1[1]*e2[0];
+
+        du1 = uv1->x - uv0->x;
+        dv1 = uv1->y - uv0->y;
+        du2 = uv2->x - uv0->x;
+        dv2 = uv2->y - uv0->y;
+        r = du1*dv2 - du2*dv1;
+
+        /* faces with degenerate texture coordinates add no tangent */
+        r = fabsf(r) > 1e-12f ? 1.0f/r : 0.0f;
+
+        for (k = 0; k < 3; k++)
+        {
+            ft[k] = (e1[k]*dv2 - e2[k]*dv1)*r;
+            fb[k] = (e2[k]*du1 - e1[k]*du2)*r;
+        }
+
+        for (k = 0; k < 9; k++)
+        {
+            float value = k < 3 ? fn[k] : (k < 6 ? ft[k - 3] : fb[k - 6]);
+
+            frames[v[0]*9 + k] += value;
+            frames[v[1]*9 + k] += value;
+            frames[v[2]*9 + k] += value;
+        }
+    }
+
+    /* normalize, and make the tangents orthogonal to the normals */
+    for (i = 0; i < sm->numVertices; i++)
+    {
+        n = frames + i*9;
+        t = n + 3;
+        b = n + 6;
+
+        length = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+
+        if (length > 0.0f)
+        {
+            n[0] /= length;
+            n[1] /= length;
+            n[2] /= length;
+        }
+        else
+        {
+            /* unused or degenerate vertex */
+            n[0] = 0.0f;
+            n[1] = 0.0f;
+            n[2] = 1.0f;
+        }
+
+        dot = n[0]*t[0] + n[1]*t[1] + n[2]*t[2];
+        t[0] -= dot*n[0];
+        t[1] -= dot*n[1];
+        t[2] -= dot*n[2];
+        length = sqrtf(t[0]*t[0] + t[1]*t[1] + t[2]*t[2]);
+
+        if (length > 1e-12f)
+        {
+            t[0] /= length;
+            t[1] /= length;
+            t[2] /= length;
+        }
+        else
+        {
+            perpendicular(t, n);
+        }
+
+        /* cross(n, t) points along the bitangent for right handed frames */
+        w = (n[1]*t[2] - n[2]*t[1])*b[0]
+            + (n[2]*t[0] - n[0]*t[2])*b[1]
+            + (n[0]*t[1] - n[1]*t[0])*b[2];
+
+        if (normals)
+        {
+            float* out = (float*)((char*)normals + i*(stride ? stride : sizeof(float)*3));
+
+            out[0] = n[0];
+            out[1] = n[1];
+            out[2] = n[2];
+        }
+
+        if (tangents)
+        {
+            float* out = (float*)((char*)tangents + i*(stride ? stride : sizeof(float)*4));
+
+            out[0] = t[0];
+            out[1] = t[1];
+            out[2] = t[2];
+            out[3] = w < 0.0f ? -1.0f : 1.0f;
+        }
+    }
+
+    free(positions);
+
+    return 1;
+}
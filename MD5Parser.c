@@ -0,0 +1,826 @@
+/* posix_madvise is POSIX, not C99 */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "MD5Parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#define FXS_MD5_NO_MMAP
+#endif
+
+#ifndef FXS_MD5_NO_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ \
+|| defined(_M_X64) || defined(_M_IX86) || defined(_M_ARM64)
+#define FXS_MD5_SWAR_DIGITS
+#endif
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** Max. # of chars of a number token.
+*/
+#define MAX_NUMBER_LENGTH 64
+
+/*
+** Max. # of significant digits the fast float path accumulates, more digits
+** could overflow the 64 bit mantissa.
+*/
+#define MAX_MANTISSA_DIGITS 19
+
+#define IS_DIGIT(c) ((unsigned char)((c) - '0') < 10)
+#define IS_BLANK(c) ((c) == ' ' || (c) == '\t' || (c) == '\r')
+#define IS_DELIMITER(c) \
+    (IS_BLANK(c) || (c) == '\n' || (c) == '(' || (c) == ')' \
+    || (c) == '{' || (c) == '}' || (c) == '"')
+
+/*
+** Maps the file into memory. Returns 0 if it fails.
+*/
+int FxsMD5FileOpen(FxsMD5File* file, const char* filename, int isWritable)
+{
+#ifndef FXS_MD5_NO_MMAP
+    int fd;
+    struct stat st;
+    void* data;
+
+    memset(file, 0, sizeof(FxsMD5File));
+
+    fd = open(filename, O_RDONLY);
+
+    if (fd < 0)
+    {
+        ERR_MSG("Could not open file")
+        return 0;
+    }
+
+    if (fstat(fd, &st) != 0)
+    {
+        ERR_MSG("Could not stat file")
+        close(fd);
+        return 0;
+    }
+
+    /* an empty file can not be mapped, but it is still a valid file */
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return 1;
+    }
+
+    /* writable mappings are copy on write, the file never changes */
+    data = mmap(
+            NULL,
+            (size_t)st.st_size,
+            isWritable ? PROT_READ | PROT_WRITE : PROT_READ,
+            MAP_PRIVATE,
+            fd,
+            0
+        );
+
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        ERR_MSG("Could not map file")
+        return 0;
+    }
+
+    /* text is read front to back */
+    if (!isWritable)
+    {
+        posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+    }
+
+    file->data = (char*)data;
+    file->size = (size_t)st.st_size;
+    file->isMapped = 1;
+
+    return 1;
+#else
+    FILE* f;
+    long size;
+    char* data;
+
+    /* the buffer is always writable */
+    (void)isWritable;
+
+    memset(file, 0, sizeof(FxsMD5File));
+
+    f = fopen(filename, "rb");
+
+    if (!f)
+    {
+        ERR_MSG("Could not open file")
+        return 0;
+    }
+
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if (size <= 0)
+    {
+        fclose(f);
+        return size == 0;
+    }
+
+    data = (char*)malloc((size_t)size);
+
+    if (!data)
+    {
+        ERR_MSG("malloc failed")
+        fclose(f);
+        return 0;
+    }
+
+    if (fread(data, 1, (size_t)size, f) != (size_t)size)
+    {
+        ERR_MSG("Could not read file")
+        free(data);
+        fclose(f);
+        return 0;
+    }
+
+    fclose(f);
+
+    file->data = data;
+    file->size = (size_t)size;
+
+    return 1;
+#endif
+}
+
+/*
+** Releases the file data.
+*/
+void FxsMD5FileClose(FxsMD5File* file)
+{
+    if (!file->data)
+    {
+        return;
+    }
+
+#ifndef FXS_MD5_NO_MMAP
+    if (file->isMapped)
+    {
+        munmap(file->data, file->size);
+    }
+    else
+#endif
+    {
+        free(file->data);
+    }
+
+    memset(file, 0, sizeof(FxsMD5File));
+}
+
+void FxsMD5ParserInit(FxsMD5Parser* parser, const char* begin, const char* end)
+{
+    parser->cur = begin;
+    parser->end = end;
+    parser->started = 0;
+    parser->numLines = 0;
+}
+
+/*
+** Skips blanks and comments of the current line. Stops in front of the
+** line feed.
+*/
+static void skipBlanks(FxsMD5Parser* parser)
+{
+    const char* cur = parser->cur;
+    const char* end = parser->end;
+
+    while (cur < end)
+    {
+        if (IS_BLANK(*cur))
+        {
+            cur++;
+        }
+        else if (*cur == '/' && cur + 1 < end && cur[1] == '/')
+        {
+            /* a comment lasts until the end of the line */
+            cur = (const char*)memchr(cur, '\n', end - cur);
+
+            if (!cur)
+            {
+                cur = end;
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    parser->cur = cur;
+}
+
+int FxsMD5ParserNextLine(FxsMD5Parser* parser)
+{
+    const char* lf;
+
+    /* skip what is left of the current line */
+    if (parser->started)
+    {
+        lf = (const char*)memchr(parser->cur, '\n', parser->end - parser->cur);
+        parser->cur = lf ? lf + 1 : parser->end;
+    }
+
+    parser->started = 1;
+
+    /* skip lines w/o tokens */
+    while (1)
+    {
+        skipBlanks(parser);
+
+        if (parser->cur >= parser->end)
+        {
+            return 0;
+        }
+
+        if (*parser->cur != '\n')
+        {
+            parser->numLines++;
+            return 1;
+        }
+
+        parser->cur++;
+    }
+}
+
+int FxsMD5ParserReadToken(FxsMD5Parser* parser, FxsMD5Token* token)
+{
+    const char* cur;
+    const char* end = parser->end;
+
+    skipBlanks(parser);
+    cur = parser->cur;
+
+    if (cur >= end || *cur == '\n')
+    {
+        return 0;
+    }
+
+    token->start = cur;
+
+    if (*cur == '(' || *cur == ')' || *cur == '{' || *cur == '}')
+    {
+        cur++;
+    }
+    else if (*cur == '"')
+    {
+        /* quoted strings may contain blanks, but do not span lines */
+        cur++;
+
+        while (cur < end && *cur != '"' && *cur != '\n')
+        {
+            cur++;
+        }
+
+        if (cur < end && *cur == '"')
+        {
+            cur++;
+        }
+    }
+    else
+    {
+        while (cur < end && !IS_DELIMITER(*cur))
+        {
+            cur++;
+        }
+    }
+
+    token->length = cur - token->start;
+    parser->cur = cur;
+
+    return 1;
+}
+
+int FxsMD5ParserReadInt(FxsMD5Parser* parser, int* value)
+{
+    FxsMD5Token token;
+
+    return FxsMD5ParserReadToken(parser, &token)
+        && FxsMD5TokenToInt(&token, value);
+}
+
+int FxsMD5ParserReadFloat(FxsMD5Parser* parser, float* value)
+{
+    FxsMD5Token token;
+
+    return FxsMD5ParserReadToken(parser, &token)
+        && FxsMD5TokenToFloat(&token, value);
+}
+
+int FxsMD5ParserReadTuple(FxsMD5Parser* parser, float* values, int count)
+{
+    return FxsMD5ParserExpect(parser, '(')
+        && FxsMD5ParserReadFloats(parser, values, count) == count
+        && FxsMD5ParserExpect(parser, ')');
+}
+
+int FxsMD5ParserExpect(FxsMD5Parser* parser, char c)
+{
+    FxsMD5Token token;
+
+    return FxsMD5ParserReadToken(parser, &token)
+        && token.length == 1
+        && token.start[0] == c;
+}
+
+int FxsMD5TokenIs(const FxsMD5Token* token, const char* str)
+{
+    size_t len = strlen(str);
+
+    return token->length == len && memcmp(token->start, str, len) == 0;
+}
+
+int FxsMD5TokenMatch(
+    const FxsMD5Token* token,
+    const char* const* keywords,
+    int numKeywords
+)
+{
+    int i = 0;
+
+    for (i = 0; i < numKeywords; i++)
+    {
+        if (FxsMD5TokenIs(token, keywords[i]))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*
+** Powers of ten that are exact in double precision.
+*/
+static const double powersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+#ifdef FXS_MD5_SWAR_DIGITS
+/*
+** Checks if the 8 chars at str are digits and returns their value in value.
+** The digits are converted in parallel within a 64 bit word (SWAR).
+*/
+static int scanEightDigits(const char* str, uint64_t* value)
+{
+    uint64_t v;
+
+    memcpy(&v, str, sizeof(v));
+
+    /* all bytes need to be in '0' ... '9' */
+    if (((v & 0xF0F0F0F0F0F0F0F0ULL)
+        | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))
+        != 0x3333333333333333ULL)
+    {
+        return 0;
+    }
+
+    /* combine pairs, then quadruples, then the two halves */
+    v -= 0x3030303030303030ULL;
+    v = (v * 10) + (v >> 8);
+    v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32)))
+        + (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+
+    *value = v & 0xFFFFFFFFULL;
+
+    return 1;
+}
+#endif
+
+/*
+** Accumulates the digits at str into mantissa. Returns the pointer past the
+** last digit, numDigits is incremented by the # of digits read.
+*/
+static const char* scanDigits(
+    const char* str,
+    const char* end,
+    uint64_t* mantissa,
+    int* numDigits
+)
+{
+    uint64_t m = *mantissa;
+    int n = *numDigits;
+#ifdef FXS_MD5_SWAR_DIGITS
+    uint64_t chunk;
+
+    while (end - str >= 8 && n + 8 <= MAX_MANTISSA_DIGITS
+    && scanEightDigits(str, &chunk))
+    {
+        m = m*100000000ULL + chunk;
+        n += 8;
+        str += 8;
+    }
+#endif
+
+    while (str < end && IS_DIGIT(*str))
+    {
+        /* keep counting, the caller falls back to strtof if n gets too big */
+        if (n < MAX_MANTISSA_DIGITS)
+        {
+            m = m*10 + (*str - '0');
+        }
+
+        n++;
+        str++;
+    }
+
+    *mantissa = m;
+    *numDigits = n;
+
+    return str;
+}
+
+/*
+** Converts the number at str with strtof, used when the fast path can not
+** guarantee correct rounding or for unusual notations (hex, inf, nan).
+*/
+static const char* scanFloatSlow(const char* str, const char* end, float* value)
+{
+    char buffer[MAX_NUMBER_LENGTH];
+    char* copy = buffer;
+    const char* tokenEnd = str;
+    char* numberEnd;
+    size_t len;
+    float v;
+
+    while (tokenEnd < end && !IS_DELIMITER(*tokenEnd))
+    {
+        tokenEnd++;
+    }
+
+    len = tokenEnd - str;
+
+    if (len == 0)
+    {
+        return NULL;
+    }
+
+    /* the data might not be zero terminated */
+    if (len >= MAX_NUMBER_LENGTH)
+    {
+        copy = (char*)malloc(len + 1);
+
+        if (!copy)
+        {
+            return NULL;
+        }
+    }
+
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+
+    v = strtof(copy, &numberEnd);
+    len = numberEnd - copy;
+
+    if (copy != buffer)
+    {
+        free(copy);
+    }
+
+    if (!len)
+    {
+        return NULL;
+    }
+
+    *value = v;
+
+    return str + len;
+}
+
+const char* FxsMD5ScanFloat(const char* str, const char* end, float* value)
+{
+    const char* cur = str;
+    uint64_t mantissa = 0;
+    uint64_t bits;
+    int numDigits = 0;      /* significant digits */
+    int numRead = 0;        /* all mantissa digits including leading zeros */
+    int exponent = 0;
+    int exponentValue = 0;
+    int isNegative = 0;
+    int isExponentNegative = 0;
+    const char* mark;
+    double d;
+
+    if (cur < end && (*cur == '-' || *cur == '+'))
+    {
+        isNegative = *cur == '-';
+        cur++;
+    }
+
+    /* integer part, leading zeros are not significant */
+    mark = cur;
+
+    while (cur < end && *cur == '0')
+    {
+        cur++;
+    }
+
+    cur = scanDigits(cur, end, &mantissa, &numDigits);
+    exponent += numDigits > MAX_MANTISSA_DIGITS ? numDigits - MAX_MANTISSA_DIGITS : 0;
+    numRead += cur - mark;
+
+    /* fractional part */
+    if (cur < end && *cur == '.')
+    {
+        cur++;
+        mark = cur;
+
+        if (mantissa == 0)
+        {
+            while (cur < end && *cur == '0')
+            {
+                cur++;
+            }
+        }
+
+        exponent -= cur - mark;
+        numRead += cur - mark;
+        mark = cur;
+        cur = scanDigits(cur, end, &mantissa, &numDigits);
+        exponent -= cur - mark;
+        numRead += cur - mark;
+    }
+
+    if (numRead == 0)
+    {
+        return scanFloatSlow(str, end, value);
+    }
+
+    /* exponent */
+    if (cur < end && (*cur == 'e' || *cur == 'E'))
+    {
+        mark = cur;
+        cur++;
+
+        if (cur < end && (*cur == '-' || *cur == '+'))
+        {
+            isExponentNegative = *cur == '-';
+            cur++;
+        }
+
+        if (cur < end && IS_DIGIT(*cur))
+        {
+            while (cur < end && IS_DIGIT(*cur))
+            {
+                if (exponentValue < 100000)
+                {
+                    exponentValue = exponentValue*10 + (*cur - '0');
+                }
+
+                cur++;
+            }
+
+            exponent += isExponentNegative ? -exponentValue : exponentValue;
+        }
+        else
+        {
+            /* "1e" is the number 1 followed by garbage */
+            cur = mark;
+        }
+    }
+
+    /* anything but a delimiter means the notation is not plain decimal */
+    if (cur < end && !IS_DELIMITER(*cur))
+    {
+        return scanFloatSlow(str, end, value);
+    }
+
+    if (mantissa == 0)
+    {
+        *value = isNegative ? -0.0f : 0.0f;
+        return cur;
+    }
+
+    /* the fast path: mantissa and power of ten are exact doubles, so d is
+    ** the correctly rounded double.
+    */
+    if (numDigits > MAX_MANTISSA_DIGITS
+    || mantissa > (1ULL << 53)
+    || exponent < -22
+    || exponent > 22)
+    {
+        return scanFloatSlow(str, end, value);
+    }
+
+    if (exponent < 0)
+    {
+        d = (double)mantissa / powersOfTen[-exponent];
+    }
+    else
+    {
+        d = (double)mantissa * powersOfTen[exponent];
+    }
+
+    /* rounding d to float again is only wrong if d lies exactly halfway
+    ** between two floats, i.e. the 29 low bits of the double mantissa are
+    ** 1000...0. d is always in the range of normalized floats here.
+    */
+    memcpy(&bits, &d, sizeof(bits));
+
+    if ((bits & 0x1FFFFFFFULL) == 0x10000000ULL)
+    {
+        return scanFloatSlow(str, end, value);
+    }
+
+    *value = isNegative ? -(float)d : (float)d;
+
+    return cur;
+}
+
+const char* FxsMD5ScanInt(const char* str, const char* end, int* value)
+{
+    const char* cur = str;
+    long long v = 0;
+    int isNegative = 0;
+
+    if (cur < end && (*cur == '-' || *cur == '+'))
+    {
+        isNegative = *cur == '-';
+        cur++;
+    }
+
+    if (cur >= end || !IS_DIGIT(*cur))
+    {
+        return NULL;
+    }
+
+    while (cur < end && IS_DIGIT(*cur))
+    {
+        v = v*10 + (*cur - '0');
+
+        if (v > 2147483648LL)
+        {
+            return NULL;
+        }
+
+        cur++;
+    }
+
+    v = isNegative ? -v : v;
+
+    if (v > 2147483647LL)
+    {
+        return NULL;
+    }
+
+    *value = (int)v;
+
+    return cur;
+}
+
+const char* FxsMD5ScanFloats(
+    const char* str,
+    const char* end,
+    float* values,
+    int maxCount,
+    int* count
+)
+{
+    const char* next;
+    int n = 0;
+
+    while (n < maxCount)
+    {
+        while (str < end && IS_BLANK(*str))
+        {
+            str++;
+        }
+
+        if (str >= end)
+        {
+            break;
+        }
+
+        next = FxsMD5ScanFloat(str, end, &values[n]);
+
+        /* stop at the first token that is not a number */
+        if (!next || (next < end && !IS_DELIMITER(*next)))
+        {
+            break;
+        }
+
+        str = next;
+        n++;
+    }
+
+    *count = n;
+
+    return str;
+}
+
+int FxsMD5ParserReadFloats(FxsMD5Parser* parser, float* values, int maxCount)
+{
+    int count = 0;
+    int n = 0;
+
+    while (count < maxCount)
+    {
+        /* also skips comments */
+        skipBlanks(parser);
+
+        parser->cur = FxsMD5ScanFloats(
+                parser->cur,
+                parser->end,
+                values + count,
+                maxCount - count,
+                &n
+            );
+
+        if (n == 0)
+        {
+            break;
+        }
+
+        count += n;
+    }
+
+    return count;
+}
+
+int FxsMD5TokenToInt(const FxsMD5Token* token, int* value)
+{
+    const char* end = token->start + token->length;
+    int v;
+
+    /* "12abc" scans 12, value is only written if all of the token is read */
+    if (FxsMD5ScanInt(token->start, end, &v) != end)
+    {
+        return 0;
+    }
+
+    *value = v;
+
+    return 1;
+}
+
+int FxsMD5TokenToFloat(const FxsMD5Token* token, float* value)
+{
+    const char* end = token->start + token->length;
+    float v;
+
+    if (FxsMD5ScanFloat(token->start, end, &v) != end)
+    {
+        return 0;
+    }
+
+    *value = v;
+
+    return 1;
+}
+
+char* FxsMD5TokenCopy(const FxsMD5Token* token)
+{
+    char* str = (char*)malloc(token->length + 1);
+
+    if (!str)
+    {
+        return NULL;
+    }
+
+    memcpy(str, token->start, token->length);
+    str[token->length] = '\0';
+
+    return str;
+}
+
+char* FxsMD5TokenCopyUnquoted(const FxsMD5Token* token)
+{
+    char* str = (char*)malloc(token->length + 1);
+    size_t i = 0, j = 0;
+
+    if (!str)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < token->length; i++)
+    {
+        if (token->start[i] != '"')
+        {
+            str[j] = token->start[i];
+            j++;
+        }
+    }
+
+    str[j] = '\0';
+
+    return str;
+}
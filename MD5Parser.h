@@ -0,0 +1,157 @@
+#ifndef MD5PARSER_H
+#define MD5PARSER_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+
+/*
+** A whole file in memory. The file is memory-mapped where the platform
+** supports it, otherwise it is read into a single buffer.
+*/
+typedef struct
+{
+    char* data;             /* first char of the file */
+    size_t size;            /* # of chars in the file */
+    int isMapped;           /* 1 if data is mapped, 0 if it was malloc'ed */
+}
+FxsMD5File;
+
+/*
+** A token points into the file data, it is NOT zero terminated. Quoted
+** strings keep their quotation marks.
+*/
+typedef struct
+{
+    const char* start;      /* first char of the token */
+    size_t length;          /* # of chars of the token */
+}
+FxsMD5Token;
+
+/*
+** Tokenizer over a range of a file. The parser works line by line:
+** FxsMD5ParserNextLine moves to the first token of the next non blank line,
+** the read functions only return tokens of the current line. Comments ("//")
+** and blanks are skipped.
+*/
+typedef struct
+{
+    const char* cur;        /* current read position */
+    const char* end;        /* one past the last char of the range */
+    int started;            /* 0 until the first line was entered */
+    size_t numLines;        /* # of lines w/ tokens that were entered */
+}
+FxsMD5Parser;
+
+/*
+** Maps a file into memory. If isWritable is set the data can be modified,
+** changes are private and never written back to the file. Returns 0 if it
+** fails.
+*/
+int FxsMD5FileOpen(FxsMD5File* file, const char* filename, int isWritable);
+
+/*
+** Releases the file data.
+*/
+void FxsMD5FileClose(FxsMD5File* file);
+
+/*
+** Inits a parser for the chars in [begin, end).
+*/
+void FxsMD5ParserInit(FxsMD5Parser* parser, const char* begin, const char* end);
+
+/*
+** Skips the rest of the current line and moves to the first token of the
+** next line that has one. Returns 0 at the end of the range.
+*/
+int FxsMD5ParserNextLine(FxsMD5Parser* parser);
+
+/*
+** Reads the next token of the current line. Returns 0 if the line has no
+** more tokens.
+*/
+int FxsMD5ParserReadToken(FxsMD5Parser* parser, FxsMD5Token* token);
+
+/*
+** Reads an integer/float token of the current line. Return 0 if there is no
+** token or if the token is not a number.
+*/
+int FxsMD5ParserReadInt(FxsMD5Parser* parser, int* value);
+int FxsMD5ParserReadFloat(FxsMD5Parser* parser, float* value);
+
+/*
+** Reads a "( x y ... )" tuple of count floats. Returns 0 if it fails.
+*/
+int FxsMD5ParserReadTuple(FxsMD5Parser* parser, float* values, int count);
+
+/*
+** Reads the token and checks if it is the single char c. Returns 0 if not.
+*/
+int FxsMD5ParserExpect(FxsMD5Parser* parser, char c);
+
+/*
+** Returns 1 if the token equals the string.
+*/
+int FxsMD5TokenIs(const FxsMD5Token* token, const char* str);
+
+/*
+** Returns the index of the keyword that equals the token or -1 if the token
+** is not a keyword.
+*/
+int FxsMD5TokenMatch(
+    const FxsMD5Token* token,
+    const char* const* keywords,
+    int numKeywords
+);
+
+/*
+** Reads a float/int from [str, end) w/o skipping blanks. Returns the pointer
+** past the last char of the number or NULL if str does not start with a
+** number. Floats are rounded exactly like strtof, but the decimal point is
+** always '.'. value is not changed if no number is read, e.g. on overflow of
+** an int.
+*/
+const char* FxsMD5ScanFloat(const char* str, const char* end, float* value);
+const char* FxsMD5ScanInt(const char* str, const char* end, int* value);
+
+/*
+** Reads up to maxCount blank separated floats from [str, end). Stops at the
+** first token that is not a float. Returns the pointer past the last float
+** read and stores the # of floats read in count.
+*/
+const char* FxsMD5ScanFloats(
+    const char* str,
+    const char* end,
+    float* values,
+    int maxCount,
+    int* count
+);
+
+/*
+** Reads the floats of the current line, like FxsMD5ScanFloats. Returns the
+** # of floats read.
+*/
+int FxsMD5ParserReadFloats(FxsMD5Parser* parser, float* values, int maxCount);
+
+/*
+** Converts a token to a number. Returns 0 and leaves value unchanged if the
+** token is not a number.
+*/
+int FxsMD5TokenToInt(const FxsMD5Token* token, int* value);
+int FxsMD5TokenToFloat(const FxsMD5Token* token, float* value);
+
+/*
+** Copies the token to a malloc'ed, zero terminated string. The unquoted
+** version removes the quotation marks. Return NULL if malloc fails.
+*/
+char* FxsMD5TokenCopy(const FxsMD5Token* token);
+char* FxsMD5TokenCopyUnquoted(const FxsMD5Token* token);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5PARSER_H */
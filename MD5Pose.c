@@ -0,0 +1,279 @@
+/*
+** Local poses. The joints are stored with one array per component, padded
+** to a multiple of POSE_PADDING joints, so decoding frames into a pose and
+** blending poses run over plain arrays and vectorize.
+*/
+
+#include "MD5Pose.h"
+#include "MD5Memory.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** # of joints the arrays of a local pose are padded to.
+*/
+#define POSE_PADDING 16
+
+/*
+** Above this |cos| of the angle between two orientations slerp falls back
+** to nlerp, as sin(angle) gets too small to divide by.
+*/
+#define SLERP_THRESHOLD 0.9995f
+
+/*
+** # of joints whose slerp weights are computed before they are applied.
+*/
+#define SLERP_CHUNK 16
+
+int FxsMD5LocalPoseCreate(FxsMD5LocalPose** pose, unsigned int numJoints)
+{
+    size_t padded = (numJoints + POSE_PADDING - 1)/POSE_PADDING*POSE_PADDING;
+    int i;
+
+    *pose = (FxsMD5LocalPose*)malloc(sizeof(FxsMD5LocalPose));
+
+    if (!*pose)
+    {
+        ERR_MSG("malloc failed");
+        return 0;
+    }
+
+    memset(*pose, 0, sizeof(FxsMD5LocalPose));
+
+    (*pose)->numJoints = numJoints;
+    (*pose)->data = (float*)FxsMD5AlignedAlloc(
+            sizeof(float)*padded*7,
+            FXS_MD5_ALIGNMENT
+        );
+
+    if (!(*pose)->data)
+    {
+        ERR_MSG("malloc failed");
+        free(*pose);
+        *pose = NULL;
+        return 0;
+    }
+
+    /* identity pose, padding included */
+    memset((*pose)->data, 0, sizeof(float)*padded*7);
+
+    for (i = 0; i < 3; i++)
+    {
+        (*pose)->positions[i] = (*pose)->data + padded*i;
+    }
+
+    for (i = 0; i < 4; i++)
+    {
+        (*pose)->orientations[i] = (*pose)->data + padded*(3 + i);
+    }
+
+    for (i = 0; i < (int)padded; i++)
+    {
+        (*pose)->orientations[3][i] = 1.0f;
+    }
+
+    return 1;
+}
+
+void FxsMD5LocalPoseDestroy(FxsMD5LocalPose** pose)
+{
+    if (!*pose)
+    {
+        return;
+    }
+
+    FxsMD5AlignedFree((*pose)->data);
+    free(*pose);
+
+    *pose = NULL;
+}
+
+int FxsMD5LocalPoseWithAnimationFrame(
+    FxsMD5LocalPose* pose,
+    const FxsMD5Animation* animation,
+    unsigned int frame
+)
+{
+    float* components[6];
+
+    if (pose->numJoints != animation->numJoints)
+    {
+        /* animation does not apply to this pose ... */
+        return 0;
+    }
+
+    components[0] = pose->positions[0];
+    components[1] = pose->positions[1];
+    components[2] = pose->positions[2];
+    components[3] = pose->orientations[0];
+    components[4] = pose->orientations[1];
+    components[5] = pose->orientations[2];
+
+    if (!FxsMD5AnimationDecodeFrame(animation, frame, components))
+    {
+        return 0;
+    }
+
+    FxsMD5AnimationCompleteOrientations(pose->orientations, animation->numJoints);
+
+    return 1;
+}
+
+/*
+** Copies the joints of a pose.
+*/
+static void copyPose(FxsMD5LocalPose* result, const FxsMD5LocalPose* pose)
+{
+    int i;
+
+    if (result == pose)
+    {
+        return;
+    }
+
+    for (i = 0; i < 3; i++)
+    {
+        memcpy(result->positions[i], pose->positions[i], sizeof(float)*pose->numJoints);
+    }
+
+    for (i = 0; i < 4; i++)
+    {
+        memcpy(result->orientations[i], pose->orientations[i], sizeof(float)*pose->numJoints);
+    }
+}
+
+/*
+** result = w0*from + w1*to for the orientations [first, first + count)
+** then normalized. to is negated for joints where the orientations are on
+** opposite hemispheres.
+*/
+static void combineOrientations(
+    FxsMD5LocalPose* result,
+    const FxsMD5LocalPose* from,
+    const FxsMD5LocalPose* to,
+    unsigned int first,
+    unsigned int count,
+    const float* w0,
+    const float* w1
+)
+{
+    unsigned int i, j;
+
+    for (j = 0; j < count; j++)
+    {
+        float q[4];
+        float dot;
+        float s;
+        float norm;
+
+        i = first + j;
+
+        dot = from->orientations[0][i]*to->orientations[0][i]
+            + from->orientations[1][i]*to->orientations[1][i]
+            + from->orientations[2][i]*to->orientations[2][i]
+            + from->orientations[3][i]*to->orientations[3][i];
+
+        s = dot < 0.0f ? -w1[j] : w1[j];
+
+        q[0] = w0[j]*from->orientations[0][i] + s*to->orientations[0][i];
+        q[1] = w0[j]*from->orientations[1][i] + s*to->orientations[1][i];
+        q[2] = w0[j]*from->orientations[2][i] + s*to->orientations[2][i];
+        q[3] = w0[j]*from->orientations[3][i] + s*to->orientations[3][i];
+
+        norm = 1.0f/sqrtf(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+
+        result->orientations[0][i] = q[0]*norm;
+        result->orientations[1][i] = q[1]*norm;
+        result->orientations[2][i] = q[2]*norm;
+        result->orientations[3][i] = q[3]*norm;
+    }
+}
+
+int FxsMD5LocalPoseBlend(
+    FxsMD5LocalPose* result,
+    const FxsMD5LocalPose* from,
+    const FxsMD5LocalPose* to,
+    float alpha,
+    int interpolation
+)
+{
+    float w0[SLERP_CHUNK];
+    float w1[SLERP_CHUNK];
+    unsigned int i, j, n;
+    int c;
+
+    if (result->numJoints != from->numJoints || from->numJoints != to->numJoints)
+    {
+        return 0;
+    }
+
+    /* the end points are exact */
+    if (alpha <= 0.0f)
+    {
+        copyPose(result, from);
+        return 1;
+    }
+
+    if (alpha >= 1.0f)
+    {
+        copyPose(result, to);
+        return 1;
+    }
+
+    for (c = 0; c < 3; c++)
+    {
+        const float* a = from->positions[c];
+        const float* b = to->positions[c];
+        float* p = result->positions[c];
+
+        for (i = 0; i < from->numJoints; i++)
+        {
+            p[i] = (1.0f - alpha)*a[i] + alpha*b[i];
+        }
+    }
+
+    for (i = 0; i < from->numJoints; i += SLERP_CHUNK)
+    {
+        n = from->numJoints - i < SLERP_CHUNK ? from->numJoints - i : SLERP_CHUNK;
+
+        for (j = 0; j < n; j++)
+        {
+            w0[j] = 1.0f - alpha;
+            w1[j] = alpha;
+        }
+
+        /* slerp weights, except for nearly equal orientations */
+        if (interpolation == FXS_MD5_SLERP)
+        {
+            for (j = 0; j < n; j++)
+            {
+                float dot = fabsf(
+                        from->orientations[0][i + j]*to->orientations[0][i + j]
+                        + from->orientations[1][i + j]*to->orientations[1][i + j]
+                        + from->orientations[2][i + j]*to->orientations[2][i + j]
+                        + from->orientations[3][i + j]*to->orientations[3][i + j]
+                    );
+                float angle;
+                float sinAngle;
+
+                if (dot > SLERP_THRESHOLD)
+                {
+                    continue;
+                }
+
+                angle = acosf(dot);
+                sinAngle = sinf(angle);
+                w0[j] = sinf((1.0f - alpha)*angle)/sinAngle;
+                w1[j] = sinf(alpha*angle)/sinAngle;
+            }
+        }
+
+        combineOrientations(result, from, to, i, n, w0, w1);
+    }
+
+    return 1;
+}
@@ -0,0 +1,72 @@
+#ifndef MD5POSE_H
+#define MD5POSE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "MD5Animation.h"
+
+/*
+** Ways to interpolate orientations.
+*/
+#define FXS_MD5_NLERP   0   /* normalized linear interpolation, cheap */
+#define FXS_MD5_SLERP   1   /* spherical linear interpolation, constant speed */
+
+/*
+** Joint positions and orientations relative to the parent joint, one array
+** per component, so loops over the joints can be vectorized. The arrays are
+** cache line aligned and padded to a multiple of 16 joints.
+*/
+typedef struct
+{
+    unsigned int numJoints;
+    float* positions[3];        /* x, y, z of the positions */
+    float* orientations[4];     /* x, y, z, w of the orientations */
+    float* data;                /* block that holds all arrays */
+}
+FxsMD5LocalPose;
+
+/*
+** Creates a local pose for numJoints joints. Returns 0 if it fails.
+*/
+int FxsMD5LocalPoseCreate(FxsMD5LocalPose** pose, unsigned int numJoints);
+
+/*
+** Releases the local pose.
+*/
+void FxsMD5LocalPoseDestroy(FxsMD5LocalPose** pose);
+
+/*
+** Decodes a frame of an animation into a local pose. Orientations get
+** their w from FxsMD5AnimationCompleteOrientations, exactly like
+** FxsMD5MeshUpdatePoseWithAnimationFrame computes it.
+** Returns 0 if the frame does not exist or the pose has the wrong # of
+** joints.
+*/
+int FxsMD5LocalPoseWithAnimationFrame(
+    FxsMD5LocalPose* pose,
+    const FxsMD5Animation* animation,
+    unsigned int frame
+);
+
+/*
+** Interpolates between two local poses, alpha = 0 gives from, 1 gives to.
+** Positions are interpolated linearly, orientations with interpolation
+** (FXS_MD5_NLERP or FXS_MD5_SLERP) along the shorter arc. result may be
+** from or to. Returns 0 if the # of joints do not match.
+*/
+int FxsMD5LocalPoseBlend(
+    FxsMD5LocalPose* result,
+    const FxsMD5LocalPose* from,
+    const FxsMD5LocalPose* to,
+    float alpha,
+    int interpolation
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5POSE_H */
@@ -0,0 +1,207 @@
+/*
+** Sampling of animations at arbitrary times. A time is turned into two
+** frames and a blend factor, the sampler keeps the two frames it blended
+** last decoded so playing an animation decodes each frame only once.
+*/
+
+#include "MD5Sampler.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** Times closer than this to a frame (in frames) are moved onto the frame,
+** so seconds computed as frame/frameRate give exactly that frame.
+*/
+#define FRAME_EPSILON 1e-4
+
+int FxsMD5SamplerCreate(
+    FxsMD5Sampler** sampler,
+    const FxsMD5Animation* animation,
+    int loopMode,
+    int interpolation
+)
+{
+    if (!animation->numFrames || !animation->frameRate)
+    {
+        ERR_MSG("Animation has no frames or no frame rate");
+        *sampler = NULL;
+        return 0;
+    }
+
+    *sampler = (FxsMD5Sampler*)malloc(sizeof(FxsMD5Sampler));
+
+    if (!*sampler)
+    {
+        ERR_MSG("malloc failed");
+        return 0;
+    }
+
+    memset(*sampler, 0, sizeof(FxsMD5Sampler));
+
+    (*sampler)->animation = animation;
+    (*sampler)->loopMode = loopMode;
+    (*sampler)->interpolation = interpolation;
+    (*sampler)->decoded[0] = -1;
+    (*sampler)->decoded[1] = -1;
+
+    if (!FxsMD5LocalPoseCreate(&(*sampler)->pose, animation->numJoints)
+    || !FxsMD5LocalPoseCreate(&(*sampler)->frames[0], animation->numJoints)
+    || !FxsMD5LocalPoseCreate(&(*sampler)->frames[1], animation->numJoints))
+    {
+        FxsMD5SamplerDestroy(sampler);
+        return 0;
+    }
+
+    return 1;
+}
+
+void FxsMD5SamplerDestroy(FxsMD5Sampler** sampler)
+{
+    if (!*sampler)
+    {
+        return;
+    }
+
+    FxsMD5LocalPoseDestroy(&(*sampler)->pose);
+    FxsMD5LocalPoseDestroy(&(*sampler)->frames[0]);
+    FxsMD5LocalPoseDestroy(&(*sampler)->frames[1]);
+    free(*sampler);
+
+    *sampler = NULL;
+}
+
+float FxsMD5SamplerDuration(const FxsMD5Sampler* sampler)
+{
+    const FxsMD5Animation* animation = sampler->animation;
+
+    if (sampler->loopMode == FXS_MD5_LOOP)
+    {
+        return (float)animation->numFrames/animation->frameRate;
+    }
+
+    return (float)(animation->numFrames - 1)/animation->frameRate;
+}
+
+/*
+** Returns the slot that holds the frame, decodes it into the slot that does
+** not hold keep if needed. Returns -1 if the frame can not be decoded.
+*/
+static int decodeFrame(FxsMD5Sampler* sampler, unsigned int frame, int keep)
+{
+    int slot;
+
+    if (sampler->decoded[0] == (int)frame)
+    {
+        return 0;
+    }
+
+    if (sampler->decoded[1] == (int)frame)
+    {
+        return 1;
+    }
+
+    slot = sampler->decoded[0] == keep ? 1 : 0;
+    sampler->decoded[slot] = -1;
+
+    if (!FxsMD5LocalPoseWithAnimationFrame(
+        sampler->frames[slot],
+        sampler->animation,
+        frame)
+    )
+    {
+        return -1;
+    }
+
+    sampler->decoded[slot] = frame;
+
+    return slot;
+}
+
+int FxsMD5SamplerSample(FxsMD5Sampler* sampler, float seconds)
+{
+    const FxsMD5Animation* animation = sampler->animation;
+    double time = (double)seconds*animation->frameRate;     /* in frames */
+    double last = animation->numFrames - 1;
+    unsigned int frame;
+    unsigned int next;
+    int from, to;
+
+    if (time != time)
+    {
+        /* NaN */
+        time = 0.0;
+    }
+
+    if (fabs(time - floor(time + 0.5)) < FRAME_EPSILON)
+    {
+        time = floor(time + 0.5);
+    }
+
+    if (sampler->loopMode == FXS_MD5_LOOP)
+    {
+        /* an infinite time has no place in the loop, fmod would make it NaN */
+        if (!isfinite(time))
+        {
+            time = 0.0;
+        }
+
+        time = fmod(time, (double)animation->numFrames);
+
+        if (time < 0.0)
+        {
+            time += animation->numFrames;
+        }
+
+        /* adding numFrames may round up to numFrames */
+        if (time >= animation->numFrames)
+        {
+            time = 0.0;
+        }
+    }
+    else
+    {
+        time = time < 0.0 ? 0.0 : (time > last ? last : time);
+    }
+
+    frame = (unsigned int)time;
+    next = frame + 1 < animation->numFrames ? frame + 1
+        : (sampler->loopMode == FXS_MD5_LOOP ? 0 : frame);
+
+    from = decodeFrame(sampler, frame, -1);
+
+    if (from < 0)
+    {
+        return 0;
+    }
+
+    /* on a frame, or blending a frame with itself */
+    if (time == frame || next == frame)
+    {
+        return FxsMD5LocalPoseBlend(
+            sampler->pose,
+            sampler->frames[from],
+            sampler->frames[from],
+            0.0f,
+            sampler->interpolation
+        );
+    }
+
+    to = decodeFrame(sampler, next, frame);
+
+    if (to < 0)
+    {
+        return 0;
+    }
+
+    return FxsMD5LocalPoseBlend(
+        sampler->pose,
+        sampler->frames[from],
+        sampler->frames[to],
+        (float)(time - frame),
+        sampler->interpolation
+    );
+}
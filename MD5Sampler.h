@@ -0,0 +1,68 @@
+#ifndef MD5SAMPLER_H
+#define MD5SAMPLER_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "MD5Pose.h"
+
+/*
+** What happens to times outside of the animation.
+*/
+#define FXS_MD5_CLAMP   0   /* hold the first/last frame */
+#define FXS_MD5_LOOP    1   /* repeat, the last frame blends into the first */
+
+/*
+** Samples an animation at arbitrary times. The sampler keeps the two frames
+** it blends decoded, so consecutive samples between the same frames only
+** blend, and moving on to the next frame only decodes one frame.
+*/
+typedef struct
+{
+    const FxsMD5Animation* animation;
+    int loopMode;                   /* FXS_MD5_CLAMP or FXS_MD5_LOOP */
+    int interpolation;              /* FXS_MD5_NLERP or FXS_MD5_SLERP */
+    FxsMD5LocalPose* pose;          /* pose of the last sample */
+    FxsMD5LocalPose* frames[2];     /* decoded frames */
+    int decoded[2];                 /* frame in frames[i], -1 if none */
+}
+FxsMD5Sampler;
+
+/*
+** Creates a sampler for an animation, the animation has to outlive the
+** sampler. Returns 0 if it fails, e.g. if the animation has no frames or no
+** frame rate.
+*/
+int FxsMD5SamplerCreate(
+    FxsMD5Sampler** sampler,
+    const FxsMD5Animation* animation,
+    int loopMode,
+    int interpolation
+);
+
+/*
+** Releases the sampler.
+*/
+void FxsMD5SamplerDestroy(FxsMD5Sampler** sampler);
+
+/*
+** Returns the length of the animation in seconds. Looping animations are
+** one frame longer, the time it takes to blend back to the first frame.
+*/
+float FxsMD5SamplerDuration(const FxsMD5Sampler* sampler);
+
+/*
+** Samples the animation at a time in seconds and stores the result in
+** sampler->pose. NaN samples the first frame, so do infinite times with
+** FXS_MD5_LOOP, FXS_MD5_CLAMP clamps them to the first or last frame.
+** Returns 0 if a frame could not be decoded.
+*/
+int FxsMD5SamplerSample(FxsMD5Sampler* sampler, float seconds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5SAMPLER_H */
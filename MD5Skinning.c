@@ -0,0 +1,1284 @@
+#include "MD5Skinning.h"
+#include "MD5Memory.h"
+#include "MD5Thread.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** The 16 floats of a (column major) matrix.
+*/
+#define MATRIX_DATA(M) ((const float*)(M))
+
+/*
+** Cost of the vertex range of a skinning task, in influence rows. A block
+** costs its # of influences + 1 for storing the positions.
+*/
+#define SKIN_TASK_COST 128
+
+/*
+** Checks the weights referenced by the vertices of a submesh and finds the
+** largest # of weights of a vertex. Returns 0 if the submesh is invalid.
+*/
+static int checkSubMesh(
+    const FxsMD5SubMesh* subMesh,
+    int numJoints,
+    int* maxInfluences
+)
+{
+    int i;
+
+    *maxInfluences = 0;
+
+    for (i = 0; i < subMesh->numWeights; i++)
+    {
+        if (subMesh->weights[i].jointId < 0
+        || subMesh->weights[i].jointId >= numJoints)
+        {
+            ERR_MSG("Weight references an invalid joint");
+            return 0;
+        }
+    }
+
+    for (i = 0; i < subMesh->numVertices; i++)
+    {
+        const FxsMD5Vertex* vertex = &subMesh->vertices[i];
+
+        if (vertex->weightId < 0 || vertex->numWeights < 0
+        || vertex->numWeights > subMesh->numWeights - vertex->weightId)
+        {
+            ERR_MSG("Vertex references invalid weights");
+            return 0;
+        }
+
+        if (vertex->numWeights > *maxInfluences)
+        {
+            *maxInfluences = vertex->numWeights;
+        }
+    }
+
+    return 1;
+}
+
+/*
+** Groups the vertices of a submesh by their # of weights and copies the
+** weights to the blocks. Returns 0 if it fails.
+*/
+static int prepareSubMesh(
+    FxsMD5SkinSubMesh* skinMesh,
+    const FxsMD5SubMesh* subMesh,
+    int numJoints
+)
+{
+    int maxInfluences;
+    int* counts = NULL;         /* # of vertices for each # of weights */
+    int i, j, n;
+    unsigned int block = 0;
+    unsigned int influence = 0;
+
+    if (!checkSubMesh(subMesh, numJoints, &maxInfluences))
+    {
+        return 0;
+    }
+
+    counts = (int*)calloc(maxInfluences + 1, sizeof(int));
+
+    if (!counts)
+    {
+        ERR_MSG("malloc failed");
+        return 0;
+    }
+
+    for (i = 0; i < subMesh->numVertices; i++)
+    {
+        counts[subMesh->vertices[i].numWeights]++;
+    }
+
+    /* count the blocks and their influences */
+    for (n = 0; n <= maxInfluences; n++)
+    {
+        unsigned int blocks = (counts[n] + FXS_MD5_SKIN_LANES - 1)/FXS_MD5_SKIN_LANES;
+
+        skinMesh->numBlocks += blocks;
+        skinMesh->numInfluences += blocks*n;
+    }
+
+    skinMesh->numVertices = subMesh->numVertices;
+    skinMesh->blocks = (FxsMD5SkinBlock*)malloc(
+            sizeof(FxsMD5SkinBlock)*skinMesh->numBlocks
+        );
+    skinMesh->influences = (FxsMD5SkinInfluence*)FxsMD5AlignedAlloc(
+            sizeof(FxsMD5SkinInfluence)*skinMesh->numInfluences,
+            FXS_MD5_ALIGNMENT
+        );
+
+    if (!skinMesh->blocks || !skinMesh->influences)
+    {
+        ERR_MSG("malloc failed");
+        free(counts);
+        return 0;
+    }
+
+    /* padding lanes have zero weights for joint 0 */
+    memset(
+        skinMesh->influences,
+        0,
+        sizeof(FxsMD5SkinInfluence)*skinMesh->numInfluences
+    );
+
+    /* fill the blocks, vertices keep their order within a group */
+    for (n = 0; n <= maxInfluences; n++)
+    {
+        FxsMD5SkinBlock* current = NULL;
+
+        if (!counts[n])
+        {
+            continue;
+        }
+
+        for (i = 0; i < subMesh->numVertices; i++)
+        {
+            const FxsMD5Vertex* vertex = &subMesh->vertices[i];
+            unsigned int lane;
+
+            if (vertex->numWeights != n)
+            {
+                continue;
+            }
+
+            /* start a new block if the current one is full */
+            if (!current || current->numVertices == FXS_MD5_SKIN_LANES)
+            {
+                current = &skinMesh->blocks[block++];
+                current->numVertices = 0;
+                current->numInfluences = n;
+                current->firstInfluence = influence;
+                memset(current->vertices, 0, sizeof(current->vertices));
+                influence += n;
+            }
+
+            lane = current->numVertices++;
+            current->vertices[lane] = i;
+
+            for (j = 0; j < n; j++)
+            {
+                const FxsMD5Weight* weight = &subMesh->weights[vertex->weightId + j];
+                FxsMD5SkinInfluence* row = &skinMesh->influences[current->firstInfluence + j];
+
+                row->x[lane] = weight->position.x*weight->value;
+                row->y[lane] = weight->position.y*weight->value;
+                row->z[lane] = weight->position.z*weight->value;
+                row->w[lane] = weight->value;
+                row->joints[lane] = weight->jointId;
+            }
+        }
+    }
+
+    free(counts);
+
+    return 1;
+}
+
+int FxsMD5SkinCreateWithMesh(FxsMD5Skin** skin, const FxsMD5Mesh* mesh)
+{
+    unsigned int i;
+
+    *skin = (FxsMD5Skin*)malloc(sizeof(FxsMD5Skin));
+
+    if (!*skin)
+    {
+        ERR_MSG("malloc failed");
+        return 0;
+    }
+
+    memset(*skin, 0, sizeof(FxsMD5Skin));
+
+    (*skin)->numJoints = mesh->bindPose.numJoints;
+    FxsMD5SkinSetKernel(*skin, FXS_MD5_SKIN_KERNEL_AUTO);
+    (*skin)->numSubMeshes = mesh->numSubMeshes;
+
+    if (mesh->numSubMeshes)
+    {
+        (*skin)->meshes = (FxsMD5SkinSubMesh*)calloc(
+                mesh->numSubMeshes,
+                sizeof(FxsMD5SkinSubMesh)
+            );
+    }
+
+    if (mesh->numSubMeshes && !(*skin)->meshes)
+    {
+        ERR_MSG("malloc failed");
+        FxsMD5SkinDestroy(skin);
+        return 0;
+    }
+
+    for (i = 0; i < mesh->numSubMeshes; i++)
+    {
+        if (!prepareSubMesh(
+            &(*skin)->meshes[i],
+            &mesh->meshes[i],
+            mesh->bindPose.numJoints)
+        )
+        {
+            FxsMD5SkinDestroy(skin);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+** Moves the bind pose normals and tangents of a submesh to the joints of
+** the influences. Returns 0 if it fails.
+*/
+static int prepareNormals(
+    FxsMD5SkinSubMesh* skinMesh,
+    const FxsMD5Mesh* mesh,
+    unsigned int subMesh
+)
+{
+    const FxsMD5SubMesh* sm = &mesh->meshes[subMesh];
+    size_t size = sizeof(FxsMD5SkinInfluence)*skinMesh->numInfluences;
+    float* frames;              /* normal, tangent of each vertex */
+    unsigned int i, j, lane;
+    int r;
+
+    FxsMD5AlignedFree(skinMesh->normalInfluences);
+    FxsMD5AlignedFree(skinMesh->tangentInfluences);
+    free(skinMesh->handedness);
+
+    skinMesh->handedness = NULL;
+    frames = NULL;
+
+    /* the influences are allocated for empty submeshes too, they mark
+    ** the normals as prepared
+    */
+    skinMesh->normalInfluences = (FxsMD5SkinInfluence*)FxsMD5AlignedAlloc(
+            size,
+            FXS_MD5_ALIGNMENT
+        );
+    skinMesh->tangentInfluences = (FxsMD5SkinInfluence*)FxsMD5AlignedAlloc(
+            size,
+            FXS_MD5_ALIGNMENT
+        );
+
+    if (sm->numVertices)
+    {
+        skinMesh->handedness = (float*)malloc(sizeof(float)*sm->numVertices);
+        frames = (float*)malloc(sizeof(float)*sm->numVertices*7);
+    }
+
+    if (!skinMesh->normalInfluences || !skinMesh->tangentInfluences
+    || (sm->numVertices && (!skinMesh->handedness || !frames)))
+    {
+        ERR_MSG("malloc failed");
+        free(frames);
+        return 0;
+    }
+
+    if (!FxsMD5MeshBindNormals(mesh, subMesh, frames, frames + 3, sizeof(float)*7))
+    {
+        free(frames);
+        return 0;
+    }
+
+    memset(skinMesh->normalInfluences, 0, size);
+    memset(skinMesh->tangentInfluences, 0, size);
+
+    for (i = 0; i < skinMesh->numBlocks; i++)
+    {
+        const FxsMD5SkinBlock* block = &skinMesh->blocks[i];
+
+        for (lane = 0; lane < block->numVertices; lane++)
+        {
+            unsigned int vertex = block->vertices[lane];
+            const float* n = frames + vertex*7;
+            const float* t = n + 3;
+
+            skinMesh->handedness[vertex] = t[3];
+
+            for (j = 0; j < block->numInfluences; j++)
+            {
+                const FxsMD5Weight* weight =
+                    &sm->weights[sm->vertices[vertex].weightId + j];
+                const float* m = MATRIX_DATA(&mesh->bindPose.joints[weight->jointId].transform);
+                FxsMD5SkinInfluence* rowN = &skinMesh->normalInfluences[block->firstInfluence + j];
+                FxsMD5SkinInfluence* rowT = &skinMesh->tangentInfluences[block->firstInfluence + j];
+                float local[2][3];
+
+                /* the joint rotations are orthonormal, inverse = transpose */
+                for (r = 0; r < 3; r++)
+                {
+                    local[0][r] = m[r*4 + 0]*n[0] + m[r*4 + 1]*n[1] + m[r*4 + 2]*n[2];
+                    local[1][r] = m[r*4 + 0]*t[0] + m[r*4 + 1]*t[1] + m[r*4 + 2]*t[2];
+                }
+
+                rowN->x[lane] = local[0][0]*weight->value;
+                rowN->y[lane] = local[0][1]*weight->value;
+                rowN->z[lane] = local[0][2]*weight->value;
+                rowN->joints[lane] = weight->jointId;
+                rowT->x[lane] = local[1][0]*weight->value;
+                rowT->y[lane] = local[1][1]*weight->value;
+                rowT->z[lane] = local[1][2]*weight->value;
+                rowT->joints[lane] = weight->jointId;
+            }
+        }
+    }
+
+    free(frames);
+
+    return 1;
+}
+
+int FxsMD5SkinAddNormals(FxsMD5Skin* skin, const FxsMD5Mesh* mesh)
+{
+    unsigned int i;
+
+    if (mesh->numSubMeshes != skin->numSubMeshes
+    || mesh->bindPose.numJoints != skin->numJoints)
+    {
+        /* skin does not belong to this mesh ... */
+        return 0;
+    }
+
+    for (i = 0; i < skin->numSubMeshes; i++)
+    {
+        if ((unsigned int)mesh->meshes[i].numVertices != skin->meshes[i].numVertices
+        || !prepareNormals(&skin->meshes[i], mesh, i))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+void FxsMD5SkinDestroy(FxsMD5Skin** skin)
+{
+    unsigned int i;
+
+    if (!*skin)
+    {
+        return;
+    }
+
+    if ((*skin)->meshes)
+    {
+        for (i = 0; i < (*skin)->numSubMeshes; i++)
+        {
+            free((*skin)->meshes[i].blocks);
+            FxsMD5AlignedFree((*skin)->meshes[i].influences);
+            FxsMD5AlignedFree((*skin)->meshes[i].normalInfluences);
+            FxsMD5AlignedFree((*skin)->meshes[i].tangentInfluences);
+            free((*skin)->meshes[i].handedness);
+        }
+
+        free((*skin)->meshes);
+    }
+
+    free(*skin);
+
+    *skin = NULL;
+}
+
+/*
+** SIMD kernels are compiled for x86 only, each kernel function is compiled
+** for its instruction set and only called if the CPU supports it.
+*/
+#if !defined(FXS_MD5_NO_SIMD) \
+    && (defined(__x86_64__) || defined(__i386__) \
+    || defined(_M_X64) || defined(_M_IX86))
+#define FXS_MD5_SIMD
+#endif
+
+#ifdef FXS_MD5_SIMD
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET(X)
+#else
+#include <cpuid.h>
+#define TARGET(X) __attribute__((target(X)))
+#endif
+#endif
+
+typedef void (*SkinKernel)(
+    const FxsMD5SkinBlock* block,
+    const FxsMD5SkinInfluence* influences,
+    const FxsMD5Joint* joints,
+    char* positions,
+    size_t stride
+);
+
+/*
+** Stores the positions of the used lanes of a block.
+*/
+static void storeBlock(
+    const FxsMD5SkinBlock* block,
+    const float* x,
+    const float* y,
+    const float* z,
+    char* positions,
+    size_t stride
+)
+{
+    unsigned int i;
+
+    for (i = 0; i < block->numVertices; i++)
+    {
+        float* position = (float*)(positions + block->vertices[i]*stride);
+
+        position[0] = x[i];
+        position[1] = y[i];
+        position[2] = z[i];
+    }
+}
+
+/*
+** Skins the vertices of a block and stores the positions. This is the
+** reference for the SIMD kernels.
+*/
+static void skinBlockScalar(
+    const FxsMD5SkinBlock* block,
+    const FxsMD5SkinInfluence* influences,
+    const FxsMD5Joint* joints,
+    char* positions,
+    size_t stride
+)
+{
+    float x[FXS_MD5_SKIN_LANES];
+    float y[FXS_MD5_SKIN_LANES];
+    float z[FXS_MD5_SKIN_LANES];
+    unsigned int i, k;
+
+    memset(x, 0, sizeof(x));
+    memset(y, 0, sizeof(y));
+    memset(z, 0, sizeof(z));
+
+    /* accumulate transform*(x, y, z, w) one influence after the other */
+    for (k = 0; k < block->numInfluences; k++)
+    {
+        const FxsMD5SkinInfluence* in = &influences[k];
+
+        for (i = 0; i < block->numVertices; i++)
+        {
+            const float* m = MATRIX_DATA(&joints[in->joints[i]].transform);
+
+            x[i] += m[0]*in->x[i] + m[4]*in->y[i] + m[8]*in->z[i] + m[12]*in->w[i];
+            y[i] += m[1]*in->x[i] + m[5]*in->y[i] + m[9]*in->z[i] + m[13]*in->w[i];
+            z[i] += m[2]*in->x[i] + m[6]*in->y[i] + m[10]*in->z[i] + m[14]*in->w[i];
+        }
+    }
+
+    storeBlock(block, x, y, z, positions, stride);
+}
+
+#ifdef FXS_MD5_SIMD
+
+/*
+** 4 vertices at a time. The columns of the 4 joint matrices are transposed,
+** so each register holds one matrix element for the 4 vertices.
+*/
+TARGET("sse")
+static void skinBlockSse(
+    const FxsMD5SkinBlock* block,
+    const FxsMD5SkinInfluence* influences,
+    const FxsMD5Joint* joints,
+    char* positions,
+    size_t stride
+)
+{
+    float x[FXS_MD5_SKIN_LANES];
+    float y[FXS_MD5_SKIN_LANES];
+    float z[FXS_MD5_SKIN_LANES];
+    unsigned int i, k, c;
+
+    for (i = 0; i < block->numVertices; i += 4)
+    {
+        __m128 sx = _mm_setzero_ps();
+        __m128 sy = _mm_setzero_ps();
+        __m128 sz = _mm_setzero_ps();
+
+        for (k = 0; k < block->numInfluences; k++)
+        {
+            const FxsMD5SkinInfluence* in = &influences[k];
+            const float* m0 = MATRIX_DATA(&joints[in->joints[i + 0]].transform);
+            const float* m1 = MATRIX_DATA(&joints[in->joints[i + 1]].transform);
+            const float* m2 = MATRIX_DATA(&joints[in->joints[i + 2]].transform);
+            const float* m3 = MATRIX_DATA(&joints[in->joints[i + 3]].transform);
+            __m128 v[4];
+            __m128 tx = _mm_setzero_ps();
+            __m128 ty = _mm_setzero_ps();
+            __m128 tz = _mm_setzero_ps();
+
+            v[0] = _mm_load_ps(&in->x[i]);
+            v[1] = _mm_load_ps(&in->y[i]);
+            v[2] = _mm_load_ps(&in->z[i]);
+            v[3] = _mm_load_ps(&in->w[i]);
+
+            for (c = 0; c < 4; c++)
+            {
+                __m128 c0 = _mm_loadu_ps(m0 + 4*c);
+                __m128 c1 = _mm_loadu_ps(m1 + 4*c);
+                __m128 c2 = _mm_loadu_ps(m2 + 4*c);
+                __m128 c3 = _mm_loadu_ps(m3 + 4*c);
+
+                /* c0, c1, c2 hold row 0, 1, 2 of column c afterwards */
+                _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+                tx = _mm_add_ps(tx, _mm_mul_ps(c0, v[c]));
+                ty = _mm_add_ps(ty, _mm_mul_ps(c1, v[c]));
+                tz = _mm_add_ps(tz, _mm_mul_ps(c2, v[c]));
+            }
+
+            sx = _mm_add_ps(sx, tx);
+            sy = _mm_add_ps(sy, ty);
+            sz = _mm_add_ps(sz, tz);
+        }
+
+        _mm_storeu_ps(&x[i], sx);
+        _mm_storeu_ps(&y[i], sy);
+        _mm_storeu_ps(&z[i], sz);
+    }
+
+    storeBlock(block, x, y, z, positions, stride);
+}
+
+/*
+** 8 vertices at a time, the matrix elements are gathered from the joints.
+*/
+TARGET("avx2,fma")
+static void skinBlockAvx2(
+    const FxsMD5SkinBlock* block,
+    const FxsMD5SkinInfluence* influences,
+    const FxsMD5Joint* joints,
+    char* positions,
+    size_t stride
+)
+{
+    float x[FXS_MD5_SKIN_LANES];
+    float y[FXS_MD5_SKIN_LANES];
+    float z[FXS_MD5_SKIN_LANES];
+    const float* m = MATRIX_DATA(&joints[0].transform);
+    const __m256i scale = _mm256_set1_epi32(sizeof(FxsMD5Joint)/sizeof(float));
+    unsigned int i, k;
+
+    for (i = 0; i < block->numVertices; i += 8)
+    {
+        __m256 sx = _mm256_setzero_ps();
+        __m256 sy = _mm256_setzero_ps();
+        __m256 sz = _mm256_setzero_ps();
+
+        for (k = 0; k < block->numInfluences; k++)
+        {
+            const FxsMD5SkinInfluence* in = &influences[k];
+            __m256i joint = _mm256_mullo_epi32(
+                    _mm256_load_si256((const __m256i*)&in->joints[i]),
+                    scale
+                );
+            __m256 vx = _mm256_load_ps(&in->x[i]);
+            __m256 vy = _mm256_load_ps(&in->y[i]);
+            __m256 vz = _mm256_load_ps(&in->z[i]);
+            __m256 vw = _mm256_load_ps(&in->w[i]);
+            __m256 t;
+
+#define GATHER(E) _mm256_i32gather_ps(m + (E), joint, 4)
+            t = _mm256_mul_ps(GATHER(0), vx);
+            t = _mm256_fmadd_ps(GATHER(4), vy, t);
+            t = _mm256_fmadd_ps(GATHER(8), vz, t);
+            sx = _mm256_add_ps(sx, _mm256_fmadd_ps(GATHER(12), vw, t));
+
+            t = _mm256_mul_ps(GATHER(1), vx);
+            t = _mm256_fmadd_ps(GATHER(5), vy, t);
+            t = _mm256_fmadd_ps(GATHER(9), vz, t);
+            sy = _mm256_add_ps(sy, _mm256_fmadd_ps(GATHER(13), vw, t));
+
+            t = _mm256_mul_ps(GATHER(2), vx);
+            t = _mm256_fmadd_ps(GATHER(6), vy, t);
+            t = _mm256_fmadd_ps(GATHER(10), vz, t);
+            sz = _mm256_add_ps(sz, _mm256_fmadd_ps(GATHER(14), vw, t));
+#undef GATHER
+        }
+
+        _mm256_storeu_ps(&x[i], sx);
+        _mm256_storeu_ps(&y[i], sy);
+        _mm256_storeu_ps(&z[i], sz);
+    }
+
+    storeBlock(block, x, y, z, positions, stride);
+}
+
+/*
+** A whole block at a time, like the AVX2 kernel.
+*/
+TARGET("avx512f")
+static void skinBlockAvx512(
+    const FxsMD5SkinBlock* block,
+    const FxsMD5SkinInfluence* influences,
+    const FxsMD5Joint* joints,
+    char* positions,
+    size_t stride
+)
+{
+    float x[FXS_MD5_SKIN_LANES];
+    float y[FXS_MD5_SKIN_LANES];
+    float z[FXS_MD5_SKIN_LANES];
+    const float* m = MATRIX_DATA(&joints[0].transform);
+    const __m512i scale = _mm512_set1_epi32(sizeof(FxsMD5Joint)/sizeof(float));
+    __m512 sx = _mm512_setzero_ps();
+    __m512 sy = _mm512_setzero_ps();
+    __m512 sz = _mm512_setzero_ps();
+    unsigned int k;
+
+    for (k = 0; k < block->numInfluences; k++)
+    {
+        const FxsMD5SkinInfluence* in = &influences[k];
+        __m512i joint = _mm512_mullo_epi32(
+                _mm512_load_si512((const void*)in->joints),
+                scale
+            );
+        __m512 vx = _mm512_load_ps(in->x);
+        __m512 vy = _mm512_load_ps(in->y);
+        __m512 vz = _mm512_load_ps(in->z);
+        __m512 vw = _mm512_load_ps(in->w);
+        __m512 t;
+
+#define GATHER(E) _mm512_i32gather_ps(joint, m + (E), 4)
+        t = _mm512_mul_ps(GATHER(0), vx);
+        t = _mm512_fmadd_ps(GATHER(4), vy, t);
+        t = _mm512_fmadd_ps(GATHER(8), vz, t);
+        sx = _mm512_add_ps(sx, _mm512_fmadd_ps(GATHER(12), vw, t));
+
+        t = _mm512_mul_ps(GATHER(1), vx);
+        t = _mm512_fmadd_ps(GATHER(5), vy, t);
+        t = _mm512_fmadd_ps(GATHER(9), vz, t);
+        sy = _mm512_add_ps(sy, _mm512_fmadd_ps(GATHER(13), vw, t));
+
+        t = _mm512_mul_ps(GATHER(2), vx);
+        t = _mm512_fmadd_ps(GATHER(6), vy, t);
+        t = _mm512_fmadd_ps(GATHER(10), vz, t);
+        sz = _mm512_add_ps(sz, _mm512_fmadd_ps(GATHER(14), vw, t));
+#undef GATHER
+    }
+
+    _mm512_storeu_ps(x, sx);
+    _mm512_storeu_ps(y, sy);
+    _mm512_storeu_ps(z, sz);
+
+    storeBlock(block, x, y, z, positions, stride);
+}
+
+/*
+** Reads the CPUID registers eax, ebx, ecx, edx of a leaf.
+*/
+static void cpuid(unsigned int leaf, unsigned int regs[4])
+{
+#ifdef _MSC_VER
+    __cpuidex((int*)regs, (int)leaf, 0);
+#else
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/*
+** Returns the register state the OS saves on context switches (XCR0).
+*/
+static unsigned int osRegisterState(void)
+{
+#ifdef _MSC_VER
+    return (unsigned int)_xgetbv(0);
+#else
+    unsigned int eax, edx;
+
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+
+    return eax;
+#endif
+}
+
+static int isCpuSupported(int kernel)
+{
+    unsigned int leaf1[4];
+    unsigned int leaf7[4] = {0, 0, 0, 0};
+    unsigned int state = 0;
+
+    cpuid(0, leaf1);
+
+    if (leaf1[0] >= 7)
+    {
+        cpuid(7, leaf7);
+    }
+
+    cpuid(1, leaf1);
+
+    /* OSXSAVE, the OS manages the AVX registers */
+    if (leaf1[2] & (1u << 27))
+    {
+        state = osRegisterState();
+    }
+
+    switch (kernel)
+    {
+        case FXS_MD5_SKIN_KERNEL_SSE:
+            return (leaf1[3] & (1u << 25)) != 0;
+
+        /* AVX2 + FMA and the ymm registers */
+        case FXS_MD5_SKIN_KERNEL_AVX2:
+            return (leaf7[1] & (1u << 5))
+                && (leaf1[2] & (1u << 12))
+                && (state & 0x06) == 0x06;
+
+        /* AVX-512F and the ymm, zmm and mask registers */
+        case FXS_MD5_SKIN_KERNEL_AVX512:
+            return (leaf7[1] & (1u << 16))
+                && (state & 0xE6) == 0xE6;
+
+        default:
+            return 0;
+    }
+}
+
+#endif /* FXS_MD5_SIMD */
+
+/*
+** Kernels by id, NULL if the kernel is not compiled in.
+*/
+static const SkinKernel kernels[FXS_MD5_SKIN_NUM_KERNELS] = {
+        NULL,
+        skinBlockScalar,
+#ifdef FXS_MD5_SIMD
+        skinBlockSse,
+        skinBlockAvx2,
+        skinBlockAvx512
+#else
+        NULL,
+        NULL,
+        NULL
+#endif
+    };
+
+int FxsMD5SkinIsKernelSupported(int kernel)
+{
+    if (kernel == FXS_MD5_SKIN_KERNEL_AUTO
+    || kernel == FXS_MD5_SKIN_KERNEL_SCALAR)
+    {
+        return 1;
+    }
+
+    if (kernel < 0 || kernel >= FXS_MD5_SKIN_NUM_KERNELS || !kernels[kernel])
+    {
+        return 0;
+    }
+
+#ifdef FXS_MD5_SIMD
+    return isCpuSupported(kernel);
+#else
+    return 0;
+#endif
+}
+
+int FxsMD5SkinSetKernel(FxsMD5Skin* skin, int kernel)
+{
+    if (!FxsMD5SkinIsKernelSupported(kernel))
+    {
+        return 0;
+    }
+
+    /* pick the widest kernel the CPU supports */
+    if (kernel == FXS_MD5_SKIN_KERNEL_AUTO)
+    {
+        kernel = FXS_MD5_SKIN_NUM_KERNELS - 1;
+
+        while (!FxsMD5SkinIsKernelSupported(kernel))
+        {
+            kernel--;
+        }
+    }
+
+    skin->kernel = kernel;
+
+    return 1;
+}
+
+/*
+** Normalizes the skinned vectors of a block, sets their w to the
+** handedness if it is not NULL.
+*/
+static void normalizeBlock(
+    const FxsMD5SkinBlock* block,
+    char* vectors,
+    size_t stride,
+    const float* handedness
+)
+{
+    unsigned int i;
+
+    for (i = 0; i < block->numVertices; i++)
+    {
+        float* v = (float*)(vectors + block->vertices[i]*stride);
+        float length = sqrtf(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+
+        if (length > 0.0f)
+        {
+            length = 1.0f/length;
+            v[0] *= length;
+            v[1] *= length;
+            v[2] *= length;
+        }
+
+        if (handedness)
+        {
+            v[3] = handedness[block->vertices[i]];
+        }
+    }
+}
+
+/*
+** Skins the blocks [first, first + count) of a submesh. normals and
+** tangents may be NULL.
+*/
+static void skinBlocks(
+    const FxsMD5Skin* skin,
+    const FxsMD5SkinSubMesh* skinMesh,
+    unsigned int first,
+    unsigned int count,
+    const FxsMD5Joint* joints,
+    float* positions,
+    float* normals,
+    float* tangents,
+    size_t stride
+)
+{
+    size_t tangentStride = stride ? stride : 4*sizeof(float);
+    unsigned int i;
+
+    if (!stride)
+    {
+        stride = 3*sizeof(float);
+    }
+
+    for (i = first; i < first + count; i++)
+    {
+        const FxsMD5SkinBlock* block = &skinMesh->blocks[i];
+
+        if (positions)
+        {
+            kernels[skin->kernel](
+                block,
+                &skinMesh->influences[block->firstInfluence],
+                joints,
+                (char*)positions,
+                stride
+            );
+        }
+
+        /* normals and tangents have w = 0, only the rotations apply */
+        if (normals && skinMesh->normalInfluences)
+        {
+            kernels[skin->kernel](
+                block,
+                &skinMesh->normalInfluences[block->firstInfluence],
+                joints,
+                (char*)normals,
+                stride
+            );
+            normalizeBlock(block, (char*)normals, stride, NULL);
+        }
+
+        if (tangents && skinMesh->tangentInfluences)
+        {
+            kernels[skin->kernel](
+                block,
+                &skinMesh->tangentInfluences[block->firstInfluence],
+                joints,
+                (char*)tangents,
+                tangentStride
+            );
+            normalizeBlock(block, (char*)tangents, tangentStride, skinMesh->handedness);
+        }
+    }
+}
+
+int FxsMD5SkinSubMeshPositions(
+    const FxsMD5Skin* skin,
+    unsigned int subMesh,
+    const FxsMD5Skeleton* pose,
+    float* positions,
+    size_t stride
+)
+{
+    if (subMesh >= skin->numSubMeshes || pose->numJoints != skin->numJoints)
+    {
+        /* skin does not belong to this pose ... */
+        return 0;
+    }
+
+    skinBlocks(
+        skin,
+        &skin->meshes[subMesh],
+        0,
+        skin->meshes[subMesh].numBlocks,
+        pose->joints,
+        positions,
+        NULL,
+        NULL,
+        stride
+    );
+
+    return 1;
+}
+
+int FxsMD5SkinSubMeshNormals(
+    const FxsMD5Skin* skin,
+    unsigned int subMesh,
+    const FxsMD5Skeleton* pose,
+    float* normals,
+    float* tangents,
+    size_t stride
+)
+{
+    if (subMesh >= skin->numSubMeshes || pose->numJoints != skin->numJoints)
+    {
+        /* skin does not belong to this pose ... */
+        return 0;
+    }
+
+    if (!skin->meshes[subMesh].normalInfluences)
+    {
+        ERR_MSG("Normals were not added to the skin");
+        return 0;
+    }
+
+    skinBlocks(
+        skin,
+        &skin->meshes[subMesh],
+        0,
+        skin->meshes[subMesh].numBlocks,
+        pose->joints,
+        NULL,
+        normals,
+        tangents,
+        stride
+    );
+
+    return 1;
+}
+
+/*
+** Blocks of a submesh that are skinned by one task.
+*/
+typedef struct
+{
+    unsigned int subMesh;
+    unsigned int firstBlock;
+    unsigned int numBlocks;
+}
+SkinRange;
+
+struct FxsMD5SkinJob
+{
+    const FxsMD5Skin* skin;
+    SkinRange* ranges;          /* ranges ordered by submesh */
+    unsigned int numRanges;
+    unsigned int* numSubMeshRanges; /* # of ranges of each submesh */
+
+    /* state of the running job */
+    const FxsMD5Skeleton* pose;
+    float** positions;          /* output buffer of each submesh */
+    float** normals;            /* may be NULL */
+    float** tangents;           /* may be NULL */
+    size_t stride;
+    unsigned int* rangesLeft;   /* # of unfinished ranges of each submesh */
+    unsigned int numRangesLeft;
+    FxsMD5Mutex mutex;
+    FxsMD5Condition finished;   /* signaled when a submesh is finished */
+};
+
+/*
+** Splits the blocks of each submesh into ranges of about SKIN_TASK_COST.
+** With ranges == NULL the ranges are only counted.
+*/
+static unsigned int splitRanges(
+    const FxsMD5Skin* skin,
+    SkinRange* ranges,
+    unsigned int* numSubMeshRanges
+)
+{
+    unsigned int numRanges = 0;
+    unsigned int i, j;
+    unsigned int cost;
+
+    for (i = 0; i < skin->numSubMeshes; i++)
+    {
+        const FxsMD5SkinSubMesh* skinMesh = &skin->meshes[i];
+        unsigned int first = numRanges;
+
+        cost = SKIN_TASK_COST;
+
+        for (j = 0; j < skinMesh->numBlocks; j++)
+        {
+            /* start a new range when the current one is full */
+            if (cost >= SKIN_TASK_COST)
+            {
+                if (ranges)
+                {
+                    ranges[numRanges].subMesh = i;
+                    ranges[numRanges].firstBlock = j;
+                    ranges[numRanges].numBlocks = 0;
+                }
+
+                numRanges++;
+                cost = 0;
+            }
+
+            if (ranges)
+            {
+                ranges[numRanges - 1].numBlocks++;
+            }
+
+            cost += skinMesh->blocks[j].numInfluences + 1;
+        }
+
+        if (numSubMeshRanges)
+        {
+            numSubMeshRanges[i] = numRanges - first;
+        }
+    }
+
+    return numRanges;
+}
+
+int FxsMD5SkinJobCreate(FxsMD5SkinJob** job, const FxsMD5Skin* skin)
+{
+    unsigned int numRanges = splitRanges(skin, NULL, NULL);
+
+    *job = (FxsMD5SkinJob*)malloc(sizeof(FxsMD5SkinJob));
+
+    if (!*job)
+    {
+        ERR_MSG("malloc failed");
+        return 0;
+    }
+
+    memset(*job, 0, sizeof(FxsMD5SkinJob));
+
+    (*job)->skin = skin;
+    (*job)->numRanges = numRanges;
+
+    if (numRanges)
+    {
+        (*job)->ranges = (SkinRange*)malloc(sizeof(SkinRange)*numRanges);
+    }
+
+    if (skin->numSubMeshes)
+    {
+        (*job)->numSubMeshRanges = (unsigned int*)malloc(
+                sizeof(unsigned int)*skin->numSubMeshes
+            );
+        (*job)->rangesLeft = (unsigned int*)calloc(
+                skin->numSubMeshes,
+                sizeof(unsigned int)
+            );
+        (*job)->positions = (float**)calloc(3*skin->numSubMeshes, sizeof(float*));
+    }
+
+    if ((numRanges && !(*job)->ranges)
+    || (skin->numSubMeshes && (!(*job)->numSubMeshRanges
+        || !(*job)->rangesLeft || !(*job)->positions)))
+    {
+        ERR_MSG("malloc failed");
+        free((*job)->ranges);
+        free((*job)->numSubMeshRanges);
+        free((*job)->rangesLeft);
+        free((*job)->positions);
+        free(*job);
+        *job = NULL;
+        return 0;
+    }
+
+    /* the normal and tangent buffers follow the position buffers */
+    if (skin->numSubMeshes)
+    {
+        (*job)->normals = (*job)->positions + skin->numSubMeshes;
+        (*job)->tangents = (*job)->normals + skin->numSubMeshes;
+    }
+
+    splitRanges(skin, (*job)->ranges, (*job)->numSubMeshRanges);
+
+    FxsMD5MutexInit(&(*job)->mutex);
+    FxsMD5ConditionInit(&(*job)->finished);
+
+    return 1;
+}
+
+void FxsMD5SkinJobDestroy(FxsMD5SkinJob** job)
+{
+    if (!*job)
+    {
+        return;
+    }
+
+    FxsMD5SkinJobWait(*job);
+
+    FxsMD5ConditionDestroy(&(*job)->finished);
+    FxsMD5MutexDestroy(&(*job)->mutex);
+    free((*job)->ranges);
+    free((*job)->numSubMeshRanges);
+    free((*job)->rangesLeft);
+    free((*job)->positions);
+    free(*job);
+
+    *job = NULL;
+}
+
+/*
+** Task of a skinning job, skins one range.
+*/
+static void skinRange(void* arg, unsigned int index)
+{
+    FxsMD5SkinJob* job = (FxsMD5SkinJob*)arg;
+    const SkinRange* range = &job->ranges[index];
+
+    skinBlocks(
+        job->skin,
+        &job->skin->meshes[range->subMesh],
+        range->firstBlock,
+        range->numBlocks,
+        job->pose->joints,
+        job->positions[range->subMesh],
+        job->normals[range->subMesh],
+        job->tangents[range->subMesh],
+        job->stride
+    );
+
+    FxsMD5MutexLock(&job->mutex);
+
+    job->numRangesLeft--;
+
+    if (--job->rangesLeft[range->subMesh] == 0)
+    {
+        FxsMD5ConditionBroadcast(&job->finished);
+    }
+
+    FxsMD5MutexUnlock(&job->mutex);
+}
+
+int FxsMD5SkinJobStart(
+    FxsMD5SkinJob* job,
+    const FxsMD5Skeleton* pose,
+    float* const* positions,
+    size_t stride,
+    const FxsMD5Scheduler* scheduler
+)
+{
+    return FxsMD5SkinJobStartWithNormals(
+            job,
+            pose,
+            positions,
+            NULL,
+            NULL,
+            stride,
+            scheduler
+        );
+}
+
+int FxsMD5SkinJobStartWithNormals(
+    FxsMD5SkinJob* job,
+    const FxsMD5Skeleton* pose,
+    float* const* positions,
+    float* const* normals,
+    float* const* tangents,
+    size_t stride,
+    const FxsMD5Scheduler* scheduler
+)
+{
+    unsigned int i;
+
+    if (pose->numJoints != job->skin->numJoints)
+    {
+        /* skin does not belong to this pose ... */
+        return 0;
+    }
+
+    FxsMD5MutexLock(&job->mutex);
+
+    if (job->numRangesLeft)
+    {
+        /* the job is still running */
+        FxsMD5MutexUnlock(&job->mutex);
+        return 0;
+    }
+
+    job->pose = pose;
+    job->stride = stride;
+    job->numRangesLeft = job->numRanges;
+
+    for (i = 0; i < job->skin->numSubMeshes; i++)
+    {
+        job->positions[i] = positions[i];
+        job->normals[i] = normals ? normals[i] : NULL;
+        job->tangents[i] = tangents ? tangents[i] : NULL;
+        job->rangesLeft[i] = job->numSubMeshRanges[i];
+    }
+
+    FxsMD5MutexUnlock(&job->mutex);
+
+    /* w/o a scheduler, or if it fails, the calling thread does the work */
+    if (!job->numRanges
+    || (scheduler && scheduler->submit(scheduler->context, skinRange, job, job->numRanges)))
+    {
+        return 1;
+    }
+
+    for (i = 0; i < job->numRanges; i++)
+    {
+        skinRange(job, i);
+    }
+
+    return 1;
+}
+
+int FxsMD5SkinJobIsSubMeshDone(FxsMD5SkinJob* job, unsigned int subMesh)
+{
+    int isDone;
+
+    FxsMD5MutexLock(&job->mutex);
+    isDone = subMesh < job->skin->numSubMeshes && !job->rangesLeft[subMesh];
+    FxsMD5MutexUnlock(&job->mutex);
+
+    return isDone;
+}
+
+void FxsMD5SkinJobWaitSubMesh(FxsMD5SkinJob* job, unsigned int subMesh)
+{
+    if (subMesh >= job->skin->numSubMeshes)
+    {
+        return;
+    }
+
+    FxsMD5MutexLock(&job->mutex);
+
+    while (job->rangesLeft[subMesh])
+    {
+        FxsMD5ConditionWait(&job->finished, &job->mutex);
+    }
+
+    FxsMD5MutexUnlock(&job->mutex);
+}
+
+void FxsMD5SkinJobWait(FxsMD5SkinJob* job)
+{
+    FxsMD5MutexLock(&job->mutex);
+
+    while (job->numRangesLeft)
+    {
+        FxsMD5ConditionWait(&job->finished, &job->mutex);
+    }
+
+    FxsMD5MutexUnlock(&job->mutex);
+}
@@ -0,0 +1,224 @@
+#ifndef MD5SKINNING_H
+#define MD5SKINNING_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include "MD5Mesh.h"
+#include "MD5Jobs.h"
+
+/*
+** # of vertices that are skinned together.
+*/
+#define FXS_MD5_SKIN_LANES 16
+
+/*
+** Kernels that skin the vertices. AUTO picks the fastest kernel the CPU
+** supports, SSE handles 4, AVX2 8 and AVX512 16 vertices per instruction.
+*/
+#define FXS_MD5_SKIN_KERNEL_AUTO    0
+#define FXS_MD5_SKIN_KERNEL_SCALAR  1
+#define FXS_MD5_SKIN_KERNEL_SSE     2
+#define FXS_MD5_SKIN_KERNEL_AVX2    3
+#define FXS_MD5_SKIN_KERNEL_AVX512  4
+#define FXS_MD5_SKIN_NUM_KERNELS    5
+
+/*
+** One influence of FXS_MD5_SKIN_LANES vertices. The weight position is
+** premultiplied by the weight value, so a vertex position is the sum of
+** transform*(x, y, z, w) over its influences.
+*/
+typedef struct
+{
+    float x[FXS_MD5_SKIN_LANES];
+    float y[FXS_MD5_SKIN_LANES];
+    float z[FXS_MD5_SKIN_LANES];
+    float w[FXS_MD5_SKIN_LANES];            /* weight value */
+    int joints[FXS_MD5_SKIN_LANES];         /* joint of the influence */
+}
+FxsMD5SkinInfluence;
+
+/*
+** A block of vertices that have the same # of influences. Lanes past
+** numVertices are padding.
+*/
+typedef struct
+{
+    unsigned int numVertices;               /* # of used lanes */
+    unsigned int numInfluences;             /* # of influences per vertex */
+    unsigned int firstInfluence;            /* index of the first influence
+                                            ** of the block in the influences
+                                            ** of the submesh
+                                            */
+    unsigned int vertices[FXS_MD5_SKIN_LANES]; /* submesh vertex of a lane */
+}
+FxsMD5SkinBlock;
+
+typedef struct
+{
+    unsigned int numVertices;
+    unsigned int numBlocks;
+    unsigned int numInfluences;
+
+    FxsMD5SkinBlock* blocks;
+    FxsMD5SkinInfluence* influences;        /* influences of the blocks, one
+                                            ** after another
+                                            */
+
+    /* bind pose normals and tangents in joint space, laid out like the
+    ** influences with w = 0, NULL until FxsMD5SkinAddNormals
+    */
+    FxsMD5SkinInfluence* normalInfluences;
+    FxsMD5SkinInfluence* tangentInfluences;
+    float* handedness;                      /* tangent w of each vertex */
+}
+FxsMD5SkinSubMesh;
+
+/*
+** Vertex weights of a mesh, rearranged for skinning. Vertices are grouped
+** by their # of influences, so the data of a submesh is read front to back
+** while skinning.
+*/
+typedef struct
+{
+    int numJoints;
+    int kernel;                             /* kernel used for skinning */
+    unsigned int numSubMeshes;
+    FxsMD5SkinSubMesh* meshes;
+}
+FxsMD5Skin;
+
+/*
+** Prepares the weights of a mesh for skinning. Returns 0 if it fails, e.g.
+** if a vertex references a weight or a weight references a joint that does
+** not exist.
+*/
+int FxsMD5SkinCreateWithMesh(FxsMD5Skin** skin, const FxsMD5Mesh* mesh);
+
+/*
+** Returns 1 if the CPU supports a kernel. The scalar kernel is always
+** supported, SIMD kernels are only available on x86 and can be disabled by
+** defining FXS_MD5_NO_SIMD.
+*/
+int FxsMD5SkinIsKernelSupported(int kernel);
+
+/*
+** Selects the kernel of the skin, new skins use FXS_MD5_SKIN_KERNEL_AUTO.
+** Returns 0 if the kernel is not supported, the kernel is not changed then.
+*/
+int FxsMD5SkinSetKernel(FxsMD5Skin* skin, int kernel);
+
+/*
+** Releases the skin.
+*/
+void FxsMD5SkinDestroy(FxsMD5Skin** skin);
+
+/*
+** Computes the posed positions of the vertices of a submesh with the joint
+** transforms of pose (usually mesh->currentPose). The position of vertex i
+** is written as 3 floats to (char*)positions + i*stride, so positions can
+** point into an interleaved vertex buffer, a stride of 0 means the
+** positions are tightly packed. Returns 0 if it fails.
+*/
+int FxsMD5SkinSubMeshPositions(
+    const FxsMD5Skin* skin,
+    unsigned int subMesh,
+    const FxsMD5Skeleton* pose,
+    float* positions,
+    size_t stride
+);
+
+/*
+** Prepares the bind pose normals and tangents of a mesh (see
+** FxsMD5MeshBindNormals) for skinning, the mesh has to be the one the skin
+** was created with. They are skinned like the positions, with the rotations
+** of the joints only, so lit vertices need no per frame rebuild from the
+** faces. Returns 0 if it fails.
+*/
+int FxsMD5SkinAddNormals(FxsMD5Skin* skin, const FxsMD5Mesh* mesh);
+
+/*
+** Computes the posed normals (x, y, z) and tangents (x, y, z, w) of the
+** vertices of a submesh, after FxsMD5SkinAddNormals. Either array may be
+** NULL, entries are stride bytes apart, 0 for packed normals and tangents.
+** Returns 0 if it fails.
+*/
+int FxsMD5SkinSubMeshNormals(
+    const FxsMD5Skin* skin,
+    unsigned int subMesh,
+    const FxsMD5Skeleton* pose,
+    float* normals,
+    float* tangents,
+    size_t stride
+);
+
+/*
+** Skins all submeshes of a skin as tasks of a scheduler. The vertices of a
+** submesh are split into ranges of similar cost, so large submeshes are
+** skinned by several threads, and each submesh can be used as soon as its
+** ranges are finished.
+*/
+typedef struct FxsMD5SkinJob FxsMD5SkinJob;
+
+/*
+** Creates a job for a skin, the skin has to outlive the job. Returns 0 if
+** it fails.
+*/
+int FxsMD5SkinJobCreate(FxsMD5SkinJob** job, const FxsMD5Skin* skin);
+
+/*
+** Waits for the job to finish and releases it.
+*/
+void FxsMD5SkinJobDestroy(FxsMD5SkinJob** job);
+
+/*
+** Starts skinning with the joint transforms of pose. positions holds the
+** output buffer of each submesh, see FxsMD5SkinSubMeshPositions for the
+** layout. pose and the buffers have to stay valid until the job finished.
+** If scheduler is NULL or fails to queue the tasks the job runs on the
+** calling thread. Returns 0 if the pose does not match the skin or if the
+** job is still running.
+*/
+int FxsMD5SkinJobStart(
+    FxsMD5SkinJob* job,
+    const FxsMD5Skeleton* pose,
+    float* const* positions,
+    size_t stride,
+    const FxsMD5Scheduler* scheduler
+);
+
+/*
+** Same as FxsMD5SkinJobStart, also skins the normals and the tangents of
+** each submesh to normals[i] and tangents[i] after FxsMD5SkinAddNormals.
+** normals, tangents or their entries may be NULL, see
+** FxsMD5SkinSubMeshNormals for the layout.
+*/
+int FxsMD5SkinJobStartWithNormals(
+    FxsMD5SkinJob* job,
+    const FxsMD5Skeleton* pose,
+    float* const* positions,
+    float* const* normals,
+    float* const* tangents,
+    size_t stride,
+    const FxsMD5Scheduler* scheduler
+);
+
+/*
+** Returns 1 if the positions of the submesh are ready.
+*/
+int FxsMD5SkinJobIsSubMeshDone(FxsMD5SkinJob* job, unsigned int subMesh);
+
+/*
+** Waits for the positions of a submesh/all submeshes.
+*/
+void FxsMD5SkinJobWaitSubMesh(FxsMD5SkinJob* job, unsigned int subMesh);
+void FxsMD5SkinJobWait(FxsMD5SkinJob* job);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5SKINNING_H */
@@ -0,0 +1,55 @@
+/* clock_gettime is POSIX, not C99 */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "MD5Stats.h"
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static const char* const sectionNames[FXS_MD5_NUM_SECTIONS] = {
+        "joints",
+        "mesh",
+        "hierarchy",
+        "bounds",
+        "baseframe",
+        "frames"
+    };
+
+void FxsMD5StatsReset(FxsMD5Stats* stats)
+{
+    memset(stats, 0, sizeof(FxsMD5Stats));
+}
+
+unsigned long long FxsMD5StatsTime(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+
+    return (unsigned long long)((double)counter.QuadPart*1e9/(double)frequency.QuadPart);
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long long)ts.tv_sec*1000000000ull + (unsigned long long)ts.tv_nsec;
+#endif
+}
+
+const char* FxsMD5StatsSectionName(unsigned int section)
+{
+    if (section >= FXS_MD5_NUM_SECTIONS)
+    {
+        return NULL;
+    }
+
+    return sectionNames[section];
+}
@@ -0,0 +1,108 @@
+#ifndef MD5STATS_H
+#define MD5STATS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+** Counters of the text loaders and the pose updates, opt-in. Pass stats in
+** the load options of a mesh or an animation, the object keeps the pointer
+** (FxsMD5Mesh.stats, FxsMD5Animation.stats) and counts its pose updates and
+** frame cache lookups into the same stats. Instances of a mesh count their
+** pose updates into FxsMD5MeshInstance.stats. Objects w/o stats, the
+** default, only test the pointer. Define FXS_MD5_NO_STATS to compile the
+** counting out.
+**
+** The allocations are counted where they happen: the blocks of the loaded
+** objects, the file buffer if the file could not be mapped, and the
+** temporary blocks of the loaders and of the passes over a mesh (welding,
+** vertex cache optimization, influence compaction). The buffers of the
+** pose updates are not counted.
+**
+** The library only adds to the counters. They are not synchronized, objects
+** that are used on different threads at the same time need their own stats.
+** The frame cache counts under its lock.
+*/
+
+/*
+** Sections of the text files, indices of FxsMD5Stats.sectionTimes.
+*/
+#define FXS_MD5_SECTION_JOINTS      0   /* joints of a mesh */
+#define FXS_MD5_SECTION_MESH        1   /* submeshes of a mesh */
+#define FXS_MD5_SECTION_HIERARCHY   2   /* joints of an animation */
+#define FXS_MD5_SECTION_BOUNDS      3
+#define FXS_MD5_SECTION_BASE_FRAME  4
+#define FXS_MD5_SECTION_FRAMES      5   /* frames, parsed or located */
+#define FXS_MD5_NUM_SECTIONS        6
+
+typedef struct
+{
+    unsigned long long bytesRead;       /* size of the text files */
+    unsigned long long numLines;        /* lines w/ tokens that were parsed */
+    unsigned long long sectionTimes[FXS_MD5_NUM_SECTIONS];  /* wall clock
+                                                            ** ns
+                                                            */
+    unsigned long long numAllocations;  /* heap blocks allocated by the
+                                        ** loaders and the passes over a
+                                        ** mesh, temporaries included
+                                        */
+    unsigned long long allocatedBytes;
+    unsigned long long numPoseUpdates;  /* current poses that were computed */
+    unsigned long long numFrameCacheHits;   /* frames of lazy animations
+                                            ** that were decoded already
+                                            */
+    unsigned long long numFrameCacheMisses; /* frames that were decoded */
+}
+FxsMD5Stats;
+
+/*
+** Counting in the library goes through these macros. FXS_MD5_STATS_ON is 1
+** if stats are counted.
+*/
+#ifndef FXS_MD5_NO_STATS
+#define FXS_MD5_STATS_ON(stats) ((stats) != NULL)
+#else
+#define FXS_MD5_STATS_ON(stats) 0
+#endif
+
+#define FXS_MD5_STATS_ADD(stats, counter, n) \
+    do { if (FXS_MD5_STATS_ON(stats)) { (stats)->counter += (n); } } while (0)
+#define FXS_MD5_STATS_TIME(stats) (FXS_MD5_STATS_ON(stats) ? FxsMD5StatsTime() : 0)
+
+/*
+** Counts a heap block of size bytes, call it where the block was allocated.
+** A block that is reallocated counts again.
+*/
+#define FXS_MD5_STATS_ALLOC(stats, size) \
+    do { FXS_MD5_STATS_ADD(stats, numAllocations, 1); \
+        FXS_MD5_STATS_ADD(stats, allocatedBytes, size); } while (0)
+
+/*
+** Adds the time since start, a FXS_MD5_STATS_TIME, to a section.
+*/
+#define FXS_MD5_STATS_SECTION(stats, section, start) \
+    FXS_MD5_STATS_ADD(stats, sectionTimes[section], FXS_MD5_STATS_TIME(stats) - (start))
+
+/*
+** Sets all counters to zero.
+*/
+void FxsMD5StatsReset(FxsMD5Stats* stats);
+
+/*
+** Returns a monotonic time in ns.
+*/
+unsigned long long FxsMD5StatsTime(void);
+
+/*
+** Returns the name of a section, e.g. "joints", or NULL if there is no such
+** section.
+*/
+const char* FxsMD5StatsSectionName(unsigned int section);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5STATS_H */
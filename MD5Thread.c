@@ -0,0 +1,227 @@
+#include "MD5Thread.h"
+
+#if !defined(FXS_MD5_NO_THREADS) && defined(_WIN32)
+#include <stdlib.h>
+
+/*
+** Win32 threads return a DWORD, the function and its argument are passed
+** on to a thread that calls it.
+*/
+typedef struct
+{
+    FxsMD5ThreadFunc func;
+    void* arg;
+}
+ThreadStart;
+
+static DWORD WINAPI threadMain(LPVOID param)
+{
+    ThreadStart start = *(ThreadStart*)param;
+
+    free(param);
+    start.func(start.arg);
+
+    return 0;
+}
+
+int FxsMD5ThreadCreate(FxsMD5Thread* thread, FxsMD5ThreadFunc func, void* arg)
+{
+    ThreadStart* start = (ThreadStart*)malloc(sizeof(ThreadStart));
+
+    if (!start)
+    {
+        return 0;
+    }
+
+    start->func = func;
+    start->arg = arg;
+    *thread = CreateThread(NULL, 0, threadMain, start, 0, NULL);
+
+    if (!*thread)
+    {
+        free(start);
+        return 0;
+    }
+
+    return 1;
+}
+
+void FxsMD5ThreadJoin(FxsMD5Thread* thread)
+{
+    WaitForSingleObject(*thread, INFINITE);
+    CloseHandle(*thread);
+}
+
+void FxsMD5MutexInit(FxsMD5Mutex* mutex)
+{
+    InitializeCriticalSection(mutex);
+}
+
+void FxsMD5MutexDestroy(FxsMD5Mutex* mutex)
+{
+    DeleteCriticalSection(mutex);
+}
+
+void FxsMD5MutexLock(FxsMD5Mutex* mutex)
+{
+    EnterCriticalSection(mutex);
+}
+
+void FxsMD5MutexUnlock(FxsMD5Mutex* mutex)
+{
+    LeaveCriticalSection(mutex);
+}
+
+void FxsMD5ConditionInit(FxsMD5Condition* condition)
+{
+    InitializeConditionVariable(condition);
+}
+
+void FxsMD5ConditionDestroy(FxsMD5Condition* condition)
+{
+    /* condition variables do not own resources */
+    (void)condition;
+}
+
+void FxsMD5ConditionWait(FxsMD5Condition* condition, FxsMD5Mutex* mutex)
+{
+    SleepConditionVariableCS(condition, mutex, INFINITE);
+}
+
+void FxsMD5ConditionBroadcast(FxsMD5Condition* condition)
+{
+    WakeAllConditionVariable(condition);
+}
+
+unsigned int FxsMD5NumProcessors(void)
+{
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+
+    return info.dwNumberOfProcessors > 0 ? (unsigned int)info.dwNumberOfProcessors : 1;
+}
+
+#elif !defined(FXS_MD5_NO_THREADS)
+#include <unistd.h>
+
+int FxsMD5ThreadCreate(FxsMD5Thread* thread, FxsMD5ThreadFunc func, void* arg)
+{
+    return pthread_create(thread, NULL, func, arg) == 0;
+}
+
+void FxsMD5ThreadJoin(FxsMD5Thread* thread)
+{
+    pthread_join(*thread, NULL);
+}
+
+void FxsMD5MutexInit(FxsMD5Mutex* mutex)
+{
+    pthread_mutex_init(mutex, NULL);
+}
+
+void FxsMD5MutexDestroy(FxsMD5Mutex* mutex)
+{
+    pthread_mutex_destroy(mutex);
+}
+
+void FxsMD5MutexLock(FxsMD5Mutex* mutex)
+{
+    pthread_mutex_lock(mutex);
+}
+
+void FxsMD5MutexUnlock(FxsMD5Mutex* mutex)
+{
+    pthread_mutex_unlock(mutex);
+}
+
+void FxsMD5ConditionInit(FxsMD5Condition* condition)
+{
+    pthread_cond_init(condition, NULL);
+}
+
+void FxsMD5ConditionDestroy(FxsMD5Condition* condition)
+{
+    pthread_cond_destroy(condition);
+}
+
+void FxsMD5ConditionWait(FxsMD5Condition* condition, FxsMD5Mutex* mutex)
+{
+    pthread_cond_wait(condition, mutex);
+}
+
+void FxsMD5ConditionBroadcast(FxsMD5Condition* condition)
+{
+    pthread_cond_broadcast(condition);
+}
+
+unsigned int FxsMD5NumProcessors(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (unsigned int)n : 1;
+}
+
+#else
+
+int FxsMD5ThreadCreate(FxsMD5Thread* thread, FxsMD5ThreadFunc func, void* arg)
+{
+    (void)thread;
+    (void)func;
+    (void)arg;
+
+    return 0;
+}
+
+void FxsMD5ThreadJoin(FxsMD5Thread* thread)
+{
+    (void)thread;
+}
+
+void FxsMD5MutexInit(FxsMD5Mutex* mutex)
+{
+    (void)mutex;
+}
+
+void FxsMD5MutexDestroy(FxsMD5Mutex* mutex)
+{
+    (void)mutex;
+}
+
+void FxsMD5MutexLock(FxsMD5Mutex* mutex)
+{
+    (void)mutex;
+}
+
+void FxsMD5MutexUnlock(FxsMD5Mutex* mutex)
+{
+    (void)mutex;
+}
+
+void FxsMD5ConditionInit(FxsMD5Condition* condition)
+{
+    (void)condition;
+}
+
+void FxsMD5ConditionDestroy(FxsMD5Condition* condition)
+{
+    (void)condition;
+}
+
+void FxsMD5ConditionWait(FxsMD5Condition* condition, FxsMD5Mutex* mutex)
+{
+    (void)condition;
+    (void)mutex;
+}
+
+void FxsMD5ConditionBroadcast(FxsMD5Condition* condition)
+{
+    (void)condition;
+}
+
+unsigned int FxsMD5NumProcessors(void)
+{
+    return 1;
+}
+
+#endif
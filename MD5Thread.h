@@ -0,0 +1,66 @@
+#ifndef MD5THREAD_H
+#define MD5THREAD_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+** Thin wrapper around the platform's threads, pthreads or Win32. If
+** FXS_MD5_NO_THREADS is defined threads can not be created and mutexes and
+** conditions do nothing. Everything then has to run on one thread: the
+** objects of the library are not thread safe, and schedulers have to run
+** the tasks before submit returns.
+*/
+
+#if !defined(FXS_MD5_NO_THREADS) && defined(_WIN32)
+#include <windows.h>
+
+typedef HANDLE FxsMD5Thread;
+typedef CRITICAL_SECTION FxsMD5Mutex;
+typedef CONDITION_VARIABLE FxsMD5Condition;
+#elif !defined(FXS_MD5_NO_THREADS)
+#include <pthread.h>
+
+typedef pthread_t FxsMD5Thread;
+typedef pthread_mutex_t FxsMD5Mutex;
+typedef pthread_cond_t FxsMD5Condition;
+#else
+typedef int FxsMD5Thread;
+typedef int FxsMD5Mutex;
+typedef int FxsMD5Condition;
+#endif
+
+typedef void* (*FxsMD5ThreadFunc)(void* arg);
+
+/*
+** Starts a thread that runs func(arg). Returns 0 if it fails.
+*/
+int FxsMD5ThreadCreate(FxsMD5Thread* thread, FxsMD5ThreadFunc func, void* arg);
+
+/*
+** Waits for the thread to finish.
+*/
+void FxsMD5ThreadJoin(FxsMD5Thread* thread);
+
+void FxsMD5MutexInit(FxsMD5Mutex* mutex);
+void FxsMD5MutexDestroy(FxsMD5Mutex* mutex);
+void FxsMD5MutexLock(FxsMD5Mutex* mutex);
+void FxsMD5MutexUnlock(FxsMD5Mutex* mutex);
+
+void FxsMD5ConditionInit(FxsMD5Condition* condition);
+void FxsMD5ConditionDestroy(FxsMD5Condition* condition);
+void FxsMD5ConditionWait(FxsMD5Condition* condition, FxsMD5Mutex* mutex);
+void FxsMD5ConditionBroadcast(FxsMD5Condition* condition);
+
+/*
+** Returns the # of processors that are online, at least 1.
+*/
+unsigned int FxsMD5NumProcessors(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: MD5THREAD_H */
@@ -0,0 +1,668 @@
+/*
+** Reordering of the faces of submeshes for the post transform vertex cache,
+** and of the vertices and weights for the order they are fetched in.
+*/
+
+#include "MD5Mesh.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** Parameters of the vertex scores of Forsyth's algorithm, the cache is an
+** LRU cache of SCORE_CACHE_SIZE vertices.
+*/
+#define SCORE_CACHE_SIZE 32
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_FACE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+/*
+** Marks vertices and weights that were not given a new index yet.
+*/
+#define NO_INDEX 0xFFFFFFFFu
+
+/*
+** FxsMD5SubMeshACMR, counts its block into stats.
+*/
+static float computeACMR(
+    const FxsMD5SubMesh* subMesh,
+    unsigned int cacheSize,
+    FxsMD5Stats* stats
+)
+{
+    unsigned int* inserted;     /* # of misses after the vertex was loaded
+                                ** into the cache, 0 if it never was
+                                */
+    unsigned int misses = 0;
+    unsigned int v[3];
+    int i, k;
+
+    if (subMesh->numFaces <= 0)
+    {
+        return 0.0f;
+    }
+
+    /* all vertices of the faces are invalid */
+    if (subMesh->numVertices <= 0)
+    {
+        return 3.0f;
+    }
+
+    inserted = (unsigned int*)calloc(subMesh->numVertices, sizeof(unsigned int));
+
+    if (!inserted)
+    {
+        ERR_MSG("malloc failed");
+        return 0.0f;
+    }
+
+    FXS_MD5_STATS_ALLOC(stats, sizeof(unsigned int)*subMesh->numVertices);
+
+    for (i = 0; i < subMesh->numFaces; i++)
+    {
+        v[0] = subMesh->faces[i].v1;
+        v[1] = subMesh->faces[i].v2;
+        v[2] = subMesh->faces[i].v3;
+
+        for (k = 0; k < 3; k++)
+        {
+            /* invalid vertices count as misses */
+            if (v[k] >= (unsigned int)subMesh->numVertices)
+            {
+                misses++;
+                continue;
+            }
+
+            /* FIFO: a vertex is evicted cacheSize misses after its load */
+            if (!inserted[v[k]] || misses - inserted[v[k]] >= cacheSize)
+            {
+                misses++;
+                inserted[v[k]] = misses;
+            }
+        }
+    }
+
+    free(inserted);
+
+    return (float)misses/subMesh->numFaces;
+}
+
+float FxsMD5SubMeshACMR(const FxsMD5SubMesh* subMesh, unsigned int cacheSize)
+{
+    return computeACMR(subMesh, cacheSize, NULL);
+}
+
+/*
+** Score of a vertex at a position in the cache (-1 if it is not in the
+** cache) that is used by remaining faces that were not emitted yet.
+*/
+static float vertexScore(int cachePosition, unsigned int remaining)
+{
+    float score = 0.0f;
+
+    if (!remaining)
+    {
+        return -1.0f;
+    }
+
+    if (cachePosition >= 0)
+    {
+        /* the vertices of the last face are scored the same */
+        if (cachePosition < 3)
+        {
+            score = LAST_FACE_SCORE;
+        }
+        else
+        {
+            score = powf(
+                    1.0f - (cachePosition - 3)*(1.0f/(SCORE_CACHE_SIZE - 3)),
+                    CACHE_DECAY_POWER
+                );
+        }
+    }
+
+    /* vertices with few faces left are preferred, to finish them */
+    return score + VALENCE_BOOST_SCALE*powf((float)remaining, -VALENCE_BOOST_POWER);
+}
+
+/*
+** Computes the order of the faces of a submesh for the vertex cache, order
+** receives the old index of each face. Returns 0 if it fails.
+*/
+static int orderFaces(
+    const FxsMD5SubMesh* sm,
+    unsigned int* order,
+    FxsMD5Stats* stats
+)
+{
+    unsigned int numVertices = sm->numVertices;
+    unsigned int numFaces = sm->numFaces;
+    unsigned int* faces;        /* 3 vertices per face */
+    unsigned int* offsets;      /* first face of each vertex in adjacency */
+    unsigned int* adjacency;    /* faces of the vertices */
+    unsigned int* remaining;    /* # of faces of a vertex not emitted yet,
+                                ** they come first in its adjacency
+                                */
+    int* cachePositions;
+    float* vertexScores;
+    float* faceScores;
+    unsigned char* emitted;
+    unsigned int cache[SCORE_CACHE_SIZE + 3];
+    unsigned int newCache[SCORE_CACHE_SIZE + 3];
+    unsigned int cacheSize = 0;
+    unsigned int newCacheSize;
+    unsigned int cursor = 0;    /* faces before it were emitted */
+    size_t size;
+    unsigned int i, j, k, n, v, f;
+    int best;
+    float bestScore;
+
+    size = sizeof(unsigned int)*(numFaces*6 + numVertices*2 + 1)
+        + sizeof(float)*(numVertices + numFaces)
+        + sizeof(int)*numVertices
+        + numFaces;
+    faces = (unsigned int*)malloc(size);
+
+    if (!faces)
+    {
+        ERR_MSG("malloc failed");
+        return 0;
+    }
+
+    FXS_MD5_STATS_ALLOC(stats, size);
+
+    adjacency = faces + numFaces*3;
+    offsets = adjacency + numFaces*3;
+    remaining = offsets + numVertices + 1;
+    vertexScores = (float*)(remaining + numVertices);
+    faceScores = vertexScores + numVertices;
+    cachePositions = (int*)(faceScores + numFaces);
+    emitted = (unsigned char*)(cachePositions + numVertices);
+
+    memset(offsets, 0, sizeof(unsigned int)*(numVertices + 1));
+    memset(emitted, 0, numFaces);
+
+    for (i = 0; i < numFaces; i++)
+    {
+        faces[i*3 + 0] = sm->faces[i].v1;
+        faces[i*3 + 1] = sm->faces[i].v2;
+        faces[i*3 + 2] = sm->faces[i].v3;
+
+        for (k = 0; k < 3; k++)
+        {
+            if (faces[i*3 + k] >= numVertices)
+            {
+                ERR_MSG("Face references invalid vertex");
+                free(faces);
+                return 0;
+            }
+
+            offsets[faces[i*3 + k] + 1]++;
+        }
+    }
+
+    for (v = 0; v < numVertices; v++)
+    {
+        offsets[v + 1] += offsets[v];
+        remaining[v] = 0;
+        cachePositions[v] = -1;
+    }
+
+    for (i = 0; i < numFaces; i++)
+    {
+        for (k = 0; k < 3; k++)
+        {
+            v = faces[i*3 + k];
+            adjacency[offsets[v] + remaining[v]++] = i;
+        }
+    }
+
+    for (v = 0; v < numVertices; v++)
+    {
+        vertexScores[v] = vertexScore(-1, remaining[v]);
+    }
+
+    best = -1;
+    bestScore = -1.0f;
+
+    for (i = 0; i < numFaces; i++)
+    {
+        faceScores[i] = vertexScores[faces[i*3 + 0]]
+            + vertexScores[faces[i*3 + 1]]
+            + vertexScores[faces[i*3 + 2]];
+
+        if (faceScores[i] > bestScore)
+        {
+            bestScore = faceScores[i];
+            best = (int)i;
+        }
+    }
+
+    for (n = 0; n < numFaces; n++)
+    {
+        /* w/o a candidate in the cache continue with the next face */
+        if (best < 0)
+        {
+            while (emitted[cursor])
+            {
+                cursor++;
+            }
+
+            best = (int)cursor;
+        }
+
+        f = (unsigned int)best;
+        order[n] = f;
+        emitted[f] = 1;
+
+        /* remove the face from the faces of its vertices */
+        for (k = 0; k < 3; k++)
+        {
+            v = faces[f*3 + k];
+
+            for (j = offsets[v]; j < offsets[v] + remaining[v]; j++)
+            {
+                if (adjacency[j] == f)
+                {
+                    adjacency[j] = adjacency[offsets[v] + remaining[v] - 1];
+                    remaining[v]--;
+                    break;
+                }
+            }
+        }
+
+        /* the vertices of the face move to the front of the cache */
+        newCacheSize = 0;
+
+        for (k = 0; k < 3; k++)
+        {
+            v = faces[f*3 + k];
+
+            for (j = 0; j < newCacheSize && newCache[j] != v; j++)
+            {
+            }
+
+            if (j == newCacheSize)
+            {
+                newCache[newCacheSize++] = v;
+            }
+        }
+
+        for (i = 0; i < cacheSize; i++)
+        {
+            v = cache[i];
+
+            if (v != faces[f*3 + 0] && v != faces[f*3 + 1] && v != faces[f*3 + 2])
+            {
+                newCache[newCacheSize++] = v;
+            }
+        }
+
+        for (i = 0; i < newCacheSize; i++)
+        {
+            v = newCache[i];
+            cachePositions[v] = i < SCORE_CACHE_SIZE ? (int)i : -1;
+            vertexScores[v] = vertexScore(cachePositions[v], remaining[v]);
+        }
+
+        /* rescore the faces of the vertices, the best one is next */
+        best = -1;
+        bestScore = -1.0f;
+
+        for (i = 0; i < newCacheSize; i++)
+        {
+            v = newCache[i];
+
+            for (j = offsets[v]; j < offsets[v] + remaining[v]; j++)
+            {
+                unsigned int face = adjacency[j];
+
+                faceScores[face] = vertexScores[faces[face*3 + 0]]
+                    + vertexScores[faces[face*3 + 1]]
+                    + vertexScores[faces[face*3 + 2]];
+
+                if (faceScores[face] > bestScore)
+                {
+                    bestScore = faceScores[face];
+                    best = (int)face;
+                }
+            }
+        }
+
+        cacheSize = newCacheSize < SCORE_CACHE_SIZE ? newCacheSize : SCORE_CACHE_SIZE;
+        memcpy(cache, newCache, sizeof(unsigned int)*cacheSize);
+    }
+
+    free(faces);
+
+    return 1;
+}
+
+/*
+** Moves element i of count elements of size bytes to remap[i]. Returns 0
+** if it fails.
+*/
+static int permute(
+    void* data,
+    size_t size,
+    const unsigned int* remap,
+    unsigned int count,
+    FxsMD5Stats* stats
+)
+{
+    char* temp;
+    unsigned int i;
+
+    if (!data || !count)
+    {
+        return 1;
+    }
+
+    temp = (char*)malloc(size*count);
+
+    if (!temp)
+    {
+        ERR_MSG("malloc failed");
+        return 0;
+    }
+
+    FXS_MD5_STATS_ALLOC(stats, size*count);
+
+    for (i = 0; i < count; i++)
+    {
+        memcpy(temp + remap[i]*size, (const char*)data + i*size, size);
+    }
+
+    memcpy(data, temp, size*count);
+    free(temp);
+
+    return 1;
+}
+
+/*
+** Reorders the faces, vertices and weights of a submesh. Returns 0 if it
+** fails.
+*/
+static int optimizeSubMesh(FxsMD5SubMesh* sm, FxsMD5Stats* stats)
+{
+    unsigned int numVertices = sm->numVertices;
+    unsigned int numWeights = sm->numWeights;
+    unsigned int numFaces = sm->numFaces;
+    unsigned int* order;        /* old index of each face */
+    unsigned int* vertexRemap;  /* new index of each vertex */
+    unsigned int* weightRemap;  /* new index of each weight */
+    unsigned int* owners;       /* vertex of each weight, later the old
+                                ** index of each vertex
+                                */
+    FxsMD5Face* faces;
+    FxsMD5Influences* influences = &sm->influences;
+    unsigned int next = 0;
+    unsigned int i, j, v;
+    int k, ok = 1;
+    int ownWeights = 1;         /* runs of weights are not shared */
+
+    /* the weights of a submesh w/o vertices are unused, they keep their
+    ** order
+    */
+    if (!numVertices && !numFaces)
+    {
+        return 1;
+    }
+
+    order = (unsigned int*)malloc(
+            sizeof(unsigned int)*(numFaces + numVertices*2 + numWeights*2)
+        );
+    faces = NULL;
+
+    if (numFaces)
+    {
+        faces = (FxsMD5Face*)malloc(sizeof(FxsMD5Face)*numFaces);
+    }
+
+    if (!order || (numFaces && !faces))
+    {
+        ERR_MSG("malloc failed");
+        free(order);
+        free(faces);
+        return 0;
+    }
+
+    FXS_MD5_STATS_ALLOC(
+        stats,
+        sizeof(unsigned int)*(numFaces + numVertices*2 + numWeights*2)
+    );
+
+    if (faces)
+    {
+        FXS_MD5_STATS_ALLOC(stats, sizeof(FxsMD5Face)*numFaces);
+    }
+
+    vertexRemap = order + numFaces;
+    weightRemap = vertexRemap + numVertices;
+    owners = weightRemap + numWeights;
+
+    /* check the weight runs of the vertices before changing anything */
+    for (i = 0; i < numWeights; i++)
+    {
+        owners[i] = NO_INDEX;
+    }
+
+    for (v = 0; v < numVertices && ok; v++)
+    {
+        const FxsMD5Vertex* vertex = &sm->vertices[v];
+
+        if (vertex->weightId < 0 || vertex->numWeights < 0
+        || vertex->numWeights > sm->numWeights - vertex->weightId)
+        {
+            ERR_MSG("Vertex references invalid weights");
+            ok = 0;
+            break;
+        }
+
+        for (k = 0; k < vertex->numWeights; k++)
+        {
+            if (owners[vertex->weightId + k] != NO_INDEX)
+            {
+                ownWeights = 0;
+            }
+
+            owners[vertex->weightId + k] = v;
+        }
+    }
+
+    if (!ok || !orderFaces(sm, order, stats))
+    {
+        free(order);
+        free(faces);
+        return 0;
+    }
+
+    /* vertices in the order of their first use, unused ones at the end */
+    for (v = 0; v < numVertices; v++)
+    {
+        vertexRemap[v] = NO_INDEX;
+    }
+
+    for (i = 0; i < numFaces; i++)
+    {
+        faces[i] = sm->faces[order[i]];
+        faces[i].id = (int)i;
+
+        if (vertexRemap[faces[i].v1] == NO_INDEX)
+        {
+            vertexRemap[faces[i].v1] = next++;
+        }
+
+        if (vertexRemap[faces[i].v2] == NO_INDEX)
+        {
+            vertexRemap[faces[i].v2] = next++;
+        }
+
+        if (vertexRemap[faces[i].v3] == NO_INDEX)
+        {
+            vertexRemap[faces[i].v3] = next++;
+        }
+
+        faces[i].v1 = vertexRemap[faces[i].v1];
+        faces[i].v2 = vertexRemap[faces[i].v2];
+        faces[i].v3 = vertexRemap[faces[i].v3];
+    }
+
+    for (v = 0; v < numVertices; v++)
+    {
+        if (vertexRemap[v] == NO_INDEX)
+        {
+            vertexRemap[v] = next++;
+        }
+    }
+
+    /* weights in the order of their vertices, unused ones at the end */
+    if (ownWeights)
+    {
+        for (i = 0; i < numWeights; i++)
+        {
+            weightRemap[i] = NO_INDEX;
+        }
+
+        /* owners becomes the old index of each vertex */
+        for (v = 0; v < numVertices; v++)
+        {
+            owners[vertexRemap[v]] = v;
+        }
+
+        next = 0;
+
+        for (i = 0; i < numVertices; i++)
+        {
+            const FxsMD5Vertex* vertex = &sm->vertices[owners[i]];
+
+            for (k = 0; k < vertex->numWeights; k++)
+            {
+                weightRemap[vertex->weightId + k] = next++;
+            }
+        }
+
+        for (j = 0; j < numWeights; j++)
+        {
+            if (weightRemap[j] == NO_INDEX)
+            {
+                weightRemap[j] = next++;
+            }
+        }
+
+        for (v = 0; v < numVertices; v++)
+        {
+            if (sm->vertices[v].numWeights)
+            {
+                sm->vertices[v].weightId = weightRemap[sm->vertices[v].weightId];
+            }
+        }
+
+        if (!permute(sm->weights, sizeof(FxsMD5Weight), weightRemap, numWeights, stats))
+        {
+            ok = 0;
+        }
+
+        for (j = 0; ok && j < numWeights; j++)
+        {
+            sm->weights[j].id = (int)j;
+        }
+    }
+
+    ok = ok && permute(sm->vertices, sizeof(FxsMD5Vertex), vertexRemap, numVertices, stats);
+
+    /* compacted influences follow their vertices */
+    if (ok && influences->numInfluences)
+    {
+        ok = permute(
+                influences->joints,
+                influences->indexSize*influences->numInfluences,
+                vertexRemap,
+                numVertices,
+                stats
+            )
+            && permute(
+                influences->weights,
+                sizeof(unsigned short)*influences->numInfluences,
+                vertexRemap,
+                numVertices,
+                stats
+            )
+            && permute(
+                influences->positions,
+                sizeof(float)*3,
+                vertexRemap,
+                numVertices,
+                stats
+            );
+    }
+
+    if (ok)
+    {
+        for (v = 0; v < numVertices; v++)
+        {
+            sm->vertices[v].id = (int)v;
+        }
+
+        if (numFaces)
+        {
+            memcpy(sm->faces, faces, sizeof(FxsMD5Face)*numFaces);
+        }
+    }
+
+    free(order);
+    free(faces);
+
+    return ok;
+}
+
+int FxsMD5MeshOptimizeVertexCache(
+    FxsMD5Mesh* mesh,
+    FxsMD5VertexCacheStats* stats
+)
+{
+    double before = 0.0;
+    double after = 0.0;
+    unsigned int numFaces = 0;
+    unsigned int i;
+
+    if (mesh->storage)
+    {
+        ERR_MSG("Meshes loaded from binary files can not be changed");
+        return 0;
+    }
+
+    for (i = 0; i < mesh->numSubMeshes; i++)
+    {
+        FxsMD5SubMesh* sm = &mesh->meshes[i];
+
+        if (sm->numFaces <= 0)
+        {
+            continue;
+        }
+
+        before += computeACMR(sm, FXS_MD5_VERTEX_CACHE_SIZE, mesh->stats)*sm->numFaces;
+
+        if (!optimizeSubMesh(sm, mesh->stats))
+        {
+            return 0;
+        }
+
+        after += computeACMR(sm, FXS_MD5_VERTEX_CACHE_SIZE, mesh->stats)*sm->numFaces;
+        numFaces += sm->numFaces;
+    }
+
+    if (stats)
+    {
+        stats->numFaces = numFaces;
+        stats->acmrBefore = numFaces ? (float)(before/numFaces) : 0.0f;
+        stats->acmrAfter = numFaces ? (float)(after/numFaces) : 0.0f;
+    }
+
+    return 1;
+}
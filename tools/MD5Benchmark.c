@@ -0,0 +1,838 @@
+/*
+** Benchmarks of loading, posing and skinning. Times each operation a # of
+** times and prints the latency percentiles and the throughput of each
+** benchmark as JSON to stdout, so runs can be compared by scripts.
+**
+** The loaders are timed with the text files, with the binary files (written
+** next to the inputs as <file>.bench.bin and removed afterwards), with
+** threads parsing the frames and with lazy frames. Pose updates are timed
+** with all frames decoded, with lazy frames and in batches of meshes.
+**
+** usage: MD5Benchmark [-n iterations] [-t threads] mesh.md5mesh anim.md5anim
+**
+** threads is the # of threads of the threaded parse and the skinning jobs,
+** the # of processors by default.
+**
+** Build it with the library sources, e.g. from the repository root:
+** cc -O2 -I. tools/MD5Benchmark.c MD5*.c -lm -lpthread -o MD5Benchmark
+*/
+
+/* clock_gettime is POSIX, not C99 */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "MD5Mesh.h"
+#include "MD5Skinning.h"
+#include "MD5Jobs.h"
+#include "MD5Thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define ERR_MSG(X) fprintf(stderr, "In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** Default # of timed runs of each benchmark.
+*/
+#define DEFAULT_ITERATIONS 100
+
+/*
+** # of untimed runs before the timed runs, to warm up caches.
+*/
+#define WARMUP_ITERATIONS 3
+
+/*
+** Max # of benchmarks of a run.
+*/
+#define MAX_BENCHMARKS 16
+
+/*
+** # of meshes posed by one call of the batched pose update.
+*/
+#define BATCH_SIZE 8
+
+/*
+** Appended to the names of the inputs for the binary files.
+*/
+#define BINARY_SUFFIX ".bench.bin"
+
+static const char* const kernelNames[FXS_MD5_SKIN_NUM_KERNELS] = {
+        "auto",
+        "scalar",
+        "sse",
+        "avx2",
+        "avx512"
+    };
+
+/*
+** Latencies of the runs of a benchmark in nanoseconds, and the amount of
+** work of one run in the unit of the throughput.
+*/
+typedef struct
+{
+    const char* name;
+    const char* unit;           /* throughput unit, e.g. "MB/s" */
+    double workPerRun;          /* MB, joints or vertices of one run */
+    unsigned int numSamples;
+    double* samples;
+}
+Benchmark;
+
+/*
+** Returns a monotonic time stamp in nanoseconds.
+*/
+static double now(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+
+    return (double)counter.QuadPart*1e9/(double)frequency.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec*1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+/*
+** Returns the size of a file in bytes, 0 if it can not be read.
+*/
+static long fileSize(const char* filename)
+{
+    FILE* file = fopen(filename, "rb");
+    long size;
+
+    if (!file)
+    {
+        return 0;
+    }
+
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fclose(file);
+
+    return size < 0 ? 0 : size;
+}
+
+static int compareSamples(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/*
+** Returns the p-th percentile of sorted samples, nearest rank.
+*/
+static double percentile(const double* samples, unsigned int count, double p)
+{
+    unsigned int rank = (unsigned int)(p/100.0*count + 0.5);
+
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+
+    if (rank > count)
+    {
+        rank = count;
+    }
+
+    return samples[rank - 1];
+}
+
+/*
+** Prints a string as a JSON string.
+*/
+static void printString(const char* s)
+{
+    putchar('"');
+
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+        {
+            printf("\\%c", *s);
+        }
+        else if ((unsigned char)*s < 0x20)
+        {
+            printf("\\u%04x", (unsigned char)*s);
+        }
+        else
+        {
+            putchar(*s);
+        }
+    }
+
+    putchar('"');
+}
+
+/*
+** Prints the statistics of a benchmark as a JSON object.
+*/
+static void printBenchmark(Benchmark* benchmark, int isLast)
+{
+    double* s = benchmark->samples;
+    unsigned int n = benchmark->numSamples;
+    double sum = 0.0;
+    double median;
+    unsigned int i;
+
+    qsort(s, n, sizeof(double), compareSamples);
+
+    for (i = 0; i < n; i++)
+    {
+        sum += s[i];
+    }
+
+    median = percentile(s, n, 50.0);
+
+    printf("    {\n");
+    printf("      \"name\": ");
+    printString(benchmark->name);
+    printf(",\n");
+    printf("      \"samples\": %u,\n", n);
+    printf("      \"mean_ns\": %.0f,\n", n ? sum/n : 0.0);
+    printf("      \"min_ns\": %.0f,\n", n ? s[0] : 0.0);
+    printf("      \"p50_ns\": %.0f,\n", n ? median : 0.0);
+    printf("      \"p90_ns\": %.0f,\n", n ? percentile(s, n, 90.0) : 0.0);
+    printf("      \"p99_ns\": %.0f,\n", n ? percentile(s, n, 99.0) : 0.0);
+    printf("      \"max_ns\": %.0f,\n", n ? s[n - 1] : 0.0);
+    printf("      \"throughput\": %.3f,\n",
+        n && median > 0.0 ? benchmark->workPerRun*1e9/median : 0.0);
+    printf("      \"throughput_unit\": ");
+    printString(benchmark->unit);
+    printf("\n    }%s\n", isLast ? "" : ",");
+}
+
+static int createBenchmark(
+    Benchmark* benchmark,
+    const char* name,
+    const char* unit,
+    double workPerRun,
+    unsigned int numSamples
+)
+{
+    benchmark->name = name;
+    benchmark->unit = unit;
+    benchmark->workPerRun = workPerRun;
+    benchmark->numSamples = numSamples;
+    benchmark->samples = (double*)malloc(sizeof(double)*numSamples);
+
+    if (!benchmark->samples)
+    {
+        ERR_MSG("malloc failed");
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+** Times FxsMD5MeshCreateWithFile, or FxsMD5MeshCreateWithBinaryFile if
+** isBinary is set.
+*/
+static int benchmarkMeshLoad(
+    Benchmark* benchmark,
+    const char* name,
+    const char* filename,
+    int isBinary,
+    unsigned int iterations
+)
+{
+    FxsMD5Mesh* mesh;
+    double start;
+    unsigned int i;
+    int success;
+
+    if (!createBenchmark(
+        benchmark,
+        name,
+        "MB/s",
+        fileSize(filename)/1e6,
+        iterations)
+    )
+    {
+        return 0;
+    }
+
+    for (i = 0; i < WARMUP_ITERATIONS + iterations; i++)
+    {
+        start = now();
+
+        success = isBinary
+            ? FxsMD5MeshCreateWithBinaryFile(&mesh, filename)
+            : FxsMD5MeshCreateWithFile(&mesh, filename);
+
+        if (!success)
+        {
+            ERR_MSG("Could not load the mesh");
+            return 0;
+        }
+
+        if (i >= WARMUP_ITERATIONS)
+        {
+            benchmark->samples[i - WARMUP_ITERATIONS] = now() - start;
+        }
+
+        FxsMD5MeshDestroy(&mesh);
+    }
+
+    return 1;
+}
+
+/*
+** Times FxsMD5AnimationCreateWithFileAndOptions, or
+** FxsMD5AnimationCreateWithBinaryFile if isBinary is set.
+*/
+static int benchmarkAnimationLoad(
+    Benchmark* benchmark,
+    const char* name,
+    const char* filename,
+    const FxsMD5AnimationLoadOptions* options,
+    int isBinary,
+    unsigned int iterations
+)
+{
+    FxsMD5Animation* animation;
+    double start;
+    unsigned int i;
+    int success;
+
+    if (!createBenchmark(
+        benchmark,
+        name,
+        "MB/s",
+        fileSize(filename)/1e6,
+        iterations)
+    )
+    {
+        return 0;
+    }
+
+    for (i = 0; i < WARMUP_ITERATIONS + iterations; i++)
+    {
+        start = now();
+
+        success = isBinary
+            ? FxsMD5AnimationCreateWithBinaryFile(&animation, filename)
+            : FxsMD5AnimationCreateWithFileAndOptions(&animation, filename, options);
+
+        if (!success)
+        {
+            ERR_MSG("Could not load the animation");
+            return 0;
+        }
+
+        if (i >= WARMUP_ITERATIONS)
+        {
+            benchmark->samples[i - WARMUP_ITERATIONS] = now() - start;
+        }
+
+        FxsMD5AnimationDestroy(&animation);
+    }
+
+    return 1;
+}
+
+/*
+** Times FxsMD5MeshUpdatePoseWithAnimationFrame, a run poses every frame of
+** the animation once.
+*/
+static int benchmarkPoseUpdate(
+    Benchmark* benchmark,
+    const char* name,
+    FxsMD5Mesh* mesh,
+    const FxsMD5Animation* animation,
+    unsigned int iterations
+)
+{
+    double start;
+    unsigned int i, f;
+
+    if (!createBenchmark(
+        benchmark,
+        name,
+        "joints/s",
+        (double)animation->numJoints*animation->numFrames,
+        iterations)
+    )
+    {
+        return 0;
+    }
+
+    for (i = 0; i < WARMUP_ITERATIONS + iterations; i++)
+    {
+        start = now();
+
+        for (f = 0; f < animation->numFrames; f++)
+        {
+            if (!FxsMD5MeshUpdatePoseWithAnimationFrame(mesh, animation, f))
+            {
+                ERR_MSG("Could not pose the mesh");
+                return 0;
+            }
+        }
+
+        if (i >= WARMUP_ITERATIONS)
+        {
+            benchmark->samples[i - WARMUP_ITERATIONS] = now() - start;
+        }
+    }
+
+    return 1;
+}
+
+/*
+** Times FxsMD5MeshUpdatePosesWithAnimationFrames, a run poses each of the
+** BATCH_SIZE meshes with every frame of the animation once. The meshes are
+** spread over the animation.
+*/
+static int benchmarkPoseUpdateBatch(
+    Benchmark* benchmark,
+    FxsMD5Mesh* const* meshes,
+    const FxsMD5Animation* animation,
+    unsigned int iterations
+)
+{
+    unsigned int frames[BATCH_SIZE];
+    double start;
+    unsigned int i, j, f;
+
+    if (!createBenchmark(
+        benchmark,
+        "pose_update_batch",
+        "joints/s",
+        (double)animation->numJoints*animation->numFrames*BATCH_SIZE,
+        iterations)
+    )
+    {
+        return 0;
+    }
+
+    for (i = 0; i < WARMUP_ITERATIONS + iterations; i++)
+    {
+        start = now();
+
+        for (f = 0; f < animation->numFrames; f++)
+        {
+            for (j = 0; j < BATCH_SIZE; j++)
+            {
+                frames[j] = (f + j*animation->numFrames/BATCH_SIZE)
+                    % animation->numFrames;
+            }
+
+            if (!FxsMD5MeshUpdatePosesWithAnimationFrames(
+                meshes,
+                frames,
+                BATCH_SIZE,
+                animation)
+            )
+            {
+                ERR_MSG("Could not pose the meshes");
+                return 0;
+            }
+        }
+
+        if (i >= WARMUP_ITERATIONS)
+        {
+            benchmark->samples[i - WARMUP_ITERATIONS] = now() - start;
+        }
+    }
+
+    return 1;
+}
+
+/*
+** Writes the binary files of the mesh and the animation. Returns 0 if it
+** fails.
+*/
+static int writeBinaryFiles(
+    const char* meshFile,
+    const char* animationFile,
+    char* meshBinaryFile,
+    char* animationBinaryFile
+)
+{
+    FxsMD5Mesh* mesh = NULL;
+    FxsMD5Animation* animation = NULL;
+    int success;
+
+    sprintf(meshBinaryFile, "%s%s", meshFile, BINARY_SUFFIX);
+    sprintf(animationBinaryFile, "%s%s", animationFile, BINARY_SUFFIX);
+
+    success = FxsMD5MeshCreateWithFile(&mesh, meshFile)
+        && FxsMD5AnimationCreateWithFile(&animation, animationFile)
+        && FxsMD5MeshWriteBinaryFile(mesh, meshBinaryFile)
+        && FxsMD5AnimationWriteBinaryFile(animation, animationBinaryFile);
+
+    if (!success)
+    {
+        ERR_MSG("Could not write the binary files");
+    }
+
+    FxsMD5AnimationDestroy(&animation);
+    FxsMD5MeshDestroy(&mesh);
+
+    return success;
+}
+
+/*
+** Times skinning all submeshes, on the calling thread if scheduler is
+** NULL, otherwise as a job of the scheduler.
+*/
+static int benchmarkSkinning(
+    Benchmark* benchmark,
+    const char* name,
+    const FxsMD5Mesh* mesh,
+    const FxsMD5Skin* skin,
+    float* const* positions,
+    const FxsMD5Scheduler* scheduler,
+    unsigned int iterations
+)
+{
+    FxsMD5SkinJob* job = NULL;
+    double numVertices = 0.0;
+    double start;
+    unsigned int i, j;
+    int success = 1;
+
+    for (j = 0; j < mesh->numSubMeshes; j++)
+    {
+        numVertices += mesh->meshes[j].numVertices;
+    }
+
+    if (!createBenchmark(benchmark, name, "vertices/s", numVertices, iterations))
+    {
+        return 0;
+    }
+
+    if (scheduler && !FxsMD5SkinJobCreate(&job, skin))
+    {
+        return 0;
+    }
+
+    for (i = 0; success && i < WARMUP_ITERATIONS + iterations; i++)
+    {
+        start = now();
+
+        if (job)
+        {
+            success = FxsMD5SkinJobStart(
+                    job,
+                    &mesh->currentPose,
+                    positions,
+                    0,
+                    scheduler
+                );
+            FxsMD5SkinJobWait(job);
+        }
+
+        for (j = 0; !job && success && j < mesh->numSubMeshes; j++)
+        {
+            success = FxsMD5SkinSubMeshPositions(
+                    skin,
+                    j,
+                    &mesh->currentPose,
+                    positions[j],
+                    0
+                );
+        }
+
+        if (i >= WARMUP_ITERATIONS)
+        {
+            benchmark->samples[i - WARMUP_ITERATIONS] = now() - start;
+        }
+    }
+
+    FxsMD5SkinJobDestroy(&job);
+
+    if (!success)
+    {
+        ERR_MSG("Could not skin the mesh");
+    }
+
+    return success;
+}
+
+int main(int argc, char** argv)
+{
+    Benchmark benchmarks[MAX_BENCHMARKS];
+    unsigned int numBenchmarks = 0;
+    unsigned int iterations = DEFAULT_ITERATIONS;
+    unsigned int numThreads = 0;
+    const char* meshFile = NULL;
+    const char* animationFile = NULL;
+    char* meshBinaryFile = NULL;
+    char* animationBinaryFile = NULL;
+    FxsMD5AnimationLoadOptions options;
+    FxsMD5Mesh* meshes[BATCH_SIZE];
+    FxsMD5Mesh* mesh = NULL;
+    FxsMD5Animation* animation = NULL;
+    FxsMD5Animation* lazyAnimation = NULL;
+    FxsMD5Skin* skin = NULL;
+    FxsMD5WorkPool* pool = NULL;
+    FxsMD5Scheduler scheduler;
+    float** positions = NULL;
+    unsigned int i;
+    int hasBinaryFiles = 0;
+    int success = 1;
+
+    for (i = 1; i < (unsigned int)argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < (unsigned int)argc)
+        {
+            iterations = (unsigned int)atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-t") && i + 1 < (unsigned int)argc)
+        {
+            numThreads = (unsigned int)atoi(argv[++i]);
+        }
+        else if (!meshFile)
+        {
+            meshFile = argv[i];
+        }
+        else if (!animationFile)
+        {
+            animationFile = argv[i];
+        }
+    }
+
+    if (!meshFile || !animationFile || !iterations)
+    {
+        fprintf(
+            stderr,
+            "usage: %s [-n iterations] [-t threads] mesh.md5mesh anim.md5anim\n",
+            argv[0]
+        );
+        return 2;
+    }
+
+    if (!numThreads)
+    {
+        numThreads = FxsMD5NumProcessors();
+    }
+
+    memset(benchmarks, 0, sizeof(benchmarks));
+    memset(meshes, 0, sizeof(meshes));
+    memset(&options, 0, sizeof(options));
+
+    meshBinaryFile = (char*)malloc(strlen(meshFile) + sizeof(BINARY_SUFFIX));
+    animationBinaryFile = (char*)malloc(strlen(animationFile) + sizeof(BINARY_SUFFIX));
+
+    if (!meshBinaryFile || !animationBinaryFile)
+    {
+        ERR_MSG("malloc failed");
+        success = 0;
+    }
+
+    /* the loaders */
+    success = success
+        && benchmarkMeshLoad(&benchmarks[numBenchmarks++], "mesh_load", meshFile, 0, iterations)
+        && benchmarkAnimationLoad(
+            &benchmarks[numBenchmarks++],
+            "animation_load",
+            animationFile,
+            NULL,
+            0,
+            iterations
+        );
+
+    options.numThreads = numThreads;
+    success = success
+        && benchmarkAnimationLoad(
+            &benchmarks[numBenchmarks++],
+            "animation_load_threaded",
+            animationFile,
+            &options,
+            0,
+            iterations
+        );
+
+    options.numThreads = 0;
+    options.isLazy = 1;
+    success = success
+        && benchmarkAnimationLoad(
+            &benchmarks[numBenchmarks++],
+            "animation_load_lazy",
+            animationFile,
+            &options,
+            0,
+            iterations
+        );
+
+    /* removed at the end even if only one of them was written */
+    hasBinaryFiles = success;
+    success = success
+        && writeBinaryFiles(meshFile, animationFile, meshBinaryFile, animationBinaryFile)
+        && benchmarkMeshLoad(
+            &benchmarks[numBenchmarks++],
+            "mesh_load_binary",
+            meshBinaryFile,
+            1,
+            iterations
+        )
+        && benchmarkAnimationLoad(
+            &benchmarks[numBenchmarks++],
+            "animation_load_binary",
+            animationBinaryFile,
+            NULL,
+            1,
+            iterations
+        );
+
+    /* the pose updates */
+    if (success
+    && (!FxsMD5MeshCreateWithFile(&mesh, meshFile)
+    || !FxsMD5AnimationCreateWithFile(&animation, animationFile)
+    || !FxsMD5AnimationCreateWithFileAndOptions(&lazyAnimation, animationFile, &options)))
+    {
+        ERR_MSG("Could not load the assets");
+        success = 0;
+    }
+
+    for (i = 0; success && i < BATCH_SIZE; i++)
+    {
+        if (!FxsMD5MeshCreateWithFile(&meshes[i], meshFile))
+        {
+            ERR_MSG("Could not load the assets");
+            success = 0;
+        }
+    }
+
+    success = success
+        && benchmarkPoseUpdate(
+            &benchmarks[numBenchmarks++],
+            "pose_update",
+            mesh,
+            animation,
+            iterations
+        )
+        && benchmarkPoseUpdate(
+            &benchmarks[numBenchmarks++],
+            "pose_update_lazy",
+            mesh,
+            lazyAnimation,
+            iterations
+        )
+        && benchmarkPoseUpdateBatch(&benchmarks[numBenchmarks++], meshes, animation, iterations);
+
+    /* skinning */
+    if (success && !FxsMD5SkinCreateWithMesh(&skin, mesh))
+    {
+        ERR_MSG("Could not create the skin");
+        success = 0;
+    }
+
+    if (success && mesh->numSubMeshes)
+    {
+        positions = (float**)calloc(mesh->numSubMeshes, sizeof(float*));
+        success = positions != NULL;
+
+        /* empty submeshes have no positions */
+        for (i = 0; success && i < mesh->numSubMeshes; i++)
+        {
+            if (mesh->meshes[i].numVertices)
+            {
+                positions[i] = (float*)malloc(sizeof(float)*mesh->meshes[i].numVertices*3);
+                success = positions[i] != NULL;
+            }
+        }
+
+        if (!success)
+        {
+            ERR_MSG("malloc failed");
+        }
+    }
+
+    success = success
+        && benchmarkSkinning(
+            &benchmarks[numBenchmarks++],
+            "skinning",
+            mesh,
+            skin,
+            positions,
+            NULL,
+            iterations
+        );
+
+    if (success && FxsMD5WorkPoolCreate(&pool, numThreads))
+    {
+        scheduler = FxsMD5WorkPoolScheduler(pool);
+        success = benchmarkSkinning(
+                &benchmarks[numBenchmarks++],
+                "skinning_job",
+                mesh,
+                skin,
+                positions,
+                &scheduler,
+                iterations
+            );
+    }
+
+    if (success)
+    {
+        printf("{\n");
+        printf("  \"mesh\": ");
+        printString(meshFile);
+        printf(",\n  \"animation\": ");
+        printString(animationFile);
+        printf(",\n  \"iterations\": %u,\n", iterations);
+        printf("  \"threads\": %u,\n", numThreads);
+        printf("  \"skin_kernel\": ");
+        printString(kernelNames[skin->kernel]);
+        printf(",\n  \"benchmarks\": [\n");
+
+        for (i = 0; i < numBenchmarks; i++)
+        {
+            printBenchmark(&benchmarks[i], i + 1 == numBenchmarks);
+        }
+
+        printf("  ]\n}\n");
+    }
+
+    for (i = 0; i < numBenchmarks; i++)
+    {
+        free(benchmarks[i].samples);
+    }
+
+    for (i = 0; positions && i < mesh->numSubMeshes; i++)
+    {
+        free(positions[i]);
+    }
+
+    for (i = 0; i < BATCH_SIZE; i++)
+    {
+        FxsMD5MeshDestroy(&meshes[i]);
+    }
+
+    if (hasBinaryFiles)
+    {
+        remove(meshBinaryFile);
+        remove(animationBinaryFile);
+    }
+
+    free(positions);
+    free(meshBinaryFile);
+    free(animationBinaryFile);
+    FxsMD5WorkPoolDestroy(&pool);
+    FxsMD5SkinDestroy(&skin);
+    FxsMD5AnimationDestroy(&lazyAnimation);
+    FxsMD5AnimationDestroy(&animation);
+    FxsMD5MeshDestroy(&mesh);
+
+    return success ? 0 : 1;
+}
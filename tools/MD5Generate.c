@@ -0,0 +1,796 @@
+/*
+** Writes synthetic .md5mesh and .md5anim files of any size, to test and
+** benchmark the loaders at production scale without production assets.
+** The same options and seed always give the same files. The animation
+** fits the mesh: both have the same joint hierarchy, and the base frame is
+** the bind pose of the mesh.
+**
+** usage: MD5Generate [options] out.md5mesh out.md5anim
+**
+**  -joints N       # of joints (64)
+**  -depth N        longest chain of joints from the root (8)
+**  -meshes N       # of submeshes (1)
+**  -verts N        # of vertices of each submesh, rounded down to a grid
+**                  (10000)
+**  -weights N      # of weights of each vertex (4)
+**  -components N   # of animated components, at most 6*joints (6*joints)
+**  -frames N       # of frames (240)
+**  -rate N         frame rate (24)
+**  -seed N         seed of the random numbers (1)
+**  -shuffle        writes the faces in a scattered order, like exporters
+**                  that do not care for the vertex cache
+**
+** Build it from the repository root:
+** cc -O2 tools/MD5Generate.c -lm -o MD5Generate
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERR_MSG(X) fprintf(stderr, "In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** Distance of neighbouring vertices of the grid of a submesh.
+*/
+#define GRID_SPACING 0.01f
+
+/*
+** Streams of the random numbers, so each part of the files can be
+** generated on its own and in any order.
+*/
+#define STREAM_HIERARCHY    1
+#define STREAM_BIND_POSE    2
+#define STREAM_WEIGHTS      3
+#define STREAM_MOTION       4
+
+typedef struct
+{
+    unsigned int numJoints;
+    unsigned int maxDepth;
+    unsigned int numSubMeshes;
+    unsigned int numVertices;
+    unsigned int numWeights;
+    unsigned int numComponents;
+    unsigned int numFrames;
+    unsigned int frameRate;
+    unsigned int seed;
+    int shuffle;
+}
+Options;
+
+/*
+** A joint of the bind pose, in object space and relative to its parent.
+*/
+typedef struct
+{
+    int parent;
+    int flags;                  /* animated components, MD5 anim flags */
+    int startIndex;             /* first animated component in a frame */
+    float position[3];          /* object space */
+    float orientation[4];       /* object space, x, y, z, w with w <= 0 */
+    float localPosition[3];
+    float localOrientation[4];
+}
+Joint;
+
+/*
+** Size of the grid of a submesh.
+*/
+typedef struct
+{
+    unsigned int width;
+    unsigned int height;
+}
+Grid;
+
+/*
+** Hashes a seed and three values to 32 random bits.
+*/
+static unsigned int hash(
+    unsigned int seed,
+    unsigned int a,
+    unsigned int b,
+    unsigned int c
+)
+{
+    unsigned int h = seed*0x9E3779B9u ^ a*0x85EBCA6Bu ^ b*0xC2B2AE35u ^ c*0x27D4EB2Fu;
+
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+
+    return h;
+}
+
+/*
+** Returns a random float in [0, 1).
+*/
+static float random01(
+    unsigned int seed,
+    unsigned int a,
+    unsigned int b,
+    unsigned int c
+)
+{
+    return (hash(seed, a, b, c) >> 8)*(1.0f/16777216.0f);
+}
+
+/*
+** Rotates v by the unit quaternion q.
+*/
+static void rotate(float* result, const float* q, const float* v)
+{
+    float t[3];
+    int i;
+
+    /* t = 2*cross(q.xyz, v), result = v + w*t + cross(q.xyz, t) */
+    t[0] = 2.0f*(q[1]*v[2] - q[2]*v[1]);
+    t[1] = 2.0f*(q[2]*v[0] - q[0]*v[2]);
+    t[2] = 2.0f*(q[0]*v[1] - q[1]*v[0]);
+
+    for (i = 0; i < 3; i++)
+    {
+        result[i] = v[i] + q[3]*t[i];
+    }
+
+    result[0] += q[1]*t[2] - q[2]*t[1];
+    result[1] += q[2]*t[0] - q[0]*t[2];
+    result[2] += q[0]*t[1] - q[1]*t[0];
+}
+
+/*
+** result = conjugate(a)*b, both unit quaternions.
+*/
+static void multiplyConjugate(float* result, const float* a, const float* b)
+{
+    float ax = -a[0], ay = -a[1], az = -a[2], aw = a[3];
+
+    result[0] = aw*b[0] + ax*b[3] + ay*b[2] - az*b[1];
+    result[1] = aw*b[1] - ax*b[2] + ay*b[3] + az*b[0];
+    result[2] = aw*b[2] + ax*b[1] - ay*b[0] + az*b[3];
+    result[3] = aw*b[3] - ax*b[0] - ay*b[1] - az*b[2];
+}
+
+/*
+** MD5 files store x, y, z of quaternions with w <= 0.
+*/
+static void makeNegativeW(float* q)
+{
+    int i;
+
+    if (q[3] > 0.0f)
+    {
+        for (i = 0; i < 4; i++)
+        {
+            q[i] = -q[i];
+        }
+    }
+}
+
+static Grid gridOf(const Options* options)
+{
+    Grid grid;
+
+    grid.width = (unsigned int)sqrt((double)options->numVertices);
+    grid.width = grid.width < 2 ? 2 : grid.width;
+    grid.height = options->numVertices/grid.width;
+    grid.height = grid.height < 2 ? 2 : grid.height;
+
+    return grid;
+}
+
+/*
+** Object space position of vertex i of a submesh.
+*/
+static void vertexPosition(float* p, const Grid* grid, unsigned int subMesh, unsigned int i)
+{
+    p[0] = (i % grid->width)*GRID_SPACING;
+    p[1] = (i/grid->width)*GRID_SPACING;
+    p[2] = subMesh*GRID_SPACING*4.0f;
+}
+
+/*
+** Builds the hierarchy and the bind pose. Each joint has at most
+** numComponents/numJoints + 1 animated components, rotations first.
+*/
+static Joint* createJoints(const Options* options)
+{
+    const unsigned int order[6] = {8, 16, 32, 1, 2, 4}; /* Qx Qy Qz Tx Ty Tz */
+    Grid grid = gridOf(options);
+    Joint* joints;
+    unsigned int* depths;
+    unsigned int numJoints = options->numJoints;
+    unsigned int i, k, n, tries;
+    int startIndex = 0;
+    float norm;
+
+    joints = (Joint*)calloc(numJoints + 1, sizeof(Joint));
+    depths = (unsigned int*)calloc(numJoints + 1, sizeof(unsigned int));
+
+    if (!joints || !depths)
+    {
+        ERR_MSG("malloc failed");
+        free(joints);
+        free(depths);
+        return NULL;
+    }
+
+    for (i = 0; i < numJoints; i++)
+    {
+        Joint* joint = &joints[i];
+
+        /* a chain down to the largest depth, then random parents above it */
+        if (options->maxDepth <= 1 || i == 0)
+        {
+            joint->parent = -1;
+        }
+        else if (i < options->maxDepth)
+        {
+            joint->parent = (int)i - 1;
+        }
+        else
+        {
+            joint->parent = 0;
+
+            for (tries = 0; tries < 16; tries++)
+            {
+                k = hash(options->seed, STREAM_HIERARCHY, i, tries) % i;
+
+                if (depths[k] + 1 < options->maxDepth)
+                {
+                    joint->parent = (int)k;
+                    break;
+                }
+            }
+        }
+
+        depths[i] = joint->parent < 0 ? 0 : depths[joint->parent] + 1;
+
+        /* bind pose spread over the grid */
+        joint->position[0] = random01(options->seed, STREAM_BIND_POSE, i, 0)
+            *grid.width*GRID_SPACING;
+        joint->position[1] = random01(options->seed, STREAM_BIND_POSE, i, 1)
+            *grid.height*GRID_SPACING;
+        joint->position[2] = random01(options->seed, STREAM_BIND_POSE, i, 2)
+            *options->numSubMeshes*GRID_SPACING*4.0f;
+
+        for (k = 0; k < 4; k++)
+        {
+            joint->orientation[k] = random01(options->seed, STREAM_BIND_POSE, i, 3 + k)
+                *2.0f - 1.0f;
+        }
+
+        norm = sqrtf(joint->orientation[0]*joint->orientation[0]
+            + joint->orientation[1]*joint->orientation[1]
+            + joint->orientation[2]*joint->orientation[2]
+            + joint->orientation[3]*joint->orientation[3]);
+
+        for (k = 0; k < 4; k++)
+        {
+            joint->orientation[k] = norm > 0.0f ? joint->orientation[k]/norm
+                : (k == 3 ? -1.0f : 0.0f);
+        }
+
+        makeNegativeW(joint->orientation);
+
+        /* base frame relative to the parent */
+        if (joint->parent < 0)
+        {
+            memcpy(joint->localPosition, joint->position, sizeof(joint->position));
+            memcpy(joint->localOrientation, joint->orientation, sizeof(joint->orientation));
+        }
+        else
+        {
+            const Joint* parent = &joints[joint->parent];
+            float conjugate[4];
+            float d[3];
+
+            for (k = 0; k < 3; k++)
+            {
+                d[k] = joint->position[k] - parent->position[k];
+                conjugate[k] = -parent->orientation[k];
+            }
+
+            conjugate[3] = parent->orientation[3];
+            rotate(joint->localPosition, conjugate, d);
+            multiplyConjugate(joint->localOrientation, parent->orientation, joint->orientation);
+            makeNegativeW(joint->localOrientation);
+        }
+
+        /* spread the animated components over the joints */
+        n = options->numComponents/numJoints + (i < options->numComponents % numJoints);
+
+        for (k = 0; k < n && k < 6; k++)
+        {
+            joint->flags |= order[k];
+        }
+
+        joint->startIndex = startIndex;
+        startIndex += n;
+    }
+
+    free(depths);
+
+    return joints;
+}
+
+/*
+** Writes the mesh. The weights of a vertex are recomputed from its index,
+** so the vertices, faces and weights stream out without being stored.
+*/
+static int writeMesh(
+    FILE* file,
+    const Options* options,
+    const Joint* joints,
+    const char* commandLine
+)
+{
+    Grid grid = gridOf(options);
+    unsigned int numVertices = grid.width*grid.height;
+    unsigned int numQuads = (grid.width - 1)*(grid.height - 1);
+    unsigned int numWeights = options->numWeights;
+    unsigned int step = 1;
+    unsigned int s, i, k, q, x, y, v;
+    float values[256];
+    float sum;
+
+    /* a step coprime with the # of quads visits each quad once */
+    if (options->shuffle)
+    {
+        unsigned int a, b, t;
+
+        for (step = 7919; step < numQuads; step += 2)
+        {
+            for (a = step, b = numQuads; b; t = a % b, a = b, b = t);
+
+            if (a == 1)
+            {
+                break;
+            }
+        }
+
+        step = step % numQuads ? step % numQuads : 1;
+    }
+
+    fprintf(file, "MD5Version 10\ncommandline \"%s\"\n\n", commandLine);
+    fprintf(file, "numJoints %u\nnumMeshes %u\n\n", options->numJoints, options->numSubMeshes);
+    fprintf(file, "joints {\n");
+
+    for (i = 0; i < options->numJoints; i++)
+    {
+        fprintf(
+            file,
+            "\t\"joint%u\"\t%d ( %f %f %f ) ( %f %f %f )\n",
+            i,
+            joints[i].parent,
+            joints[i].position[0],
+            joints[i].position[1],
+            joints[i].position[2],
+            joints[i].orientation[0],
+            joints[i].orientation[1],
+            joints[i].orientation[2]
+        );
+    }
+
+    fprintf(file, "}\n");
+
+    for (s = 0; s < options->numSubMeshes; s++)
+    {
+        fprintf(file, "\nmesh {\n\tshader \"synthetic%u\"\n\n\tnumverts %u\n", s, numVertices);
+
+        for (i = 0; i < numVertices; i++)
+        {
+            fprintf(
+                file,
+                "\tvert %u ( %f %f ) %u %u\n",
+                i,
+                (float)(i % grid.width)/(grid.width - 1),
+                (float)(i/grid.width)/(grid.height - 1),
+                i*numWeights,
+                numWeights
+            );
+        }
+
+        fprintf(file, "\n\tnumtris %u\n", numQuads*2);
+
+        for (i = 0, q = 0; i < numQuads; i++, q = (q + step) % numQuads)
+        {
+            x = q % (grid.width - 1);
+            y = q/(grid.width - 1);
+            v = y*grid.width + x;
+
+            fprintf(file, "\ttri %u %u %u %u\n", i*2, v, v + grid.width, v + 1);
+            fprintf(file, "\ttri %u %u %u %u\n", i*2 + 1, v + 1, v + grid.width, v + grid.width + 1);
+        }
+
+        fprintf(file, "\n\tnumweights %u\n", numVertices*numWeights);
+
+        for (i = 0; i < numVertices; i++)
+        {
+            float p[3];
+
+            vertexPosition(p, &grid, s, i);
+
+            for (k = 0, sum = 0.0f; k < numWeights; k++)
+            {
+                values[k] = 0.1f + random01(options->seed, STREAM_WEIGHTS, s*numVertices + i, k*2);
+                sum += values[k];
+            }
+
+            /* the weights are joint local, so the bind pose gives p back */
+            for (k = 0; k < numWeights; k++)
+            {
+                unsigned int j = hash(options->seed, STREAM_WEIGHTS, s*numVertices + i, k*2 + 1)
+                    % options->numJoints;
+                float conjugate[4];
+                float d[3];
+                float w[3];
+                int c;
+
+                for (c = 0; c < 3; c++)
+                {
+                    d[c] = p[c] - joints[j].position[c];
+                    conjugate[c] = -joints[j].orientation[c];
+                }
+
+                conjugate[3] = joints[j].orientation[3];
+                rotate(w, conjugate, d);
+
+                fprintf(
+                    file,
+                    "\tweight %u %u %f ( %f %f %f )\n",
+                    i*numWeights + k,
+                    j,
+                    values[k]/sum,
+                    w[0],
+                    w[1],
+                    w[2]
+                );
+            }
+        }
+
+        fprintf(file, "}\n");
+    }
+
+    return !ferror(file);
+}
+
+/*
+** Writes the animation. Each frame moves the base frame a little along
+** sine waves of different phases, one frame at a time.
+*/
+static int writeAnimation(
+    FILE* file,
+    const Options* options,
+    const Joint* joints,
+    const char* commandLine
+)
+{
+    const char* names[6] = {"Tx", "Ty", "Tz", "Qx", "Qy", "Qz"};
+    Grid grid = gridOf(options);
+    float min[3], max[3], pad;
+    unsigned int f, i, k;
+
+    max[0] = grid.width*GRID_SPACING;
+    max[1] = grid.height*GRID_SPACING;
+    max[2] = options->numSubMeshes*GRID_SPACING*4.0f;
+    pad = (max[0] > max[1] ? max[0] : max[1])*0.5f + 1.0f;
+
+    for (k = 0; k < 3; k++)
+    {
+        min[k] = -pad;
+        max[k] += pad;
+    }
+
+    fprintf(file, "MD5Version 10\ncommandline \"%s\"\n\n", commandLine);
+    fprintf(
+        file,
+        "numFrames %u\nnumJoints %u\nframeRate %u\nnumAnimatedComponents %u\n\n",
+        options->numFrames,
+        options->numJoints,
+        options->frameRate,
+        options->numComponents
+    );
+    fprintf(file, "hierarchy {\n");
+
+    for (i = 0; i < options->numJoints; i++)
+    {
+        fprintf(
+            file,
+            "\t\"joint%u\"\t%d %d %d\t//",
+            i,
+            joints[i].parent,
+            joints[i].flags,
+            joints[i].startIndex
+        );
+
+        if (joints[i].parent >= 0)
+        {
+            fprintf(file, " joint%d", joints[i].parent);
+        }
+
+        if (joints[i].flags)
+        {
+            fprintf(file, " (");
+
+            for (k = 0; k < 6; k++)
+            {
+                if (joints[i].flags & (1 << k))
+                {
+                    fprintf(file, " %s", names[k]);
+                }
+            }
+
+            fprintf(file, " )");
+        }
+
+        fprintf(file, "\n");
+    }
+
+    fprintf(file, "}\n\nbounds {\n");
+
+    for (f = 0; f < options->numFrames; f++)
+    {
+        fprintf(file, "\t( %f %f %f ) ( %f %f %f )\n", min[0], min[1], min[2], max[0], max[1], max[2]);
+    }
+
+    fprintf(file, "}\n\nbaseframe {\n");
+
+    for (i = 0; i < options->numJoints; i++)
+    {
+        fprintf(
+            file,
+            "\t( %f %f %f ) ( %f %f %f )\n",
+            joints[i].localPosition[0],
+            joints[i].localPosition[1],
+            joints[i].localPosition[2],
+            joints[i].localOrientation[0],
+            joints[i].localOrientation[1],
+            joints[i].localOrientation[2]
+        );
+    }
+
+    fprintf(file, "}\n");
+
+    for (f = 0; f < options->numFrames; f++)
+    {
+        float t = 6.2831853f*f/options->numFrames;
+
+        fprintf(file, "\nframe %u {\n", f);
+
+        for (i = 0; i < options->numJoints; i++)
+        {
+            float values[6];
+            float length;
+
+            if (!joints[i].flags)
+            {
+                continue;
+            }
+
+            for (k = 0; k < 6; k++)
+            {
+                float phase = 6.2831853f*random01(options->seed, STREAM_MOTION, i, k);
+                float amplitude = k < 3 ? 0.02f : 0.1f;
+
+                values[k] = (k < 3 ? joints[i].localPosition[k] : joints[i].localOrientation[k - 3])
+                    + amplitude*sinf(t + phase);
+            }
+
+            /* keep the rotations unit quaternions */
+            length = values[3]*values[3] + values[4]*values[4] + values[5]*values[5];
+
+            if (length > 0.998f)
+            {
+                length = sqrtf(0.998f/length);
+
+                for (k = 3; k < 6; k++)
+                {
+                    values[k] *= length;
+                }
+            }
+
+            fprintf(file, "\t");
+
+            for (k = 0; k < 6; k++)
+            {
+                if (joints[i].flags & (1 << k))
+                {
+                    fprintf(file, " %f", values[k]);
+                }
+            }
+
+            fprintf(file, "\n");
+        }
+
+        fprintf(file, "}\n");
+    }
+
+    return !ferror(file);
+}
+
+/*
+** Parses the value of option argv[*i].
+*/
+static int readOption(unsigned int* value, int argc, char** argv, int* i)
+{
+    char* end;
+    unsigned long parsed;
+
+    if (*i + 1 >= argc)
+    {
+        return 0;
+    }
+
+    parsed = strtoul(argv[*i + 1], &end, 10);
+
+    if (*end || end == argv[*i + 1] || argv[*i + 1][0] == '-' || parsed > 0x7FFFFFFFul)
+    {
+        return 0;
+    }
+
+    *value = (unsigned int)parsed;
+    (*i)++;
+
+    return 1;
+}
+
+static int writeFile(
+    const char* path,
+    int (*write)(FILE*, const Options*, const Joint*, const char*),
+    const Options* options,
+    const Joint* joints,
+    const char* commandLine
+)
+{
+    FILE* file = fopen(path, "w");
+    int written;
+
+    if (!file)
+    {
+        ERR_MSG("Could not open file");
+        return 0;
+    }
+
+    written = write(file, options, joints, commandLine);
+    written = fclose(file) == 0 && written;
+
+    if (!written)
+    {
+        ERR_MSG("Could not write file");
+    }
+
+    return written;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    Joint* joints;
+    char commandLine[512];
+    const char* paths[2] = {NULL, NULL};
+    int numPaths = 0;
+    int componentsSet = 0;
+    int parsed = 1;
+    int i;
+
+    options.numJoints = 64;
+    options.maxDepth = 8;
+    options.numSubMeshes = 1;
+    options.numVertices = 10000;
+    options.numWeights = 4;
+    options.numComponents = 0;
+    options.numFrames = 240;
+    options.frameRate = 24;
+    options.seed = 1;
+    options.shuffle = 0;
+
+    commandLine[0] = '\0';
+
+    /* the command line goes into the files, without quotes */
+    for (i = 1; i < argc; i++)
+    {
+        if (strlen(commandLine) + strlen(argv[i]) + 2 < sizeof(commandLine)
+        && !strchr(argv[i], '"'))
+        {
+            strcat(commandLine, i > 1 ? " " : "");
+            strcat(commandLine, argv[i]);
+        }
+    }
+
+    for (i = 1; i < argc && parsed; i++)
+    {
+        if (!strcmp(argv[i], "-joints"))
+        {
+            parsed = readOption(&options.numJoints, argc, argv, &i);
+        }
+        else if (!strcmp(argv[i], "-depth"))
+        {
+            parsed = readOption(&options.maxDepth, argc, argv, &i);
+        }
+        else if (!strcmp(argv[i], "-meshes"))
+        {
+            parsed = readOption(&options.numSubMeshes, argc, argv, &i);
+        }
+        else if (!strcmp(argv[i], "-verts"))
+        {
+            parsed = readOption(&options.numVertices, argc, argv, &i);
+        }
+        else if (!strcmp(argv[i], "-weights"))
+        {
+            parsed = readOption(&options.numWeights, argc, argv, &i);
+        }
+        else if (!strcmp(argv[i], "-components"))
+        {
+            parsed = readOption(&options.numComponents, argc, argv, &i);
+            componentsSet = 1;
+        }
+        else if (!strcmp(argv[i], "-frames"))
+        {
+            parsed = readOption(&options.numFrames, argc, argv, &i);
+        }
+        else if (!strcmp(argv[i], "-rate"))
+        {
+            parsed = readOption(&options.frameRate, argc, argv, &i);
+        }
+        else if (!strcmp(argv[i], "-seed"))
+        {
+            parsed = readOption(&options.seed, argc, argv, &i);
+        }
+        else if (!strcmp(argv[i], "-shuffle"))
+        {
+            options.shuffle = 1;
+        }
+        else if (argv[i][0] != '-' && numPaths < 2)
+        {
+            paths[numPaths++] = argv[i];
+        }
+        else
+        {
+            parsed = 0;
+        }
+    }
+
+    if (!componentsSet)
+    {
+        options.numComponents = options.numJoints*6;
+    }
+
+    if (!parsed || numPaths != 2 || !options.numJoints || !options.numSubMeshes
+    || !options.numWeights || options.numWeights > 256 || !options.numFrames
+    || !options.frameRate || options.numJoints > 0x7FFFFFFFu/6
+    || options.numComponents > options.numJoints*6
+    || options.numVertices > 0x7FFFFFFFu/options.numWeights)
+    {
+        fprintf(
+            stderr,
+            "usage: %s [-joints N] [-depth N] [-meshes N] [-verts N] [-weights N]\n"
+            "       [-components N] [-frames N] [-rate N] [-seed N] [-shuffle]\n"
+            "       out.md5mesh out.md5anim\n",
+            argv[0]
+        );
+        return 1;
+    }
+
+    joints = createJoints(&options);
+
+    if (!joints)
+    {
+        return 1;
+    }
+
+    if (!writeFile(paths[0], writeMesh, &options, joints, commandLine)
+    || !writeFile(paths[1], writeAnimation, &options, joints, commandLine))
+    {
+        free(joints);
+        return 1;
+    }
+
+    free(joints);
+
+    return 0;
+}
@@ -0,0 +1,311 @@
+/*
+** Checks that FxsMD5ScanFloat reads the same floats as strtof, bit for bit,
+** and stops at the same char. Checks a list of inputs that take the slow
+** path (hex, inf, nan, too many digits, exponents out of range, halfway
+** cases, tokens longer than the stack buffer), then random floats in
+** several notations and random strings of digits. Also checks that
+** FxsMD5ScanInt matches strtol in the range of int and that neither scanner
+** writes the value if it fails. Prints the first mismatches, the exit code
+** is 1 if any input does not match.
+**
+** usage: MD5ScanTest [count] [seed]
+**
+** count is the # of random inputs of each kind (1000000), seed the seed of
+** the random numbers (1).
+**
+** Build it with the library sources, e.g. from the repository root:
+** cc -O2 -I. tools/MD5ScanTest.c MD5*.c -lm -lpthread -o MD5ScanTest
+*/
+
+#include "MD5Parser.h"
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+** # of mismatches that are printed.
+*/
+#define MAX_REPORTS 20
+
+/*
+** Written to the value before each scan, to catch failed scans that write
+** it.
+*/
+#define SENTINEL_FLOAT 12345.0f
+#define SENTINEL_INT 12345
+
+static const char* const floatInputs[] = {
+        /* the fast path */
+        "0", "-0", "+0", "1", "-1", "0.5", ".5", "5.", "-.5", "3.14159",
+        "0.1", "0.2", "0.3", "1e10", "1E10", "1e+10", "1e-10", "-2.5e-3",
+        "000001.5000", "0.000001", "123456789", "1234567890123456789",
+        "3.4028234e38", "1.17549435e-38", "1e22", "1e-22",
+        /* halfway between two floats */
+        "16777217", "33554434", "-16777217", "16777219", "0.5000000298023223876953125",
+        "1.00000005960464477539062500",
+        /* hex, inf and nan */
+        "0x1p3", "0X1.8p-1", "-0x10", "0x", "inf", "-inf", "INF",
+        "infinity", "-Infinity", "nan", "NAN", "-nan",
+        /* more than 19 significant digits */
+        "12345678901234567890", "1.23456789012345678901234567890",
+        "0.000000000000000000000000000000000000000000000000123456789012345678901",
+        "340282356779733661637539395458142568448",
+        "340282356779733661637539395458142568447",
+        /* exponents out of the range of the fast path */
+        "1e23", "1e-23", "1e38", "3.4028236e38", "1e39", "-1e39", "1e-38",
+        "1e-40", "1.4e-45", "7e-46", "1e-46", "1e99999", "1e-99999",
+        "0e99999", "123e-30", "9007199254740993", "9007199254740993e-5",
+        /* longer than the buffer on the stack */
+        "0.00000000000000000000000000000000000000000000000000000000000000000000001",
+        "100000000000000000000000000000000000000000000000000000000000000000000000",
+        /* garbage and partial numbers */
+        "", "-", "+", ".", "-.", "e5", "1e", "1e+", "1e-x", "1.5f", "1..5",
+        "1.5.5", "--1", "1x", "0x1p", "1e5x", "1(", "2)", "3\"", "4}"
+    };
+
+static const char* const intInputs[] = {
+        "0", "-0", "+7", "42", "-42", "0012", "2147483647", "-2147483648",
+        "2147483648", "-2147483649", "99999999999999999999",
+        "-99999999999999999999", "12abc", "", "-", "+", "x1", "1.5"
+    };
+
+/*
+** Seed of the random numbers.
+*/
+static unsigned int state = 1;
+
+static unsigned int random32(void)
+{
+    /* xorshift32 */
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    return state;
+}
+
+static unsigned long numChecked = 0;
+static unsigned long numFailed = 0;
+
+static void report(const char* message, const char* str)
+{
+    numFailed++;
+
+    if (numFailed <= MAX_REPORTS)
+    {
+        printf("%s: \"%s\"\n", message, str);
+    }
+}
+
+/*
+** Compares FxsMD5ScanFloat with strtof for a zero terminated string.
+*/
+static void checkFloat(const char* str)
+{
+    const char* end = str + strlen(str);
+    const char* next;
+    char* refEnd;
+    float value = SENTINEL_FLOAT;
+    float ref;
+    unsigned int bits, refBits;
+
+    numChecked++;
+    next = FxsMD5ScanFloat(str, end, &value);
+    ref = strtof(str, &refEnd);
+
+    if (refEnd == str)
+    {
+        if (next)
+        {
+            report("float read, strtof reads nothing", str);
+        }
+        else if (value != SENTINEL_FLOAT)
+        {
+            report("float written on failure", str);
+        }
+
+        return;
+    }
+
+    if (next != refEnd)
+    {
+        report("float ends at another char than strtof", str);
+        return;
+    }
+
+    memcpy(&bits, &value, sizeof(bits));
+    memcpy(&refBits, &ref, sizeof(refBits));
+
+    /* NaNs only need to be NaN, the payload may differ */
+    if (bits != refBits && !(value != value && ref != ref))
+    {
+        report("float does not match strtof", str);
+    }
+}
+
+/*
+** Compares FxsMD5ScanInt with strtol for a zero terminated string.
+*/
+static void checkInt(const char* str)
+{
+    const char* end = str + strlen(str);
+    const char* next;
+    char* refEnd;
+    int value = SENTINEL_INT;
+    long ref;
+
+    numChecked++;
+    next = FxsMD5ScanInt(str, end, &value);
+    errno = 0;
+    ref = strtol(str, &refEnd, 10);
+
+    /* strtol skips blanks, the inputs have none */
+    if (refEnd == str || errno == ERANGE || ref < INT_MIN || ref > INT_MAX)
+    {
+        if (next)
+        {
+            report("int read, it is no int", str);
+        }
+        else if (value != SENTINEL_INT)
+        {
+            report("int written on failure", str);
+        }
+
+        return;
+    }
+
+    if (next != refEnd || value != (int)ref)
+    {
+        report("int does not match strtol", str);
+    }
+}
+
+/*
+** Checks a random float in several notations.
+*/
+static void checkRandomFloat(void)
+{
+    char str[256];
+    unsigned int bits = random32();
+    float f, next;
+    double halfway;
+
+    memcpy(&f, &bits, sizeof(f));
+
+    snprintf(str, sizeof(str), "%.9g", f);
+    checkFloat(str);
+    snprintf(str, sizeof(str), "%.17g", f);
+    checkFloat(str);
+    snprintf(str, sizeof(str), "%.3e", f);
+    checkFloat(str);
+    snprintf(str, sizeof(str), "%a", f);
+    checkFloat(str);
+
+    if (fabsf(f) < 1e6f)
+    {
+        snprintf(str, sizeof(str), "%.6f", f);
+        checkFloat(str);
+    }
+
+    /* exactly halfway to the next float, the rounding is to even */
+    if (isfinite(f))
+    {
+        next = nextafterf(f, INFINITY);
+
+        if (isfinite(next))
+        {
+            halfway = ((double)f + (double)next)*0.5;
+            snprintf(str, sizeof(str), "%.60g", halfway);
+            checkFloat(str);
+        }
+    }
+}
+
+/*
+** Checks a random string of up to 24 digits with a random decimal point and
+** exponent.
+*/
+static void checkRandomDigits(void)
+{
+    char str[64];
+    unsigned int numDigits = 1 + random32() % 24;
+    unsigned int point = random32() % (numDigits + 2);
+    unsigned int i;
+    char* cur = str;
+
+    if (random32() & 1)
+    {
+        *cur++ = '-';
+    }
+
+    for (i = 0; i < numDigits; i++)
+    {
+        if (i == point)
+        {
+            *cur++ = '.';
+        }
+
+        *cur++ = (char)('0' + random32() % 10);
+    }
+
+    if (random32() & 1)
+    {
+        cur += sprintf(cur, "e%d", (int)(random32() % 101) - 50);
+    }
+
+    *cur = '\0';
+    checkFloat(str);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long count = 1000000;
+    unsigned long i;
+
+    if (argc > 3)
+    {
+        fprintf(stderr, "usage: %s [count] [seed]\n", argv[0]);
+        return 1;
+    }
+
+    if (argc > 1)
+    {
+        count = strtoul(argv[1], NULL, 10);
+    }
+
+    if (argc > 2)
+    {
+        state = (unsigned int)strtoul(argv[2], NULL, 10);
+    }
+
+    /* xorshift never leaves 0 */
+    state = state ? state : 1;
+
+    for (i = 0; i < sizeof(floatInputs)/sizeof(floatInputs[0]); i++)
+    {
+        checkFloat(floatInputs[i]);
+    }
+
+    for (i = 0; i < sizeof(intInputs)/sizeof(intInputs[0]); i++)
+    {
+        checkInt(intInputs[i]);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        checkRandomFloat();
+        checkRandomDigits();
+    }
+
+    printf(
+        "%lu inputs checked, %lu mismatches: %s\n",
+        numChecked,
+        numFailed,
+        numFailed ? "FAILED" : "ok"
+    );
+
+    return numFailed ? 1 : 0;
+}
@@ -0,0 +1,269 @@
+/*
+** Checks that every skinning kernel the CPU supports matches the scalar
+** kernel. Skins the positions, normals and tangents of all submeshes in
+** the bind pose and in each frame of the animation, and compares them with
+** a tight tolerance. Kernels the CPU does not support are skipped. Prints
+** the largest error of each kernel, the exit code is 1 if a kernel does
+** not match.
+**
+** usage: MD5SkinTest mesh.md5mesh [anim.md5anim]
+**
+** Build it with the library sources, e.g. from the repository root:
+** cc -O2 -I. tools/MD5SkinTest.c MD5*.c -lm -lpthread -o MD5SkinTest
+**
+** tools/MD5Generate.c writes meshes and animations of any size to run it
+** on.
+*/
+
+#include "MD5Mesh.h"
+#include "MD5Skinning.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERR_MSG(X) fprintf(stderr, "In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** Largest error allowed, relative to the size of the value, but at least
+** absolute. The kernels sum the influences in the same order, only fused
+** multiply-adds round differently.
+*/
+#define TOLERANCE 1e-5f
+
+static const char* const kernelNames[FXS_MD5_SKIN_NUM_KERNELS] = {
+        "auto",
+        "scalar",
+        "sse",
+        "avx2",
+        "avx512"
+    };
+
+/*
+** Positions (3 floats), normals (3) and tangents (4) of a submesh.
+*/
+typedef struct
+{
+    float* positions;
+    float* normals;
+    float* tangents;
+}
+Vertices;
+
+static int createVertices(Vertices* vertices, unsigned int numVertices)
+{
+    /* nothing to skin, the buffers stay NULL */
+    if (!numVertices)
+    {
+        return 1;
+    }
+
+    vertices->positions = (float*)malloc(sizeof(float)*3*numVertices);
+    vertices->normals = (float*)malloc(sizeof(float)*3*numVertices);
+    vertices->tangents = (float*)malloc(sizeof(float)*4*numVertices);
+
+    return vertices->positions && vertices->normals && vertices->tangents;
+}
+
+static void destroyVertices(Vertices* vertices)
+{
+    free(vertices->positions);
+    free(vertices->normals);
+    free(vertices->tangents);
+}
+
+/*
+** Skins a submesh with the current kernel of the skin.
+*/
+static int skinSubMesh(
+    const FxsMD5Skin* skin,
+    unsigned int subMesh,
+    const FxsMD5Skeleton* pose,
+    Vertices* vertices
+)
+{
+    return FxsMD5SkinSubMeshPositions(skin, subMesh, pose, vertices->positions, 0)
+        && FxsMD5SkinSubMeshNormals(
+            skin,
+            subMesh,
+            pose,
+            vertices->normals,
+            vertices->tangents,
+            0
+        );
+}
+
+/*
+** Returns the largest error of count floats relative to the reference.
+*/
+static float maxError(const float* values, const float* reference, unsigned int count)
+{
+    float error = 0.0f;
+    float e;
+    unsigned int i;
+
+    for (i = 0; i < count; i++)
+    {
+        e = fabsf(values[i] - reference[i]);
+        e /= fabsf(reference[i]) > 1.0f ? fabsf(reference[i]) : 1.0f;
+
+        /* NaN never compares, so it has to be caught on its own */
+        if (e != e)
+        {
+            return INFINITY;
+        }
+
+        error = e > error ? e : error;
+    }
+
+    return error;
+}
+
+/*
+** Compares the kernels in the current pose of the mesh, errors holds the
+** largest error of each kernel so far.
+*/
+static int comparePose(
+    FxsMD5Skin* skin,
+    const FxsMD5Mesh* mesh,
+    Vertices* reference,
+    Vertices* vertices,
+    float* errors
+)
+{
+    unsigned int i, n;
+    int kernel;
+    float e;
+
+    for (i = 0; i < mesh->numSubMeshes; i++)
+    {
+        n = mesh->meshes[i].numVertices;
+
+        if (!FxsMD5SkinSetKernel(skin, FXS_MD5_SKIN_KERNEL_SCALAR)
+        || !skinSubMesh(skin, i, &mesh->currentPose, reference))
+        {
+            return 0;
+        }
+
+        for (kernel = FXS_MD5_SKIN_KERNEL_SSE; kernel < FXS_MD5_SKIN_NUM_KERNELS; kernel++)
+        {
+            if (!FxsMD5SkinIsKernelSupported(kernel))
+            {
+                continue;
+            }
+
+            if (!FxsMD5SkinSetKernel(skin, kernel)
+            || !skinSubMesh(skin, i, &mesh->currentPose, vertices))
+            {
+                return 0;
+            }
+
+            e = maxError(vertices->positions, reference->positions, n*3);
+            errors[kernel] = e > errors[kernel] ? e : errors[kernel];
+            e = maxError(vertices->normals, reference->normals, n*3);
+            errors[kernel] = e > errors[kernel] ? e : errors[kernel];
+            e = maxError(vertices->tangents, reference->tangents, n*4);
+            errors[kernel] = e > errors[kernel] ? e : errors[kernel];
+        }
+    }
+
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    FxsMD5Mesh* mesh = NULL;
+    FxsMD5Animation* animation = NULL;
+    FxsMD5Skin* skin = NULL;
+    Vertices reference;
+    Vertices vertices;
+    float errors[FXS_MD5_SKIN_NUM_KERNELS];
+    unsigned int maxVertices = 0;
+    unsigned int numPoses = 1;
+    unsigned int i;
+    int kernel;
+    int success = 1;
+    int passed = 1;
+
+    if (argc != 2 && argc != 3)
+    {
+        fprintf(stderr, "usage: %s mesh.md5mesh [anim.md5anim]\n", argv[0]);
+        return 1;
+    }
+
+    memset(&reference, 0, sizeof(Vertices));
+    memset(&vertices, 0, sizeof(Vertices));
+    memset(errors, 0, sizeof(errors));
+
+    if (!FxsMD5MeshCreateWithFile(&mesh, argv[1])
+    || (argc == 3 && !FxsMD5AnimationCreateWithFile(&animation, argv[2])))
+    {
+        ERR_MSG("Could not load the mesh or the animation");
+        success = 0;
+    }
+
+    if (success && (!FxsMD5SkinCreateWithMesh(&skin, mesh)
+    || !FxsMD5SkinAddNormals(skin, mesh)))
+    {
+        ERR_MSG("Could not create the skin");
+        success = 0;
+    }
+
+    for (i = 0; success && i < mesh->numSubMeshes; i++)
+    {
+        if ((unsigned int)mesh->meshes[i].numVertices > maxVertices)
+        {
+            maxVertices = mesh->meshes[i].numVertices;
+        }
+    }
+
+    if (success && (!createVertices(&reference, maxVertices)
+    || !createVertices(&vertices, maxVertices)))
+    {
+        ERR_MSG("malloc failed");
+        success = 0;
+    }
+
+    /* the bind pose, then each frame */
+    success = success && comparePose(skin, mesh, &reference, &vertices, errors);
+
+    for (i = 0; success && animation && i < animation->numFrames; i++)
+    {
+        success = FxsMD5MeshUpdatePoseWithAnimationFrame(mesh, animation, i)
+            && comparePose(skin, mesh, &reference, &vertices, errors);
+        numPoses++;
+    }
+
+    if (!success)
+    {
+        ERR_MSG("Could not skin the mesh");
+    }
+
+    /* report all kernels, then fail */
+    for (kernel = FXS_MD5_SKIN_KERNEL_SSE; success && kernel < FXS_MD5_SKIN_NUM_KERNELS; kernel++)
+    {
+        if (!FxsMD5SkinIsKernelSupported(kernel))
+        {
+            printf("%-8s skipped, not supported\n", kernelNames[kernel]);
+            continue;
+        }
+
+        printf(
+            "%-8s max error %g in %u poses: %s\n",
+            kernelNames[kernel],
+            errors[kernel],
+            numPoses,
+            errors[kernel] <= TOLERANCE ? "ok" : "FAILED"
+        );
+
+        passed = passed && errors[kernel] <= TOLERANCE;
+    }
+
+    destroyVertices(&reference);
+    destroyVertices(&vertices);
+    FxsMD5SkinDestroy(&skin);
+    FxsMD5AnimationDestroy(&animation);
+    FxsMD5MeshDestroy(&mesh);
+
+    return success && passed ? 0 : 1;
+}